@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
 #include <err.h>
 #include <errno.h>
@@ -7,6 +9,7 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include "asgn2_helper_funcs.h"
@@ -21,6 +24,8 @@ void handlePUTRequest(int clientSocket, const char *resourceURI, int contentLeng
 int validateHeaders(const char *headerBuffer);
 ssize_t readUntilDelimiter(int fileDescriptor, char buffer[], size_t maxBytes);
 ssize_t my_pass_n_bytes(int sourceFd, int destinationFd, size_t bytesToPass);
+ssize_t mySendfileNBytes(int fileFd, int socketFd, size_t bytesToPass);
+ssize_t mySpliceNBytes(int socketFd, int fileFd, size_t bytesToPass);
 bool isValidMethod(const char *method);
 
 // Function to get current time in milliseconds
@@ -266,7 +271,11 @@ void handleGETRequest(int clientSocket, const char *resourceURI) {
     char responseHeader[256];
     sprintf(responseHeader, "HTTP/1.1 200 OK\r\nContent-Length: %ld\r\n\r\n", contentLength);
     write_n_bytes(clientSocket, responseHeader, strlen(responseHeader));
-    my_pass_n_bytes(fileFd, clientSocket, contentLength);
+    if (S_ISREG(fileStats.st_mode)) {
+        mySendfileNBytes(fileFd, clientSocket, contentLength);
+    } else {
+        my_pass_n_bytes(fileFd, clientSocket, contentLength);
+    }
     close(fileFd);
 }
 
@@ -287,6 +296,65 @@ ssize_t my_pass_n_bytes(int sourceFd, int destinationFd, size_t bytesToPass) {
     return bytesToPass;
 }
 
+// Function to send a regular file with sendfile so its bytes never enter user space
+ssize_t mySendfileNBytes(int fileFd, int socketFd, size_t bytesToPass) {
+    size_t bytesSent = 0;
+    while (bytesSent < bytesToPass) {
+        ssize_t sent = sendfile(socketFd, fileFd, NULL, bytesToPass - bytesSent);
+        if (sent < 0 && errno == EINTR) {
+            continue; // Retry after interrupts
+        }
+        if (sent < 0 && bytesSent == 0) {
+            return my_pass_n_bytes(fileFd, socketFd, bytesToPass); // sendfile not supported
+        }
+        if (sent <= 0) {
+            return sent < 0 ? -1 : (ssize_t) bytesSent;
+        }
+        bytesSent += sent;
+    }
+    return bytesSent;
+}
+
+// Function to move bytes from a socket into a file through a pipe with splice
+ssize_t mySpliceNBytes(int socketFd, int fileFd, size_t bytesToPass) {
+    int pipeFds[2];
+    if (pipe(pipeFds) < 0) {
+        return my_pass_n_bytes(socketFd, fileFd, bytesToPass);
+    }
+    size_t bytesMoved = 0;
+    while (bytesMoved < bytesToPass) {
+        ssize_t inPipe
+            = splice(socketFd, NULL, pipeFds[1], NULL, bytesToPass - bytesMoved, SPLICE_F_MOVE);
+        if (inPipe < 0 && errno == EINTR) {
+            continue; // Retry after interrupts
+        }
+        if (inPipe < 0 && bytesMoved == 0 && errno == EINVAL) {
+            close(pipeFds[0]);
+            close(pipeFds[1]);
+            return my_pass_n_bytes(socketFd, fileFd, bytesToPass); // splice not supported
+        }
+        if (inPipe <= 0) {
+            break; // Handle errors or end of file
+        }
+        while (inPipe > 0) {
+            ssize_t outPipe = splice(pipeFds[0], NULL, fileFd, NULL, inPipe, SPLICE_F_MOVE);
+            if (outPipe < 0 && errno == EINTR) {
+                continue;
+            }
+            if (outPipe <= 0) {
+                close(pipeFds[0]);
+                close(pipeFds[1]);
+                return -1;
+            }
+            inPipe -= outPipe;
+            bytesMoved += outPipe;
+        }
+    }
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    return bytesMoved;
+}
+
 // Function to handle PUT requests
 void handlePUTRequest(int clientSocket, const char *resourceURI, int contentLength) {
     if (contentLength == -1) {
@@ -321,7 +389,7 @@ void handlePUTRequest(int clientSocket, const char *resourceURI, int contentLeng
             86);
         return;
     }
-    int bytesWritten = my_pass_n_bytes(clientSocket, fileFd, contentLength);
+    int bytesWritten = mySpliceNBytes(clientSocket, fileFd, contentLength);
     if (bytesWritten != contentLength) {
         close(fileFd);
         write_n_bytes(clientSocket,
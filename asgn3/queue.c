@@ -1,74 +1,311 @@
 #include "queue.h"
 
-#include <assert.h>
-#include <pthread.h>
-#include <semaphore.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
+#define CACHE_LINE_SIZE 64
+
+// A bounded MPMC queue (Vyukov's design). Each slot carries a sequence number that says whose
+// turn it is: seq == pos means the slot is free for the producer of position pos, and
+// seq == pos + 1 means it holds that producer's element for the consumer of position pos.
+// Threads only sleep (on a futex) when the queue is empty or full.
+typedef struct slot {
+    _Atomic uint64_t seq;
+    void *elem;
+} slot_t;
+
+// Producers, consumers and each kind of sleeper get their own cache lines
 struct queue {
-    int size;
-    int in;
-    int out;
-    void **buf;
-    sem_t full_slots;
-    sem_t empty_slots;
-    pthread_mutex_t mutex;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t head; // next position to push
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail; // next position to pop
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t pushed; // futex word bumped to wake poppers
+    _Atomic uint32_t pop_waiters;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t popped; // futex word bumped to wake pushers
+    _Atomic uint32_t push_waiters;
+    _Alignas(CACHE_LINE_SIZE) uint64_t mask;
+    slot_t *slots;
 };
 
+static int futex_wait(_Atomic uint32_t *word, uint32_t val, const struct timespec *timeout) {
+    return (int) syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word, int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+// Function to wake up to count sleepers, but only pay for the syscall if someone sleeps.
+// Reading waiters with an RMW orders it against the sleeper's increment: either that comes
+// first and we see it, or it comes after and the sleeper sees our slot update when it looks
+// again. (A locked add is also cheaper than a full fence on x86.)
+static void wake(_Atomic uint32_t *word, _Atomic uint32_t *waiters, int count) {
+    if (atomic_fetch_add(waiters, 0) > 0) {
+        atomic_fetch_add(word, 1);
+        futex_wake(word, count);
+    }
+}
+
 queue_t *queue_new(int size) {
-    queue_t *q = (queue_t *) malloc(sizeof(queue_t));
-    if (q) {
-        q->size = size;
-        q->in = 0;
-        q->out = 0;
-        q->buf = (void **) malloc(size * sizeof(void *));
-        if (!q->buf) {
-            free(q);
-            return NULL;
-        }
-        if (sem_init(&q->full_slots, 0, size) != 0 || sem_init(&q->empty_slots, 0, 0) != 0
-            || pthread_mutex_init(&q->mutex, NULL) != 0) {
-            free(q->buf);
-            free(q);
-            return NULL;
-        }
+    if (size < 1) {
+        return NULL;
     }
+    queue_t *q = aligned_alloc(CACHE_LINE_SIZE, sizeof(queue_t));
+    if (q == NULL) {
+        return NULL;
+    }
+    // One slot can't tell "free for the next lap" from "full" by its sequence number alone
+    uint64_t capacity = 2;
+    while (capacity < (uint64_t) size) {
+        capacity <<= 1;
+    }
+    q->slots = malloc(capacity * sizeof(slot_t));
+    if (q->slots == NULL) {
+        free(q);
+        return NULL;
+    }
+    for (uint64_t i = 0; i < capacity; i++) {
+        atomic_init(&q->slots[i].seq, i);
+    }
+    q->mask = capacity - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->pushed, 0);
+    atomic_init(&q->pop_waiters, 0);
+    atomic_init(&q->popped, 0);
+    atomic_init(&q->push_waiters, 0);
     return q;
 }
 
 void queue_delete(queue_t **q) {
     if (q && *q) {
-        sem_destroy(&(*q)->full_slots);
-        sem_destroy(&(*q)->empty_slots);
-        pthread_mutex_destroy(&(*q)->mutex);
-        free((*q)->buf);
+        free((*q)->slots);
         free(*q);
         *q = NULL;
     }
 }
 
+// Function to claim up to n consecutive free slots; returns the first position via *first
+static int claim_push(queue_t *q, int n, uint64_t *first) {
+    uint64_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        int k = 0;
+        while (k < n) {
+            slot_t *slot = &q->slots[(pos + k) & q->mask];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + k) {
+                break;
+            }
+            k++;
+        }
+        if (k == 0) {
+            // Either the queue is full or another producer already took pos
+            slot_t *slot = &q->slots[pos & q->mask];
+            int64_t diff = (int64_t) (atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+            if (diff < 0) {
+                return 0;
+            }
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+            continue;
+        }
+        // Nobody else can touch slots pos..pos+k-1 until head moves past them, so if the CAS
+        // succeeds they are still free
+        if (atomic_compare_exchange_weak_explicit(
+                &q->head, &pos, pos + k, memory_order_relaxed, memory_order_relaxed)) {
+            *first = pos;
+            return k;
+        }
+    }
+}
+
+// Function to claim up to n consecutive filled slots; returns the first position via *first
+static int claim_pop(queue_t *q, int n, uint64_t *first) {
+    uint64_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        int k = 0;
+        while (k < n) {
+            slot_t *slot = &q->slots[(pos + k) & q->mask];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + k + 1) {
+                break;
+            }
+            k++;
+        }
+        if (k == 0) {
+            slot_t *slot = &q->slots[pos & q->mask];
+            int64_t diff
+                = (int64_t) (atomic_load_explicit(&slot->seq, memory_order_acquire) - (pos + 1));
+            if (diff < 0) {
+                return 0;
+            }
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+            continue;
+        }
+        if (atomic_compare_exchange_weak_explicit(
+                &q->tail, &pos, pos + k, memory_order_relaxed, memory_order_relaxed)) {
+            *first = pos;
+            return k;
+        }
+    }
+}
+
+// Function to push as many of elems as fit right now
+static int push_some(queue_t *q, void **elems, int n) {
+    uint64_t pos;
+    int k = claim_push(q, n, &pos);
+    for (int i = 0; i < k; i++) {
+        slot_t *slot = &q->slots[(pos + i) & q->mask];
+        slot->elem = elems[i];
+        atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+    }
+    if (k > 0) {
+        wake(&q->pushed, &q->pop_waiters, k);
+    }
+    return k;
+}
+
+// Function to pop as many elements (up to n) as are there right now
+static int pop_some(queue_t *q, void **elems, int n) {
+    uint64_t pos;
+    int k = claim_pop(q, n, &pos);
+    for (int i = 0; i < k; i++) {
+        slot_t *slot = &q->slots[(pos + i) & q->mask];
+        elems[i] = slot->elem;
+        atomic_store_explicit(&slot->seq, pos + i + q->mask + 1, memory_order_release);
+    }
+    if (k > 0) {
+        wake(&q->popped, &q->push_waiters, k);
+    }
+    return k;
+}
+
+static struct timespec deadline_after(int timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// Function to sleep until word moves past seen or the deadline (NULL: none) passes.
+// Returns false once the deadline has passed.
+static bool park(_Atomic uint32_t *word, uint32_t seen, const struct timespec *deadline) {
+    struct timespec left, *timeout = NULL;
+    if (deadline != NULL) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left.tv_sec = deadline->tv_sec - now.tv_sec;
+        left.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+        if (left.tv_nsec < 0) {
+            left.tv_sec--;
+            left.tv_nsec += 1000000000L;
+        }
+        if (left.tv_sec < 0) {
+            return false;
+        }
+        timeout = &left;
+    }
+    if (futex_wait(word, seen, timeout) < 0 && errno == ETIMEDOUT) {
+        return false;
+    }
+    return true;
+}
+
+// Function to move n elements in or out of the queue, parking while it is full (or empty).
+// With all set every element must move; otherwise the call returns once at least one has.
+static int transfer(queue_t *q, void **elems, int n, bool push, bool all,
+    const struct timespec *deadline) {
+    _Atomic uint32_t *word = push ? &q->popped : &q->pushed;
+    _Atomic uint32_t *waiters = push ? &q->push_waiters : &q->pop_waiters;
+    int done = 0;
+    for (;;) {
+        done += push ? push_some(q, elems + done, n - done) : pop_some(q, elems + done, n - done);
+        if (done == n || (done > 0 && !all)) {
+            return done;
+        }
+
+        // Announce that we are about to sleep, then look once more before sleeping
+        uint32_t seen = atomic_load(word);
+        atomic_fetch_add(waiters, 1);
+        done += push ? push_some(q, elems + done, n - done) : pop_some(q, elems + done, n - done);
+        bool slept = true;
+        if (done < n && (done == 0 || all)) {
+            slept = park(word, seen, deadline);
+        }
+        atomic_fetch_sub(waiters, 1);
+        if (done == n || (done > 0 && !all)) {
+            return done;
+        }
+        if (!slept) {
+            return done;
+        }
+    }
+}
+
 bool queue_push(queue_t *q, void *elem) {
     if (q == NULL) {
         return false;
     }
-    sem_wait(&q->full_slots);
-    pthread_mutex_lock(&q->mutex);
-    q->buf[q->in] = elem;
-    q->in = (q->in + 1) % q->size;
-    pthread_mutex_unlock(&q->mutex);
-    sem_post(&q->empty_slots);
-    return true;
+    return transfer(q, &elem, 1, true, true, NULL) == 1;
 }
 
 bool queue_pop(queue_t *q, void **elem) {
     if (q == NULL) {
         return false;
     }
-    sem_wait(&q->empty_slots);
-    pthread_mutex_lock(&q->mutex);
-    *elem = q->buf[q->out];
-    q->out = (q->out + 1) % q->size;
-    pthread_mutex_unlock(&q->mutex);
-    sem_post(&q->full_slots);
-    return true;
+    return transfer(q, elem, 1, false, true, NULL) == 1;
+}
+
+bool queue_try_push(queue_t *q, void *elem) {
+    return q != NULL && push_some(q, &elem, 1) == 1;
+}
+
+bool queue_try_pop(queue_t *q, void **elem) {
+    return q != NULL && pop_some(q, elem, 1) == 1;
+}
+
+bool queue_push_timed(queue_t *q, void *elem, int timeout_ms) {
+    if (q == NULL) {
+        return false;
+    }
+    struct timespec deadline = deadline_after(timeout_ms);
+    return transfer(q, &elem, 1, true, true, &deadline) == 1;
+}
+
+bool queue_pop_timed(queue_t *q, void **elem, int timeout_ms) {
+    if (q == NULL) {
+        return false;
+    }
+    struct timespec deadline = deadline_after(timeout_ms);
+    return transfer(q, elem, 1, false, true, &deadline) == 1;
+}
+
+int queue_push_n(queue_t *q, void **elems, int n) {
+    if (q == NULL || n < 0) {
+        return -1;
+    }
+    return n == 0 ? 0 : transfer(q, elems, n, true, true, NULL);
+}
+
+int queue_pop_n(queue_t *q, void **elems, int max) {
+    if (q == NULL || max < 0) {
+        return -1;
+    }
+    return max == 0 ? 0 : transfer(q, elems, max, false, false, NULL);
+}
+
+int queue_size(queue_t *q) {
+    if (q == NULL) {
+        return 0;
+    }
+    // Read tail first so that head can only have moved further on
+    uint64_t tail = atomic_load(&q->tail);
+    uint64_t head = atomic_load(&q->head);
+    return head > tail ? (int) (head - tail) : 0;
 }
@@ -0,0 +1,352 @@
+/**
+ * @File queue_test.c
+ *
+ * Throughput and latency benchmark for queue_t.  For every combination
+ * of producer/consumer counts and queue capacities it moves a fixed
+ * number of elements through one queue, timing every push and pop, and
+ * prints one CSV row with the throughput and the p50/p99/p99.9 latency
+ * of each side.  Latencies include time spent blocked on a full or empty
+ * queue, which is what callers see.
+ *
+ * Every element carries its producer's id and a sequence number, and the
+ * consumers check that each one arrives exactly once and that each
+ * producer's arrive in the order it pushed them.  Before timing anything,
+ * a few small runs put every way to push and pop (one at a time, in
+ * batches, timed, and non-blocking) through the same checks.  The
+ * benchmark fails if any check does.
+ *
+ * usage: ./queue_test [-l label] [-o ops] [-b batch] [-m mode] [-p P:C,P:C,...]
+ *                     [-c cap1,cap2,...]
+ *
+ *   -l  tag every row, e.g. with the commit being measured (default "queue")
+ *   -b  move elements with queue_push_n/queue_pop_n in batches of this size
+ *   -m  "timed" moves them with queue_push_timed/queue_pop_timed, and "try"
+ *       with queue_try_push/queue_try_pop, retrying until they succeed
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+
+#define MAX_CONFIGS 32
+#define MAX_BATCH   256
+#define TIMEOUT_MS  10 // what timed pushes and pops wait before they give up (and are retried)
+
+// How elements are pushed and popped; blocking ones in batches if batch is more than 1
+typedef enum { MODE_BLOCKING, MODE_TIMED, MODE_TRY } op_mode_t;
+
+static const char *mode_names[] = { "blocking", "timed", "try" };
+
+// What the consumers of a run have seen, shared by all of them: how many times each element of
+// each producer arrived, and how many checks failed
+typedef struct {
+    int producers;
+    long per_producer; // elements each producer pushes
+    _Atomic unsigned char *seen; // per_producer counts per producer
+    atomic_long violations;
+} ledger_t;
+
+typedef struct {
+    queue_t *q;
+    int id; // of a producer, from 0
+    long ops; // elements this thread moves
+    int batch;
+    op_mode_t mode;
+    ledger_t *ledger;
+    uint64_t *samples; // ns per call
+    long nsamples;
+} worker_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Function to make the element that is the seq'th (from 1) pushed by producer id
+static void *tag(int id, long seq) {
+    return (void *) (((uintptr_t) (id + 1) << 32) | (uintptr_t) seq);
+}
+
+// Function to report a failed check, printing the first few
+static void violation(ledger_t *ledger, const char *what, uintptr_t elem) {
+    if (atomic_fetch_add(&ledger->violations, 1) < 10) {
+        fprintf(stderr, "queue_test: %s: producer %lu, element %lu\n", what,
+            (unsigned long) (elem >> 32) - 1, (unsigned long) (elem & 0xffffffff));
+    }
+}
+
+// Function to check an element a consumer popped: it must be one that was pushed, not seen
+// before, and after any other of its producer's this consumer has seen (last, per producer)
+static void check_elem(ledger_t *ledger, void *elem, long *last) {
+    uintptr_t e = (uintptr_t) elem;
+    long p = (long) (e >> 32) - 1, seq = (long) (e & 0xffffffff);
+    if (p < 0 || p >= ledger->producers || seq < 1 || seq > ledger->per_producer) {
+        violation(ledger, "an element that was never pushed", e);
+        return;
+    }
+    if (seq <= last[p]) {
+        violation(ledger, "out of order", e);
+    }
+    last[p] = seq;
+    if (atomic_fetch_add(&ledger->seen[p * ledger->per_producer + seq - 1], 1) != 0) {
+        violation(ledger, "popped more than once", e);
+    }
+}
+
+static void *producer(void *arg) {
+    worker_t *w = arg;
+    void *elems[MAX_BATCH];
+    for (long i = 0; i < w->ops; i += w->batch) {
+        int n = w->ops - i < w->batch ? (int) (w->ops - i) : w->batch;
+        for (int j = 0; j < n; j++) {
+            elems[j] = tag(w->id, i + j + 1);
+        }
+        uint64_t start = now_ns();
+        if (w->mode == MODE_TIMED) {
+            while (!queue_push_timed(w->q, elems[0], TIMEOUT_MS)) {
+            }
+        } else if (w->mode == MODE_TRY) {
+            while (!queue_try_push(w->q, elems[0])) {
+                sched_yield();
+            }
+        } else if (w->batch == 1) {
+            queue_push(w->q, elems[0]);
+        } else {
+            queue_push_n(w->q, elems, n);
+        }
+        w->samples[w->nsamples++] = now_ns() - start;
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    worker_t *w = arg;
+    void *elems[MAX_BATCH];
+    long *last = calloc(w->ledger->producers, sizeof(long));
+    long got = 0;
+    while (got < w->ops) {
+        int want = w->ops - got < w->batch ? (int) (w->ops - got) : w->batch;
+        int n = 1;
+        uint64_t start = now_ns();
+        if (w->mode == MODE_TIMED) {
+            while (!queue_pop_timed(w->q, elems, TIMEOUT_MS)) {
+            }
+        } else if (w->mode == MODE_TRY) {
+            while (!queue_try_pop(w->q, elems)) {
+                sched_yield();
+            }
+        } else if (w->batch == 1) {
+            queue_pop(w->q, elems);
+        } else {
+            n = queue_pop_n(w->q, elems, want);
+        }
+        w->samples[w->nsamples++] = now_ns() - start;
+        if (n < 1 || n > want) {
+            atomic_fetch_add(&w->ledger->violations, 1);
+            fprintf(stderr, "queue_test: popped %d elements, asked for at most %d\n", n, want);
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            check_elem(w->ledger, elems[i], last);
+        }
+        got += n;
+    }
+    free(last);
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to merge the samples of count workers and find the p50, p99 and p99.9
+static void percentiles(worker_t *w, int count, uint64_t out[3]) {
+    long total = 0;
+    for (int i = 0; i < count; i++) {
+        total += w[i].nsamples;
+    }
+    uint64_t *all = malloc((total + 1) * sizeof(uint64_t));
+    long k = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(all + k, w[i].samples, w[i].nsamples * sizeof(uint64_t));
+        k += w[i].nsamples;
+    }
+    qsort(all, total, sizeof(uint64_t), cmp_u64);
+    const double q[3] = { 0.50, 0.99, 0.999 };
+    for (int i = 0; i < 3; i++) {
+        out[i] = total ? all[(long) ((double) (total - 1) * q[i])] : 0;
+    }
+    free(all);
+}
+
+// Function to move ops elements (rounded up so that every thread moves as many) through a new
+// queue, returning false if any check failed.  If label isn't NULL, prints the run's CSV row.
+static bool run(const char *label, int producers, int consumers, int capacity, long ops, int batch,
+    op_mode_t mode) {
+    // Every thread moves the same number of elements, so round ops to a multiple of both sides
+    long unit = (long) producers * consumers;
+    ops = (ops + unit - 1) / unit * unit;
+
+    ledger_t ledger = { .producers = producers, .per_producer = ops / producers };
+    ledger.seen = calloc(ops, sizeof(*ledger.seen));
+    atomic_init(&ledger.violations, 0);
+
+    queue_t *q = queue_new(capacity);
+    int count = producers + consumers;
+    worker_t *w = calloc(count, sizeof(worker_t));
+    pthread_t *tid = calloc(count, sizeof(pthread_t));
+    for (int i = 0; i < count; i++) {
+        w[i].q = q;
+        w[i].id = i;
+        w[i].batch = batch;
+        w[i].mode = mode;
+        w[i].ledger = &ledger;
+        w[i].ops = i < producers ? ops / producers : ops / consumers;
+        w[i].samples = malloc((w[i].ops + 1) * sizeof(uint64_t));
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; i++) {
+        pthread_create(&tid[i], NULL, i < producers ? producer : consumer, &w[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    double secs = (double) (now_ns() - start) / 1e9;
+
+    // Each element has to have arrived once; ones that arrived twice were reported already
+    for (long i = 0; i < ops; i++) {
+        if (atomic_load(&ledger.seen[i]) == 0) {
+            violation(&ledger, "never popped",
+                (uintptr_t) tag((int) (i / ledger.per_producer), i % ledger.per_producer + 1));
+        }
+    }
+    bool ok = atomic_load(&ledger.violations) == 0;
+    if (!ok) {
+        fprintf(stderr,
+            "queue_test: %ld checks failed with %d:%d threads, capacity %d, batch %d, %s\n",
+            (long) atomic_load(&ledger.violations), producers, consumers, capacity, batch,
+            mode_names[mode]);
+    }
+
+    uint64_t push[3], pop[3];
+    percentiles(w, producers, push);
+    percentiles(w + producers, consumers, pop);
+    if (label != NULL) {
+            printf("%s,%d,%d,%d,%d,%ld,%.3f,%.3f,%lu,%lu,%lu,%lu,%lu,%lu\n", label, producers,
+            consumers, capacity, batch, ops, secs, (double) ops / secs / 1e6,
+            (unsigned long) push[0], (unsigned long) push[1], (unsigned long) push[2],
+            (unsigned long) pop[0], (unsigned long) pop[1], (unsigned long) pop[2]);
+        fflush(stdout);
+    }
+
+    for (int i = 0; i < count; i++) {
+        free(w[i].samples);
+    }
+    free(w);
+    free(tid);
+    free(ledger.seen);
+    queue_delete(&q);
+    return ok;
+}
+
+// Function to run every way of pushing and popping through the checks, with one producer or
+// consumer and with several, and with capacities from 1 (always full or empty) up
+static bool check_all(void) {
+    static const int threads[][2] = { { 1, 1 }, { 1, 4 }, { 4, 1 }, { 4, 4 } };
+    static const int capacities[] = { 1, 3, 64 };
+    static const struct {
+        int batch;
+        op_mode_t mode;
+    } ways[] = { { 1, MODE_BLOCKING }, { 7, MODE_BLOCKING }, { 64, MODE_BLOCKING },
+        { 1, MODE_TIMED }, { 1, MODE_TRY } };
+    bool ok = true;
+    for (size_t w = 0; w < sizeof(ways) / sizeof(ways[0]); w++) {
+        for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+            for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++) {
+                ok = run(NULL, threads[t][0], threads[t][1], capacities[c], 20000, ways[w].batch,
+                         ways[w].mode)
+                     && ok;
+            }
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const char *label = "queue";
+    long ops = 1000000;
+    int batch = 1;
+    op_mode_t mode = MODE_BLOCKING;
+    int ratios[MAX_CONFIGS][2] = { { 1, 1 }, { 1, 4 }, { 4, 1 }, { 4, 4 }, { 16, 16 } };
+    int nratios = 5;
+    int capacities[MAX_CONFIGS] = { 1, 16, 256, 4096 };
+    int ncapacities = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:o:b:m:p:c:")) != -1) {
+        switch (opt) {
+        case 'l': label = optarg; break;
+        case 'o': ops = atol(optarg); break;
+        case 'b': batch = atoi(optarg); break;
+        case 'm':
+            mode = strcmp(optarg, "timed") == 0 ? MODE_TIMED
+                   : strcmp(optarg, "try") == 0 ? MODE_TRY
+                                                 : MODE_BLOCKING;
+            break;
+        case 'p':
+            nratios = 0;
+            for (char *tok = strtok(optarg, ","); tok && nratios < MAX_CONFIGS;
+                 tok = strtok(NULL, ",")) {
+                if (sscanf(tok, "%d:%d", &ratios[nratios][0], &ratios[nratios][1]) == 2) {
+                    nratios++;
+                }
+            }
+            break;
+        case 'c':
+            ncapacities = 0;
+            for (char *tok = strtok(optarg, ","); tok && ncapacities < MAX_CONFIGS;
+                 tok = strtok(NULL, ",")) {
+                capacities[ncapacities++] = atoi(tok);
+            }
+            break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-l label] [-o ops] [-b batch] [-m timed|try] [-p P:C,P:C,...] "
+                "[-c cap1,cap2,...]\n",
+                argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (ops < 1 || ops > UINT32_MAX || batch < 1 || batch > MAX_BATCH
+        || (mode != MODE_BLOCKING && batch != 1)) {
+        fprintf(stderr,
+            "%s: ops must be positive and batch between 1 and %d, and 1 with -m timed or try\n",
+            argv[0], MAX_BATCH);
+        return EXIT_FAILURE;
+    }
+    if (!check_all()) {
+        return EXIT_FAILURE;
+    }
+
+    printf("impl,producers,consumers,capacity,batch,ops,seconds,mops_per_sec,"
+           "push_p50_ns,push_p99_ns,push_p999_ns,pop_p50_ns,pop_p99_ns,pop_p999_ns\n");
+    for (int r = 0; r < nratios; r++) {
+        for (int c = 0; c < ncapacities; c++) {
+            if (!run(label, ratios[r][0], ratios[r][1], capacities[c], ops, batch, mode)) {
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,9 +1,21 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
 #include "rwlock.h"
 
-// Assuming PRIORITY constants are defined elsewhere
+// READERS_BIASED follows BRAVO (Dice and Kogan, ATC '19): while a lock is biased, a reader
+// just publishes the lock in its own slot of a global visible-readers table and never
+// touches the lock itself. A writer revokes the bias and waits for those slots to empty.
+#define VISIBLE_READERS   4096 // a power of two
+#define SLOT_STRIDE       8 // readers of one lock spread one cache line apart
+#define INHIBIT_MULTIPLE  9 // stay unbiased this many revocation times after a revocation
+#define MAX_FAST_HELD     8 // biased read locks one thread can hold at once
+#define CACHE_LINE_SIZE   64
+
 typedef struct rwlock {
     pthread_mutex_t lock;
     pthread_cond_t readers_ok;
@@ -14,8 +26,78 @@ typedef struct rwlock {
     int waiting_writers;
     PRIORITY priority;
     uint32_t n;
+    uint32_t readers_since_writer; // readers admitted since the last writer released (N_WAY)
+    _Atomic bool rbias; // READERS_BIASED: readers may take the fast path
+    uint64_t inhibit_until; // READERS_BIASED: no re-biasing before this time (ns)
 } rwlock_t;
 
+static _Alignas(CACHE_LINE_SIZE) _Atomic(rwlock_t *) visible_readers[VISIBLE_READERS];
+
+// The slots this thread filled, so that reader_unlock knows which path the lock came from
+typedef struct {
+    rwlock_t *rw;
+    _Atomic(rwlock_t *) *slot;
+} fast_hold_t;
+
+static _Thread_local fast_hold_t fast_held[MAX_FAST_HELD];
+static _Thread_local int nfast_held;
+static _Thread_local char thread_tag; // its address identifies the thread
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Function to pick this thread's slot for a lock
+static _Atomic(rwlock_t *) *visible_slot(rwlock_t *rw) {
+    uint64_t h = ((uintptr_t) &thread_tag ^ ((uintptr_t) rw >> 6)) * 0x9E3779B97F4A7C15ULL;
+    return &visible_readers[((h >> 40) * SLOT_STRIDE) & (VISIBLE_READERS - 1)];
+}
+
+// Function to try the biased fast path: claim our slot, then check that the bias still holds
+static bool fast_reader_lock(rwlock_t *rw) {
+    if (!atomic_load_explicit(&rw->rbias, memory_order_relaxed) || nfast_held == MAX_FAST_HELD) {
+        return false;
+    }
+    _Atomic(rwlock_t *) *slot = visible_slot(rw);
+    rwlock_t *empty = NULL;
+    if (!atomic_compare_exchange_strong(slot, &empty, rw)) {
+        return false; // another thread hashed here; the slow path still works
+    }
+    if (atomic_load(&rw->rbias)) {
+        fast_held[nfast_held++] = (fast_hold_t) { rw, slot };
+        return true;
+    }
+    atomic_store(slot, NULL); // a writer revoked the bias in between
+    return false;
+}
+
+static bool fast_reader_unlock(rwlock_t *rw) {
+    for (int i = nfast_held - 1; i >= 0; i--) {
+        if (fast_held[i].rw == rw) {
+            atomic_store_explicit(fast_held[i].slot, NULL, memory_order_release);
+            fast_held[i] = fast_held[--nfast_held];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to turn off a lock's bias and wait out the readers that got in through it.
+// Call holding the lock for writing.
+static void revoke_bias(rwlock_t *rw) {
+    uint64_t start = now_ns();
+    atomic_store(&rw->rbias, false);
+    for (int i = 0; i < VISIBLE_READERS; i += SLOT_STRIDE) {
+        while (atomic_load(&visible_readers[i]) == rw) {
+            sched_yield();
+        }
+    }
+    uint64_t now = now_ns();
+    rw->inhibit_until = now + (now - start) * INHIBIT_MULTIPLE;
+}
+
 rwlock_t *rwlock_new(PRIORITY p, uint32_t n) {
     rwlock_t *rw = malloc(sizeof(rwlock_t));
     if (rw == NULL)
@@ -29,6 +111,9 @@ rwlock_t *rwlock_new(PRIORITY p, uint32_t n) {
     rw->waiting_writers = 0;
     rw->priority = p;
     rw->n = n;
+    rw->readers_since_writer = 0;
+    atomic_init(&rw->rbias, p == READERS_BIASED);
+    rw->inhibit_until = 0;
     return rw;
 }
 
@@ -42,24 +127,72 @@ void rwlock_delete(rwlock_t **l) {
     *l = NULL;
 }
 
+// Function to decide whether a reader may enter now; call with rw->lock held.
+//   READERS: only an active writer keeps readers out.
+//   WRITERS: an active or waiting writer keeps readers out.
+//   N_WAY:   while a writer waits, only n readers may enter after the last writer released.
+//   READERS_BIASED: like N_WAY once the bias is revoked.
+static bool reader_may_enter(rwlock_t *rw) {
+    if (rw->writers > 0) {
+        return false;
+    }
+    switch (rw->priority) {
+    case READERS: return true;
+    case WRITERS: return rw->waiting_writers == 0;
+    case N_WAY:
+    case READERS_BIASED: return rw->waiting_writers == 0 || rw->readers_since_writer < rw->n;
+    }
+    return true;
+}
+
+// Function to decide whether a writer may enter now; call with rw->lock held.
+//   READERS: waiting readers go first.
+//   WRITERS: the lock only has to be free.
+//   N_WAY:   waiting readers go first until n of them entered since the last writer.
+//   READERS_BIASED: like N_WAY; readers on the fast path are waited for in revoke_bias.
+static bool writer_may_enter(rwlock_t *rw) {
+    if (rw->readers > 0 || rw->writers > 0) {
+        return false;
+    }
+    switch (rw->priority) {
+    case READERS: return rw->waiting_readers == 0;
+    case WRITERS: return true;
+    case N_WAY:
+    case READERS_BIASED: return rw->waiting_readers == 0 || rw->readers_since_writer >= rw->n;
+    }
+    return true;
+}
+
 void reader_lock(rwlock_t *rw) {
+    if (rw->priority == READERS_BIASED && fast_reader_lock(rw)) {
+        return;
+    }
     pthread_mutex_lock(&rw->lock);
     rw->waiting_readers++;
-    while (rw->writers > 0 || (rw->priority == WRITERS && rw->waiting_writers > 0)) {
+    while (!reader_may_enter(rw)) {
         pthread_cond_wait(&rw->readers_ok, &rw->lock);
     }
     rw->waiting_readers--;
     rw->readers++;
+    rw->readers_since_writer++;
+
+    // No writer holds the lock now, so this is a safe point to bias it again once the last
+    // revocation has been paid for
+    if (rw->priority == READERS_BIASED && !atomic_load_explicit(&rw->rbias, memory_order_relaxed)
+        && now_ns() >= rw->inhibit_until) {
+        atomic_store(&rw->rbias, true);
+    }
     pthread_mutex_unlock(&rw->lock);
 }
 
 void reader_unlock(rwlock_t *rw) {
+    if (rw->priority == READERS_BIASED && fast_reader_unlock(rw)) {
+        return;
+    }
     pthread_mutex_lock(&rw->lock);
     rw->readers--;
     if (rw->readers == 0 && rw->waiting_writers > 0) {
         pthread_cond_signal(&rw->writers_ok);
-    } else if (rw->readers == 0) {
-        pthread_cond_broadcast(&rw->writers_ok);
     }
     pthread_mutex_unlock(&rw->lock);
 }
@@ -67,23 +200,30 @@ void reader_unlock(rwlock_t *rw) {
 void writer_lock(rwlock_t *rw) {
     pthread_mutex_lock(&rw->lock);
     rw->waiting_writers++;
-    while (rw->readers > 0 || rw->writers > 0) {
+    while (!writer_may_enter(rw)) {
         pthread_cond_wait(&rw->writers_ok, &rw->lock);
     }
     rw->waiting_writers--;
     rw->writers++;
     pthread_mutex_unlock(&rw->lock);
+
+    if (atomic_load_explicit(&rw->rbias, memory_order_relaxed)) {
+        revoke_bias(rw);
+    }
 }
 
 void writer_unlock(rwlock_t *rw) {
     pthread_mutex_lock(&rw->lock);
     rw->writers--;
-    if (rw->priority == READERS && rw->waiting_readers > 0) {
+    rw->readers_since_writer = 0;
+
+    // Wake everyone who might be next and let the priority rules sort them out; a writer
+    // that loses to the readers is signalled again when the last of them leaves
+    if (rw->waiting_readers > 0) {
         pthread_cond_broadcast(&rw->readers_ok);
-    } else if (rw->waiting_writers > 0) {
+    }
+    if (rw->waiting_writers > 0) {
         pthread_cond_signal(&rw->writers_ok);
-    } else {
-        pthread_cond_broadcast(&rw->readers_ok);
     }
     pthread_mutex_unlock(&rw->lock);
 }
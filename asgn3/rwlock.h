@@ -0,0 +1,76 @@
+/**
+ * @File rwlock.h
+ *
+ * The header file that you need to implement for assignment 3.
+ *
+ * @author Andrew Quinn, Mitchell Elliott, and Gurpreet Dhillon.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @struct rwlock_t
+ *
+ *  @brief This typedef renames the struct rwlock.  Your `c` file
+ *  should define the variables that you need for your reader/writer
+ *  lock.
+ */
+typedef struct rwlock rwlock_t;
+
+/** @brief Who goes first when both readers and writers are waiting.
+ *
+ *  READERS: waiting readers always go before waiting writers.
+ *  WRITERS: waiting writers always go before waiting readers.
+ *  N_WAY:   after a writer releases the lock, at most n readers go
+ *           ahead of a waiting writer, so neither side starves.
+ *  READERS_BIASED: for read-mostly locks.  While no writer has come by
+ *           lately, readers only write a slot of a global table that
+ *           other threads' slots don't share, never the lock itself.  A
+ *           writer revokes the bias and waits for those readers, which
+ *           makes writes slower; otherwise the rules are N_WAY's.
+ */
+typedef enum { READERS, WRITERS, N_WAY, READERS_BIASED } PRIORITY;
+
+/** @brief Dynamically allocates and initializes a new rwlock with
+ *         priority p, and, if using N_WAY priority, n.
+ *
+ *  @param The priority of the rwlock
+ *
+ *  @param The n value, if using N_WAY priority
+ *
+ *  @return a pointer to a new rwlock_t
+ */
+
+rwlock_t *rwlock_new(PRIORITY p, uint32_t n);
+
+/** @brief Delete your rwlock and free all of its memory.
+ *
+ *  @param rw the rwlock to be deleted.  Note, you should assign the
+ *  passed in pointer to NULL when returning (i.e., you should set *rw
+ *  = NULL after deallocation).
+ *
+ */
+void rwlock_delete(rwlock_t **rw);
+
+/** @brief acquire rw for reading
+ *
+ */
+void reader_lock(rwlock_t *rw);
+
+/** @brief release rw for reading--you can assume that the thread
+ * releasing the lock has *already* acquired it for reading.
+ *
+ */
+void reader_unlock(rwlock_t *rw);
+
+/** @brief acquire rw for writing
+ *
+ */
+void writer_lock(rwlock_t *rw);
+
+/** @brief release rw for writing--you can assume that the thread
+ * releasing the lock has *already* acquired it for writing.
+ *
+ */
+void writer_unlock(rwlock_t *rw);
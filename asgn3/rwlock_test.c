@@ -0,0 +1,272 @@
+/**
+ * @File rwlock_test.c
+ *
+ * Latency harness for rwlock_t.  Reader and writer threads hammer one
+ * lock, each holding it for a fixed critical section and then thinking
+ * for a while, and every acquisition's wait is recorded.  For every
+ * reader count given it runs once for READERS, once for WRITERS and once
+ * for every N_WAY n given, and prints one CSV row per run with each
+ * side's throughput and p50/p99/p99.9/worst-case waits, so that n can be
+ * picked from data.  READERS_BIASED runs with the first n.  -l tags every
+ * row so that runs of different implementations can be diffed.
+ *
+ * With -s it instead measures how read throughput scales: 1, 2, 4, ...
+ * 64 threads only take and release the read lock (plus -w writers that
+ * write every -t microseconds), for every mode.
+ *
+ * usage: ./rwlock_test [-s] [-l label] [-r r1,r2,...] [-w writers] [-d seconds]
+ *                      [-c critical_us] [-t think_us] [-n n1,n2,...]
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rwlock.h"
+
+#define MAX_SAMPLES (1 << 20)
+#define MAX_NWAYS   32
+#define MAX_READERS 16
+
+typedef struct {
+    rwlock_t *lock;
+    bool writer;
+    uint64_t *samples; // wait times in ns
+    size_t nsamples;
+    uint64_t ops;
+    uint64_t max;
+} worker_t;
+
+static _Atomic bool stop;
+static uint64_t critical_ns = 10000;
+static uint64_t think_ns = 10000;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Function to keep the CPU busy for ns nanoseconds, like real work would
+static void spin_for(uint64_t ns) {
+    uint64_t end = now_ns() + ns;
+    while (now_ns() < end) {
+    }
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    while (!atomic_load(&stop)) {
+        uint64_t start = now_ns();
+        if (w->writer) {
+            writer_lock(w->lock);
+        } else {
+            reader_lock(w->lock);
+        }
+        uint64_t wait = now_ns() - start;
+        spin_for(critical_ns);
+        if (w->writer) {
+            writer_unlock(w->lock);
+        } else {
+            reader_unlock(w->lock);
+        }
+
+        if (w->nsamples < MAX_SAMPLES) {
+            w->samples[w->nsamples++] = wait;
+        }
+        if (wait > w->max) {
+            w->max = wait;
+        }
+        w->ops++;
+        spin_for(think_ns);
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to merge one side's samples and report its ops and its p50, p99, p99.9 and max wait
+// (in us)
+static void summarize(worker_t *w, int count, uint64_t *ops, double wait[4]) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += w[i].nsamples;
+    }
+    uint64_t *all = malloc((total + 1) * sizeof(uint64_t));
+    size_t k = 0;
+    *ops = 0;
+    wait[3] = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(all + k, w[i].samples, w[i].nsamples * sizeof(uint64_t));
+        k += w[i].nsamples;
+        *ops += w[i].ops;
+        if (w[i].max / 1000.0 > wait[3]) {
+            wait[3] = w[i].max / 1000.0;
+        }
+    }
+    qsort(all, total, sizeof(uint64_t), cmp_u64);
+    const double q[3] = { 0.50, 0.99, 0.999 };
+    for (int i = 0; i < 3; i++) {
+        wait[i] = total ? all[(size_t) ((double) (total - 1) * q[i])] / 1000.0 : 0;
+    }
+    free(all);
+}
+
+// Function to run readers that only lock and unlock, and writers that write every think_ns
+static void *scaling_worker(void *arg) {
+    worker_t *w = arg;
+    while (!atomic_load(&stop)) {
+        if (w->writer) {
+            writer_lock(w->lock);
+            writer_unlock(w->lock);
+            spin_for(think_ns);
+        } else {
+            reader_lock(w->lock);
+            reader_unlock(w->lock);
+        }
+        w->ops++;
+    }
+    return NULL;
+}
+
+static void run_scaling(
+    const char *label, const char *name, PRIORITY p, uint32_t n, int writers, double secs) {
+    for (int readers = 1; readers <= 64; readers *= 2) {
+        rwlock_t *lock = rwlock_new(p, n);
+        int count = readers + writers;
+        worker_t *w = calloc(count, sizeof(worker_t));
+        pthread_t *tid = calloc(count, sizeof(pthread_t));
+        atomic_store(&stop, false);
+        for (int i = 0; i < count; i++) {
+            w[i].lock = lock;
+            w[i].writer = i >= readers;
+            pthread_create(&tid[i], NULL, scaling_worker, &w[i]);
+        }
+        usleep((useconds_t) (secs * 1e6));
+        atomic_store(&stop, true);
+        uint64_t reads = 0, writes = 0;
+        for (int i = 0; i < count; i++) {
+            pthread_join(tid[i], NULL);
+            if (w[i].writer) {
+                writes += w[i].ops;
+            } else {
+                reads += w[i].ops;
+            }
+        }
+        printf("%s,%s,%u,%d,%d,%.0f,%.0f\n", label, name, n, readers, writers,
+            (double) reads / secs, (double) writes / secs);
+        fflush(stdout);
+        free(w);
+        free(tid);
+        rwlock_delete(&lock);
+    }
+}
+
+static void run(const char *label, const char *name, PRIORITY p, uint32_t n, int readers,
+    int writers, double secs) {
+    rwlock_t *lock = rwlock_new(p, n);
+    int count = readers + writers;
+    worker_t *w = calloc(count, sizeof(worker_t));
+    pthread_t *tid = calloc(count, sizeof(pthread_t));
+    atomic_store(&stop, false);
+    for (int i = 0; i < count; i++) {
+        w[i].lock = lock;
+        w[i].writer = i >= readers;
+        w[i].samples = malloc(MAX_SAMPLES * sizeof(uint64_t));
+        pthread_create(&tid[i], NULL, worker, &w[i]);
+    }
+    usleep((useconds_t) (secs * 1e6));
+    atomic_store(&stop, true);
+    for (int i = 0; i < count; i++) {
+        pthread_join(tid[i], NULL);
+    }
+
+    uint64_t rops, wops;
+    double rwait[4], wwait[4];
+    summarize(w, readers, &rops, rwait);
+    summarize(w + readers, writers, &wops, wwait);
+    printf("%s,%s,%u,%d,%d,%.1f,%.0f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", label, name,
+        n, readers, writers, secs, (double) rops / secs, (double) wops / secs, rwait[0], rwait[1],
+        rwait[2], rwait[3], wwait[0], wwait[1], wwait[2], wwait[3]);
+    fflush(stdout);
+
+    for (int i = 0; i < count; i++) {
+        free(w[i].samples);
+    }
+    free(w);
+    free(tid);
+    rwlock_delete(&lock);
+}
+
+int main(int argc, char **argv) {
+    const char *label = "rwlock";
+    int readers[MAX_READERS] = { 2, 8, 32 };
+    int nreaders = 3;
+    int writers = 2;
+    double secs = 2.0;
+    uint32_t nways[MAX_NWAYS] = { 1, 4, 16, 64 };
+    int nnways = 4;
+    bool scaling = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "sl:r:w:d:c:t:n:")) != -1) {
+        switch (opt) {
+        case 's': scaling = true; break;
+        case 'l': label = optarg; break;
+        case 'r':
+            nreaders = 0;
+            for (char *tok = strtok(optarg, ","); tok && nreaders < MAX_READERS;
+                 tok = strtok(NULL, ",")) {
+                readers[nreaders++] = atoi(tok);
+            }
+            break;
+        case 'w': writers = atoi(optarg); break;
+        case 'd': secs = atof(optarg); break;
+        case 'c': critical_ns = strtoull(optarg, NULL, 10) * 1000; break;
+        case 't': think_ns = strtoull(optarg, NULL, 10) * 1000; break;
+        case 'n':
+            nnways = 0;
+            for (char *tok = strtok(optarg, ","); tok && nnways < MAX_NWAYS;
+                 tok = strtok(NULL, ",")) {
+                nways[nnways++] = (uint32_t) strtoul(tok, NULL, 10);
+            }
+            break;
+        default:
+            fprintf(stderr,
+                "usage: %s [-s] [-l label] [-r r1,r2,...] [-w writers] [-d seconds] "
+                "[-c critical_us] [-t think_us] [-n n1,n2,...]\n",
+                argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (scaling) {
+        printf("impl,mode,n,readers,writers,reads_per_sec,writes_per_sec\n");
+        run_scaling(label, "READERS", READERS, 0, writers, secs);
+        run_scaling(label, "WRITERS", WRITERS, 0, writers, secs);
+        run_scaling(label, "N_WAY", N_WAY, nways[0], writers, secs);
+        run_scaling(label, "READERS_BIASED", READERS_BIASED, nways[0], writers, secs);
+        return EXIT_SUCCESS;
+    }
+
+    printf("impl,mode,n,readers,writers,seconds,reads_per_sec,writes_per_sec,"
+           "reader_wait_p50_us,reader_wait_p99_us,reader_wait_p999_us,reader_wait_max_us,"
+           "writer_wait_p50_us,writer_wait_p99_us,writer_wait_p999_us,writer_wait_max_us\n");
+    for (int r = 0; r < nreaders; r++) {
+        run(label, "READERS", READERS, 0, readers[r], writers, secs);
+        run(label, "WRITERS", WRITERS, 0, readers[r], writers, secs);
+        for (int i = 0; i < nnways; i++) {
+            run(label, "N_WAY", N_WAY, nways[i], readers[r], writers, secs);
+        }
+        run(label, "READERS_BIASED", READERS_BIASED, nways[0], readers[r], writers, secs);
+    }
+    return EXIT_SUCCESS;
+}
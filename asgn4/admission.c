@@ -0,0 +1,75 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "admission.h"
+
+struct admission {
+    uint64_t target;
+    uint64_t interval;
+    _Atomic uint64_t interval_end; // when the current interval is over (ns)
+    _Atomic uint64_t min_wait; // shortest wait reported in the current interval
+    _Atomic bool overloaded; // the last interval's shortest wait was above the target
+    _Atomic uint64_t shed;
+};
+
+admission_t *admission_new(uint64_t target_ns, uint64_t interval_ns) {
+    admission_t *a = malloc(sizeof(admission_t));
+    if (a == NULL) {
+        return NULL;
+    }
+    a->target = target_ns;
+    a->interval = interval_ns;
+    atomic_init(&a->interval_end, 0);
+    atomic_init(&a->min_wait, UINT64_MAX);
+    atomic_init(&a->overloaded, false);
+    atomic_init(&a->shed, 0);
+    return a;
+}
+
+void admission_delete(admission_t **a) {
+    if (a == NULL || *a == NULL) {
+        return;
+    }
+    free(*a);
+    *a = NULL;
+}
+
+bool admission_admit(admission_t *a, uint64_t now, uint64_t waited_ns) {
+    if (a->target == 0) {
+        return true;
+    }
+    uint64_t min = atomic_load_explicit(&a->min_wait, memory_order_relaxed);
+    while (waited_ns < min
+           && !atomic_compare_exchange_weak_explicit(
+               &a->min_wait, &min, waited_ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    // Whoever first notices that the interval is over judges it and starts the next one.  The
+    // wait just reported is in it, so its minimum is never left at UINT64_MAX.
+    uint64_t end = atomic_load_explicit(&a->interval_end, memory_order_relaxed);
+    uint64_t next = now + a->interval;
+    if (now >= end
+        && atomic_compare_exchange_strong_explicit(
+            &a->interval_end, &end, next, memory_order_relaxed, memory_order_relaxed)) {
+        min = atomic_exchange_explicit(&a->min_wait, UINT64_MAX, memory_order_relaxed);
+        atomic_store_explicit(&a->overloaded, min > a->target, memory_order_relaxed);
+    }
+    return !admission_expired(a, waited_ns);
+}
+
+bool admission_expired(admission_t *a, uint64_t waited_ns) {
+    if (a->target == 0) {
+        return false;
+    }
+    bool overloaded = atomic_load_explicit(&a->overloaded, memory_order_relaxed);
+    if (waited_ns > (overloaded ? a->target : a->interval)) {
+        atomic_fetch_add_explicit(&a->shed, 1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void admission_stats(admission_t *a, admission_stats_t *stats) {
+    stats->shed = atomic_load_explicit(&a->shed, memory_order_relaxed);
+    stats->overloaded = atomic_load_explicit(&a->overloaded, memory_order_relaxed);
+}
@@ -0,0 +1,64 @@
+/**
+ * @File admission.h
+ *
+ * Load shedding by queue delay, after CoDel.  Workers report how long each
+ * request waited in the queues before they took it.  If even the shortest
+ * wait of an interval was above the target, the queues never drained in
+ * that interval: requests are arriving faster than they are served, and
+ * the pool is overloaded.  Until an interval goes by in which some request
+ * got through within the target, requests that waited longer than the
+ * target are answered with a 503 instead of being served, which is cheap
+ * and drains the queue, so the requests that are served never wait much
+ * longer than the target.  At other times only requests that waited a
+ * whole interval are shed.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @struct admission_t
+ *
+ *  @brief The target, the shortest wait of the current interval, and
+ *         whether the last interval was overloaded.
+ */
+typedef struct admission admission_t;
+
+/** @brief A snapshot of the shedding, for monitoring.
+ */
+typedef struct admission_stats {
+    uint64_t shed;
+    bool overloaded;
+} admission_stats_t;
+
+/** @brief Creates a shedder that aims to keep queue waits under target_ns,
+ *         judged over intervals of interval_ns.  A target of 0 never sheds.
+ *
+ *  @return a pointer to a new admission_t, or NULL on failure.
+ */
+admission_t *admission_new(uint64_t target_ns, uint64_t interval_ns);
+
+/** @brief Free the shedder; *a is set to NULL.
+ */
+void admission_delete(admission_t **a);
+
+/** @brief Report that a request waited waited_ns before a worker took it
+ *         at now (metrics_now).  Safe to call from any thread.
+ *
+ *  @return whether to serve the request; if not, answer it with a 503.
+ */
+bool admission_admit(admission_t *a, uint64_t now, uint64_t waited_ns);
+
+/** @brief Whether a request that has been queued for waited_ns, and that
+ *         no worker has taken yet, should be turned away now.  Unlike
+ *         admission_admit, this is not a wait the judgement is based on.
+ *         Safe to call from any thread.
+ *
+ *  @return whether to answer the request with a 503.
+ */
+bool admission_expired(admission_t *a, uint64_t waited_ns);
+
+/** @brief Fill *stats with a snapshot of the shedder.
+ */
+void admission_stats(admission_t *a, admission_stats_t *stats);
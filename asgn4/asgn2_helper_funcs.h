@@ -34,6 +34,20 @@ typedef struct {
  */
 int listener_init(Listener_Socket *sock, int port);
 
+/** @brief Like listener_init, but with SO_REUSEPORT set, so that several
+ *         sockets may listen on the same port and the kernel spreads new
+ *         connections across them.  Implemented in listener.c rather
+ *         than the helper library.
+ *
+ *  @param sock The Listener_Socket to initialize.
+ *
+ *  @param port The port on which to listen.
+ *
+ *  @return 0, indicating success, or -1, indicating that it failed to
+ *          listen.  Sets errno according to any errors that occur.
+ */
+int listener_init_reuseport(Listener_Socket *sock, int port);
+
 /** @brief Accept a new connection and initialize a 5 second timeout
  *
  *  @param sock The Listener_Socket from which to get the new
@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audit_log.h"
+
+#define RING_SIZE       256 // entries per ring, a power of two
+#define LINE_MAX_LEN    256
+#define BATCH_MAX       1024
+#define FLUSH_MS        5 // how long lines may wait before the flusher looks again
+#define CLAIM_WAIT_MS   1 // how long a thread without a ring waits before trying again
+#define CACHE_LINE_SIZE 64
+
+typedef struct audit_entry {
+    uint64_t seq;
+    uint32_t len;
+    char line[LINE_MAX_LEN];
+} audit_entry_t;
+
+// A single-producer single-consumer ring: its owner thread advances head and
+// the flusher advances tail, each on its own cache line
+typedef struct audit_ring {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t head;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail;
+    _Atomic bool owned;
+    audit_entry_t entries[RING_SIZE];
+} audit_ring_t;
+
+struct audit_log {
+    char *path;
+    int fd;
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t next_seq;
+    _Atomic uint64_t written; // lines written so far, for audit_log_flush
+    _Atomic(audit_ring_t *) *rings; // max_rings of them, allocated as threads claim them
+    _Atomic int nrings;
+    int max_rings;
+    uint64_t *cursor; // for the flusher, per ring
+    uint64_t *heads;
+    pthread_mutex_t claim_mutex;
+    _Atomic bool rotate;
+    _Atomic bool stop;
+    _Atomic bool sleeping;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t flusher;
+};
+
+// The ring the calling thread writes to, and the log it belongs to
+static _Thread_local audit_ring_t *my_ring = NULL;
+static _Thread_local audit_log_t *my_log = NULL;
+
+static int open_log(const char *path) {
+    return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+// Function to find the calling thread a ring, reusing one given up by an exited thread
+static audit_ring_t *claim_ring(audit_log_t *log) {
+    pthread_mutex_lock(&log->claim_mutex);
+    audit_ring_t *ring = NULL;
+    int n = atomic_load(&log->nrings);
+    for (int i = 0; i < n && ring == NULL; i++) {
+        audit_ring_t *r = atomic_load(&log->rings[i]);
+        if (!atomic_load(&r->owned)) {
+            ring = r;
+        }
+    }
+    if (ring == NULL && n < log->max_rings) {
+        ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(audit_ring_t));
+        if (ring != NULL) {
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+            atomic_store(&log->rings[n], ring);
+            atomic_store(&log->nrings, n + 1);
+        }
+    }
+    if (ring != NULL) {
+        atomic_store(&ring->owned, true);
+    }
+    pthread_mutex_unlock(&log->claim_mutex);
+    return ring;
+}
+
+// Function to get the flusher going early, when a ring is filling up between its rounds
+static void wake_flusher(audit_log_t *log) {
+    if (atomic_load(&log->sleeping)) {
+        pthread_mutex_lock(&log->mutex);
+        pthread_cond_signal(&log->cond);
+        pthread_mutex_unlock(&log->mutex);
+    }
+}
+
+void audit_log_record(
+    audit_log_t *log, const char *method, const char *uri, uint16_t code, const char *request_id) {
+    // A line written around the rings would skip the sequence merge, so a thread without one
+    // waits for one.  There is a ring for every thread the server may run, so this only waits
+    // while a retiring thread is still giving its ring up.
+    if (my_log != log) {
+        struct timespec pause = { 0, CLAIM_WAIT_MS * 1000000L };
+        while ((my_ring = claim_ring(log)) == NULL) {
+            nanosleep(&pause, NULL);
+        }
+        my_log = log;
+    }
+    audit_ring_t *ring = my_ring;
+
+    // Make room before taking a sequence number; the flusher can't get past a taken
+    // number until its line is published, so publishing must never have to wait
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= RING_SIZE) {
+        wake_flusher(log);
+        sched_yield();
+    }
+
+    audit_entry_t *e = &ring->entries[head & (RING_SIZE - 1)];
+    e->seq = atomic_fetch_add_explicit(&log->next_seq, 1, memory_order_relaxed);
+    int len = snprintf(e->line, LINE_MAX_LEN, "%s,/%s,%d,%s\n", method, uri, code, request_id);
+    if (len >= LINE_MAX_LEN) {
+        len = LINE_MAX_LEN;
+        e->line[LINE_MAX_LEN - 1] = '\n';
+    }
+    e->len = len < 0 ? 0 : (uint32_t) len;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // Waking the flusher costs a syscall (and, on a busy machine, a context switch) while the
+    // caller holds its URI lock, so leave it to the flusher's timer unless the ring is filling
+    if (head + 1 - atomic_load_explicit(&ring->tail, memory_order_relaxed) == RING_SIZE / 2) {
+        wake_flusher(log);
+    }
+}
+
+void audit_log_detach(audit_log_t *log) {
+    if (my_log == log && my_ring != NULL) {
+        atomic_store(&my_ring->owned, false);
+    }
+    my_ring = NULL;
+    my_log = NULL;
+}
+
+void audit_log_flush(audit_log_t *log) {
+    uint64_t target = atomic_load(&log->next_seq);
+    while (atomic_load(&log->written) < target) {
+        pthread_mutex_lock(&log->mutex);
+        pthread_cond_signal(&log->cond);
+        pthread_mutex_unlock(&log->mutex);
+        sched_yield();
+    }
+}
+
+void audit_log_rotate(audit_log_t *log) {
+    atomic_store(&log->rotate, true);
+}
+
+// Function to write a whole batch, resuming after partial writes
+static void write_batch(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= (size_t) n;
+        }
+    }
+}
+
+// Function to take the next lines in sequence order from the rings' heads and write them.
+// Each ring holds its own lines in increasing order, so the next line is at some ring's tail.
+// Returns how many lines were written.
+static int flush_batch(audit_log_t *log, uint64_t *next) {
+    static struct iovec iov[BATCH_MAX];
+    uint64_t *cursor = log->cursor;
+    uint64_t *heads = log->heads;
+    int nrings = atomic_load(&log->nrings);
+    for (int i = 0; i < nrings; i++) {
+        audit_ring_t *r = atomic_load(&log->rings[i]);
+        cursor[i] = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        heads[i] = atomic_load_explicit(&r->head, memory_order_acquire);
+    }
+
+    int count = 0;
+    int i = 0;
+    int misses = 0;
+    while (count < BATCH_MAX && misses < nrings) {
+        audit_ring_t *r = atomic_load(&log->rings[i]);
+        audit_entry_t *e = &r->entries[cursor[i] & (RING_SIZE - 1)];
+        if (cursor[i] < heads[i] && e->seq == *next) {
+            iov[count].iov_base = e->line;
+            iov[count].iov_len = e->len;
+            count++;
+            cursor[i]++;
+            (*next)++;
+            misses = 0; // consecutive lines often come from the same ring, so stay on it
+        } else {
+            i = (i + 1) % nrings;
+            misses++;
+        }
+    }
+
+    if (count > 0) {
+        write_batch(log->fd, iov, count);
+        for (int j = 0; j < nrings; j++) {
+            atomic_store_explicit(
+                &atomic_load(&log->rings[j])->tail, cursor[j], memory_order_release);
+        }
+    }
+    return count;
+}
+
+static void reopen(audit_log_t *log) {
+    if (log->path == NULL) {
+        return;
+    }
+    int fd = open_log(log->path);
+    if (fd >= 0) {
+        close(log->fd);
+        log->fd = fd;
+    }
+}
+
+static void *flusher_thread(void *arg) {
+    audit_log_t *log = arg;
+    uint64_t next = 0;
+    for (;;) {
+        if (atomic_exchange(&log->rotate, false)) {
+            reopen(log);
+        }
+        if (flush_batch(log, &next) > 0) {
+            atomic_store(&log->written, next);
+            continue;
+        }
+        if (atomic_load(&log->stop) && next == atomic_load(&log->next_seq)) {
+            return NULL;
+        }
+
+        // Caught up (or waiting on a line whose number was taken but which is not yet
+        // published): sleep until the next round, or until a ring is half full
+        pthread_mutex_lock(&log->mutex);
+        atomic_store(&log->sleeping, true);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLUSH_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (!atomic_load(&log->stop)) {
+            pthread_cond_timedwait(&log->cond, &log->mutex, &deadline);
+        }
+        atomic_store(&log->sleeping, false);
+        pthread_mutex_unlock(&log->mutex);
+    }
+}
+
+// Function to free a log's memory, once its flusher is stopped (or never started)
+static void free_log(audit_log_t *log) {
+    for (int i = 0; i < atomic_load(&log->nrings); i++) {
+        free(atomic_load(&log->rings[i]));
+    }
+    free(log->rings);
+    free(log->cursor);
+    free(log->heads);
+    free(log->path);
+    free(log);
+}
+
+audit_log_t *audit_log_new(const char *path, int max_threads) {
+    audit_log_t *log = calloc(1, sizeof(audit_log_t));
+    if (log == NULL) {
+        return NULL;
+    }
+    log->fd = STDERR_FILENO;
+    log->max_rings = max_threads > 0 ? max_threads : 1;
+    log->rings = calloc((size_t) log->max_rings, sizeof(*log->rings));
+    log->cursor = calloc((size_t) log->max_rings, sizeof(uint64_t));
+    log->heads = calloc((size_t) log->max_rings, sizeof(uint64_t));
+    if (log->rings == NULL || log->cursor == NULL || log->heads == NULL) {
+        free_log(log);
+        return NULL;
+    }
+    if (path != NULL) {
+        log->path = strdup(path);
+        log->fd = open_log(path);
+        if (log->path == NULL || log->fd < 0) {
+            free_log(log);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&log->claim_mutex, NULL);
+    pthread_mutex_init(&log->mutex, NULL);
+    pthread_cond_init(&log->cond, NULL);
+    if (pthread_create(&log->flusher, NULL, flusher_thread, log) != 0) {
+        if (log->path != NULL) {
+            close(log->fd);
+        }
+        free_log(log);
+        return NULL;
+    }
+    return log;
+}
+
+void audit_log_delete(audit_log_t **log) {
+    if (log == NULL || *log == NULL) {
+        return;
+    }
+    audit_log_t *l = *log;
+    atomic_store(&l->stop, true);
+    pthread_mutex_lock(&l->mutex);
+    pthread_cond_signal(&l->cond);
+    pthread_mutex_unlock(&l->mutex);
+    pthread_join(l->flusher, NULL);
+
+    if (l->path != NULL) {
+        close(l->fd);
+    }
+    pthread_mutex_destroy(&l->claim_mutex);
+    pthread_mutex_destroy(&l->mutex);
+    pthread_cond_destroy(&l->cond);
+    free_log(l);
+    *log = NULL;
+}
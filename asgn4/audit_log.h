@@ -0,0 +1,58 @@
+/**
+ * @File audit_log.h
+ *
+ * The server's audit log, written asynchronously.  Each worker thread
+ * appends its lines to its own single-producer ring buffer, and a
+ * background thread merges the rings and writes them out in large writev
+ * batches.  Every line gets a sequence number when it is recorded, and
+ * lines are written in sequence order, so recording a line while holding
+ * a URI's lock keeps the log in linearization order.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @struct audit_log_t
+ *
+ *  @brief The log file, the per-thread rings, and the flusher thread.
+ */
+typedef struct audit_log audit_log_t;
+
+/** @brief Opens (appending) or creates the log and starts the flusher.
+ *
+ *  @param path The log file, or NULL to write to stderr.
+ *  @param max_threads How many threads may record lines at once; there
+ *         is a ring for each.
+ *
+ *  @return a pointer to a new audit_log_t, or NULL on failure.
+ */
+audit_log_t *audit_log_new(const char *path, int max_threads);
+
+/** @brief Flush everything recorded so far, stop the flusher and free
+ *         the log; *log is set to NULL.
+ */
+void audit_log_delete(audit_log_t **log);
+
+/** @brief Wait until every line recorded before the call is written,
+ *         e.g. before the server exits.
+ */
+void audit_log_flush(audit_log_t *log);
+
+/** @brief Append "method,/uri,code,request_id" to the log.  The calling
+ *         thread claims a ring on its first call, waiting for one if
+ *         max_threads others hold them.  Otherwise blocks only if its
+ *         ring is full.
+ */
+void audit_log_record(
+    audit_log_t *log, const char *method, const char *uri, uint16_t code, const char *request_id);
+
+/** @brief Give up the calling thread's ring, e.g. before the thread
+ *         exits.  Lines already recorded are still written.
+ */
+void audit_log_detach(audit_log_t *log);
+
+/** @brief Ask the flusher to reopen the log file, e.g. after it was
+ *         renamed by logrotate.  Async-signal-safe.
+ */
+void audit_log_rotate(audit_log_t *log);
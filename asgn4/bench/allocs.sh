@@ -0,0 +1,68 @@
+#!/bin/bash
+
+# Counts heap allocations per request.  Runs httpserver with
+# bench/malloc_count.so preloaded, warms it up, then takes the allocator's
+# counts before and after a bench/loadgen run and prints the allocations
+# and frees per request served: for keep-alive GETs of cached objects, for
+# PUTs, and for GETs on a new connection each (-r 1).
+#
+# usage: bench/allocs.sh [loadgen options]    (default: -c 16 -d 5)
+
+cd "$(dirname "$0")/.." || exit 1
+
+opts=("$@")
+if [ ${#opts[@]} -eq 0 ]; then
+    opts=(-c 16 -d 5)
+fi
+
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+make -s clean && make -s httpserver bench/loadgen bench/malloc_count.so || exit 1
+cp httpserver bench/loadgen bench/malloc_count.so "$work"
+make -s clean
+
+# Function to print the allocator's counts so far, as "allocs frees"
+counts() {
+    local lines
+    lines=$(grep -c '^malloc_count:' "$work/stderr")
+    kill -USR2 $server
+    while [ "$(grep -c '^malloc_count:' "$work/stderr")" -eq "$lines" ]; do
+        sleep 0.05
+    done
+    grep '^malloc_count:' "$work/stderr" | tail -1 | awk '{ print $3, $5 }'
+}
+
+echo "workload,requests,allocs/request,frees/request"
+for workload in get put new-connection; do
+    case $workload in
+    get) flags=(-w 0) server_flags=() ;;
+    put) flags=(-w 100) server_flags=() ;;
+    new-connection) flags=(-w 0) server_flags=(-r 1) ;;
+    esac
+    rm -rf "$work/data" && mkdir "$work/data" && : > "$work/stderr"
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data" && LD_PRELOAD="$work/malloc_count.so" exec "$work/httpserver" \
+        "${server_flags[@]}" "$port" 2> "$work/stderr") &
+    server=$!
+    sleep 0.5
+
+    # Put the objects and let the pool, caches and free lists fill before counting
+    "$work/loadgen" -c 4 -d 1 -s 4096 -w 50 "$port" > /dev/null
+    read -r a0 f0 < <(counts)
+    requests=$("$work/loadgen" -P -s 4096 "${flags[@]}" "${opts[@]}" "$port" \
+        | awk -F, '$5 == "ALL" { print $6 }')
+    read -r a1 f1 < <(counts)
+    awk -v w=$workload -v n="$requests" -v a=$((a1 - a0)) -v f=$((f1 - f0)) \
+        'BEGIN { printf "%s,%d,%.2f,%.2f\n", w, n, a / n, f / n }'
+
+    kill $server
+    wait $server 2>/dev/null
+    server=
+done
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# Runs the same load against the asgn2 and asgn4 servers and prints
+# bench/loadgen's CSV for both, labelled by server.  Every argument is
+# passed to loadgen, so e.g. bench/compare.sh -c 16 -R 5000 -z 0.99 -w 20.
+#
+# usage: bench/compare.sh [loadgen options]
+#        ASGN2=path ASGN4=path override the server binaries; a server that
+#        hasn't been built is skipped.
+
+cd "$(dirname "$0")/.." || exit 1
+make -s bench/loadgen || exit 1
+
+asgn2=${ASGN2:-../asgn2/httpserver}
+asgn4=${ASGN4:-./httpserver}
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+header=1
+for name in asgn2 asgn4; do
+    bin=$([ $name = asgn2 ] && echo "$asgn2" || echo "$asgn4")
+    if [ ! -x "$bin" ]; then
+        echo "skipping $name: $bin is not built" >&2
+        continue
+    fi
+    bin=$(realpath "$bin")
+    mkdir -p "$work/$name"
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/$name" && exec "$bin" "$port" 2>/dev/null) &
+    server=$!
+    sleep 0.5
+
+    bench/loadgen -l $name "$@" "$port" | tail -n +$header
+    header=2
+
+    kill $server
+    wait $server 2>/dev/null
+    server=
+done
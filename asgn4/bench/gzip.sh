@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Measures what gzip costs and saves per GET.  Serves text objects (this
+# directory's sources, repeated to each size) and runs bench/loadgen with
+# GETs only, three ways: without Accept-Encoding (identity), with gzip from
+# the copies the object cache keeps (cached), and with the cache off so
+# that every response is compressed as it goes out (streamed).  Prints the
+# bytes the server sent and the server's CPU time (user + system), per
+# request, from /metrics and /proc.
+#
+# usage: bench/gzip.sh [loadgen options]    (default: -c 8 -d 5)
+#        SIZES="4096 65536 1048576" overrides the object sizes, in bytes
+
+cd "$(dirname "$0")/.." || exit 1
+
+opts=("$@")
+if [ ${#opts[@]} -eq 0 ]; then
+    opts=(-c 8 -d 5)
+fi
+sizes=(${SIZES:-4096 65536 1048576})
+keys=16
+hz=$(getconf CLK_TCK)
+
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+make -s clean && make -s httpserver bench/loadgen || exit 1
+cp httpserver bench/loadgen "$work"
+cat ./*.[ch] > "$work/corpus"
+make -s clean
+
+# Function to print the bytes the server has sent and the CPU time it has used, in ticks
+counters() {
+    local sent
+    sent=$(curl -s "http://localhost:$port/metrics" | awk '/^httpserver_sent_bytes_total/ { print $2 }')
+    echo "$sent $(awk '{ print $14 + $15 }' "/proc/$server/stat")"
+}
+
+echo "size,encoding,requests,rps,bytes/request,cpu_us/request"
+for size in "${sizes[@]}"; do
+    rm -rf "$work/data" && mkdir "$work/data"
+    while [ "$(stat -c %s "$work/data/lg-0.obj" 2>/dev/null || echo 0)" -lt "$size" ]; do
+        cat "$work/corpus" >> "$work/data/lg-0.obj"
+    done
+    truncate -s "$size" "$work/data/lg-0.obj"
+    for ((k = 1; k < keys; k++)); do
+        cp "$work/data/lg-0.obj" "$work/data/lg-$k.obj"
+    done
+
+    for encoding in identity cached streamed; do
+        case $encoding in
+        identity) server_flags=() flags=() ;;
+        cached) server_flags=() flags=(-e) ;;
+        streamed) server_flags=(-c 0) flags=(-e) ;;
+        esac
+        port=$((20000 + RANDOM % 20000))
+        (cd "$work/data" && exec "$work/httpserver" "${server_flags[@]}" "$port" 2>/dev/null) &
+        server=$!
+        sleep 0.5
+
+        # Fill the cache (and its compressed copies) before counting
+        "$work/loadgen" -P -w 0 -k $keys -c 2 -d 1 "${flags[@]}" "$port" > /dev/null
+        read -r b0 t0 < <(counters)
+        row=$("$work/loadgen" -P -w 0 -k $keys "${flags[@]}" "${opts[@]}" "$port" \
+            | awk -F, '$5 == "GET" { print $6, $8 }')
+        read -r b1 t1 < <(counters)
+        read -r requests rps <<< "$row"
+        awk -v s="$size" -v e=$encoding -v n="$requests" -v r="$rps" -v b=$((b1 - b0)) \
+            -v t=$((t1 - t0)) -v hz="$hz" \
+            'BEGIN { printf "%s,%s,%d,%s,%.0f,%.1f\n", s, e, n, r, b / n, t * 1e6 / hz / n }'
+
+        kill $server
+        wait $server 2>/dev/null
+        server=
+    done
+done
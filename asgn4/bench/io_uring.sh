@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Compares GET throughput with and without the io_uring backend.  Builds
+# httpserver both ways (IO_URING=0 and 1), then runs bench/loadgen with
+# GETs only against objects of each size, with the object cache turned
+# off so that every GET opens and reads its object.  Prints loadgen's
+# CSV, labelled by backend and object size.
+#
+# usage: bench/io_uring.sh [loadgen options]    (default: -c 16 -d 5)
+#        SIZES="4096 1048576" overrides the object sizes, in bytes
+
+cd "$(dirname "$0")/.." || exit 1
+
+opts=("$@")
+if [ ${#opts[@]} -eq 0 ]; then
+    opts=(-c 16 -d 5)
+fi
+sizes=(${SIZES:-4096 1048576})
+
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+for uring in 0 1; do
+    make -s clean && make -s IO_URING=$uring httpserver || exit 1
+    cp httpserver "$work/httpserver-$uring"
+done
+make -s clean
+make -s bench/loadgen || exit 1
+
+header=1
+for size in "${sizes[@]}"; do
+    for uring in 0 1; do
+        name=$([ $uring -eq 1 ] && echo io_uring || echo blocking)
+        rm -rf "$work/data" && mkdir "$work/data"
+        port=$((20000 + RANDOM % 20000))
+        (cd "$work/data" && exec "$work/httpserver-$uring" -c 0 "$port" 2>/dev/null) &
+        server=$!
+        sleep 0.5
+
+        bench/loadgen -l "$name-$size" -w 0 -s "$size" "${opts[@]}" "$port" | tail -n +$header
+        header=2
+
+        kill $server
+        wait $server 2>/dev/null
+        server=
+    done
+done
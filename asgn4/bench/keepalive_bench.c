@@ -0,0 +1,175 @@
+/**
+ * @File keepalive_bench.c
+ *
+ * Measures GET requests/sec against a running httpserver, first opening a
+ * new connection for every request and then reusing (and optionally
+ * pipelining on) persistent connections.
+ *
+ * usage: ./bench/keepalive_bench [-c clients] [-d seconds] [-p depth] <port> <uri>
+ *        (the object must already exist on the server, e.g. via curl -T)
+ *
+ * When the server ends a connection (its -r limit), the client reconnects;
+ * pipelined requests that were cut off are not counted.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    int port;
+    const char *uri;
+    int reuse;
+    int depth;
+    double seconds;
+    uint64_t requests;
+    uint64_t errors;
+} client_t;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static int dial(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// Function to read up to `count` 200 responses, using Content-Length to find each one's end.
+// Returns how many arrived; *closed is set if the server is ending the connection.
+static int read_responses(int fd, int count, int *closed) {
+    static _Thread_local char buf[1 << 16];
+    size_t len = 0;
+    int got = 0;
+    *closed = 0;
+    while (got < count && !*closed) {
+        char *end = memmem(buf, len, "\r\n\r\n", 4);
+        if (end != NULL) {
+            char *cl = memmem(buf, end - buf, "Content-Length: ", 16);
+            if (cl == NULL || strncmp(buf, "HTTP/1.1 200", 12) != 0) {
+                *closed = 1;
+                break;
+            }
+            *closed = memmem(buf, end - buf, "Connection: close", 17) != NULL;
+            size_t total = (size_t) (end + 4 - buf) + strtoul(cl + 16, NULL, 10);
+            if (len >= total) {
+                memmove(buf, buf + total, len - total);
+                len -= total;
+                got++;
+                continue;
+            }
+            *closed = 0;
+        }
+        ssize_t n = len == sizeof(buf) ? -1 : read(fd, buf + len, sizeof(buf) - len);
+        if (n <= 0) {
+            *closed = 1;
+            break;
+        }
+        len += (size_t) n;
+    }
+    return got;
+}
+
+static void *client(void *arg) {
+    client_t *c = arg;
+    char req[256];
+    int reqlen = snprintf(req, sizeof(req), "GET /%s HTTP/1.1\r\n\r\n", c->uri);
+    char batch[256 * 64];
+    for (int i = 0; i < c->depth; i++) {
+        memcpy(batch + i * reqlen, req, reqlen);
+    }
+
+    double deadline = now_s() + c->seconds;
+    int fd = -1;
+    while (now_s() < deadline) {
+        if (fd < 0 && (fd = dial(c->port)) < 0) {
+            c->errors++;
+            continue;
+        }
+        int closed = 1;
+        int got = 0;
+        if (write(fd, batch, (size_t) reqlen * c->depth) == reqlen * c->depth) {
+            got = read_responses(fd, c->depth, &closed);
+        }
+        c->requests += (uint64_t) got;
+        if (got == 0) {
+            c->errors++;
+        }
+        if (!c->reuse || closed) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+static void run(const char *mode, int port, const char *uri, int reuse, int depth, int clients,
+    double seconds) {
+    client_t c[clients];
+    pthread_t tid[clients];
+    double start = now_s();
+    for (int i = 0; i < clients; i++) {
+        c[i] = (client_t) { port, uri, reuse, depth, seconds, 0, 0 };
+        pthread_create(&tid[i], NULL, client, &c[i]);
+    }
+    uint64_t requests = 0, errors = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(tid[i], NULL);
+        requests += c[i].requests;
+        errors += c[i].errors;
+    }
+    double elapsed = now_s() - start;
+    printf("%-12s %8d %6d %12.0f %8llu\n", mode, clients, depth, (double) requests / elapsed,
+        (unsigned long long) errors);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    int clients = 8;
+    int depth = 8;
+    double seconds = 5.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:p:")) != -1) {
+        switch (opt) {
+        case 'c': clients = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        case 'p': depth = atoi(optarg); break;
+        default: optind = argc; break;
+        }
+    }
+    if (argc - optind != 2 || depth < 1 || depth > 64) {
+        fprintf(stderr, "usage: %s [-c clients] [-d seconds] [-p depth] <port> <uri>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    int port = atoi(argv[optind]);
+    const char *uri = argv[optind + 1];
+
+    printf("%-12s %8s %6s %12s %8s\n", "mode", "clients", "depth", "req/s", "errors");
+    run("close", port, uri, 0, 1, clients, seconds);
+    run("keep-alive", port, uri, 1, 1, clients, seconds);
+    run("pipelined", port, uri, 1, depth, clients, seconds);
+    return EXIT_SUCCESS;
+}
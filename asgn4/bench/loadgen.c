@@ -0,0 +1,489 @@
+/**
+ * @File loadgen.c
+ *
+ * Load generator for httpserver (asgn2 or asgn4).  Every connection runs
+ * in its own thread and sends a mix of GETs and PUTs over a fixed key set,
+ * reconnecting whenever the server closes the connection.
+ *
+ *   closed loop (default): each connection sends its next request as soon
+ *     as the last one is answered.
+ *   open loop (-R rate):   requests are due at a constant total rate.  A
+ *     request's latency is measured from when it was due, not from when it
+ *     went out, so a stalled server is charged for the requests it held up
+ *     (the coordinated-omission correction).
+ *
+ * usage: ./bench/loadgen [-c conns] [-d seconds] [-R rate] [-w put_pct] [-s size]
+ *                        [-k keys] [-z theta] [-i] [-e] [-P] [-l label] [-H hist.csv] <port>
+ *
+ *   -z  zipfian key skew (e.g. 0.99); 0 picks keys uniformly
+ *   -i  tag every request with a unique Request-Id header
+ *   -e  send "Accept-Encoding: gzip" with every GET
+ *   -P  skip PUTting every key once before the run
+ *   -l  first column of every row, e.g. the server under test
+ *   -H  also write the merged latency histogram as CSV
+ *
+ * Prints one CSV row each for GET, PUT and ALL with the throughput and the
+ * p50/p90/p99/p99.9/p99.99/max latency in microseconds.
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+// Log-linear histogram of microseconds: exact below 64, then 32 buckets per power of two
+// (about 3% resolution), up to 2^45 us
+#define SUB_BUCKETS 32
+#define NBUCKETS    (2 * SUB_BUCKETS + 44 * SUB_BUCKETS)
+#define BUF_SIZE    65536
+
+enum { GET, PUT, NOPS };
+
+typedef struct {
+    uint64_t counts[NBUCKETS];
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t max;
+} histogram_t;
+
+typedef struct {
+    int id;
+    double interval; // seconds between this connection's requests in open loop; 0: closed
+    double start;
+    double end;
+    uint64_t rng;
+    histogram_t hist[NOPS];
+} client_t;
+
+static int port;
+static int put_pct = 10;
+static size_t object_size = 1024;
+static int nkeys = 1000;
+static bool tag_requests;
+static bool accept_gzip;
+static double *zipf_cdf; // NULL: uniform
+static char *body;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t) {
+    struct timespec ts = { (time_t) t, (long) ((t - (double) (time_t) t) * 1e9) };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static uint64_t next_rand(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static double rand_unit(uint64_t *s) {
+    return (double) (next_rand(s) >> 11) / (double) (1ULL << 53);
+}
+
+static int bucket_of(uint64_t us) {
+    if (us < 2 * SUB_BUCKETS) {
+        return (int) us;
+    }
+    int shift = 63 - __builtin_clzll(us) - 5;
+    int b = 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (int) ((us >> shift) - SUB_BUCKETS);
+    return b < NBUCKETS ? b : NBUCKETS - 1;
+}
+
+// Function to find the smallest value that lands in bucket b
+static uint64_t bucket_value(int b) {
+    if (b < 2 * SUB_BUCKETS) {
+        return (uint64_t) b;
+    }
+    int shift = (b - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    return (uint64_t) (SUB_BUCKETS + (b - 2 * SUB_BUCKETS) % SUB_BUCKETS) << shift;
+}
+
+static void record(histogram_t *h, double seconds) {
+    uint64_t us = seconds > 0 ? (uint64_t) (seconds * 1e6) : 0;
+    h->counts[bucket_of(us)]++;
+    h->requests++;
+    if (us > h->max) {
+        h->max = us;
+    }
+}
+
+static uint64_t percentile(const histogram_t *h, double q) {
+    uint64_t rank = (uint64_t) ceil(q * (double) h->requests), seen = 0;
+    for (int b = 0; b < NBUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank && seen > 0) {
+            uint64_t v = bucket_value(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static void merge(histogram_t *into, const histogram_t *h) {
+    for (int b = 0; b < NBUCKETS; b++) {
+        into->counts[b] += h->counts[b];
+    }
+    into->requests += h->requests;
+    into->errors += h->errors;
+    if (h->max > into->max) {
+        into->max = h->max;
+    }
+}
+
+// Function to build the CDF of a zipfian distribution over nkeys keys
+static double *zipf_new(int n, double theta) {
+    double *cdf = malloc((size_t) n * sizeof(double));
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += 1.0 / pow((double) (i + 1), theta);
+        cdf[i] = sum;
+    }
+    for (int i = 0; i < n; i++) {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+static int pick_key(uint64_t *rng) {
+    if (zipf_cdf == NULL) {
+        return (int) (next_rand(rng) % (uint64_t) nkeys);
+    }
+    double u = rand_unit(rng);
+    int lo = 0, hi = nkeys - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (zipf_cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int dial(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool write_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n <= 0) {
+            return false;
+        }
+        while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+            n -= (ssize_t) iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= (size_t) n;
+        }
+    }
+    return true;
+}
+
+// Function to skip a chunked body, of which buf[start, len) has already been read. Returns
+// false if the connection broke first, or if more than the body arrived.
+static bool skip_chunked(int fd, char *buf, size_t start, size_t len) {
+    for (;;) {
+        char *eol;
+        while ((eol = memmem(buf + start, len - start, "\r\n", 2)) == NULL) {
+            memmove(buf, buf + start, len - start);
+            len -= start;
+            start = 0;
+            ssize_t n = len == BUF_SIZE ? -1 : read(fd, buf + len, BUF_SIZE - len);
+            if (n <= 0) {
+                return false;
+            }
+            len += (size_t) n;
+        }
+        size_t size = strtoul(buf + start, NULL, 16);
+        start = (size_t) (eol + 2 - buf);
+
+        // The chunk's data and the CRLF after it; after the last chunk, that ends the body
+        size_t left = size + 2;
+        while (left > 0) {
+            if (start == len) {
+                ssize_t n = read(fd, buf, BUF_SIZE);
+                if (n <= 0) {
+                    return false;
+                }
+                start = 0;
+                len = (size_t) n;
+            }
+            size_t n = len - start < left ? len - start : left;
+            start += n;
+            left -= n;
+        }
+        if (size == 0) {
+            return start == len;
+        }
+    }
+}
+
+// Function to read one response and skip its body. Returns the status code, or -1 if the
+// connection broke first; *closed is set if the connection can't be reused.
+static int read_response(int fd, char *buf, bool *closed) {
+    size_t len = 0;
+    char *end;
+    while ((end = memmem(buf, len, "\r\n\r\n", 4)) == NULL) {
+        ssize_t n = len == BUF_SIZE ? -1 : read(fd, buf + len, BUF_SIZE - len);
+        if (n <= 0) {
+            *closed = true;
+            return -1;
+        }
+        len += (size_t) n;
+    }
+    int code = len > 12 ? atoi(buf + 9) : -1;
+    if (memmem(buf, (size_t) (end - buf), "Transfer-Encoding: chunked", 26) != NULL) {
+        *closed = memmem(buf, (size_t) (end - buf), "Connection: close", 17) != NULL;
+        if (!skip_chunked(fd, buf, (size_t) (end + 4 - buf), len)) {
+            *closed = true;
+            return -1;
+        }
+        return code;
+    }
+    char *cl = memmem(buf, (size_t) (end - buf), "Content-Length: ", 16);
+    *closed = cl == NULL || memmem(buf, (size_t) (end - buf), "Connection: close", 17) != NULL;
+    size_t left = cl ? strtoul(cl + 16, NULL, 10) : 0;
+    size_t have = len - (size_t) (end + 4 - buf);
+    if (have > left) {
+        *closed = true; // the server answered more than we asked; don't guess
+    }
+    left -= have < left ? have : left;
+    while (left > 0) {
+        ssize_t n = read(fd, buf, left < BUF_SIZE ? left : BUF_SIZE);
+        if (n <= 0) {
+            *closed = true;
+            return -1;
+        }
+        left -= (size_t) n;
+    }
+    return code;
+}
+
+// Function to send one request and wait for its answer on *fd, dialing first if needed.
+// A server that closes without saying so (asgn2) breaks the next request on a reused
+// connection, so that one is retried once on a new connection. Returns the status code or -1.
+static int request(int *fd, char *buf, int op, int key, uint64_t request_id) {
+    bool reused = *fd >= 0;
+    if (!reused && (*fd = dial()) < 0) {
+        return -1;
+    }
+    char head[256];
+    int len = snprintf(head, sizeof(head), "%s /lg-%d.obj HTTP/1.1\r\n", op == PUT ? "PUT" : "GET",
+        key);
+    if (op == PUT) {
+        len += snprintf(head + len, sizeof(head) - len, "Content-Length: %zu\r\n", object_size);
+    }
+    if (accept_gzip && op == GET) {
+        len += snprintf(head + len, sizeof(head) - len, "Accept-Encoding: gzip\r\n");
+    }
+    if (tag_requests) {
+        len += snprintf(head + len, sizeof(head) - len, "Request-Id: %llu\r\n",
+            (unsigned long long) request_id);
+    }
+    len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    struct iovec iov[2] = { { head, (size_t) len }, { body, op == PUT ? object_size : 0 } };
+
+    bool closed = true;
+    int code = write_all(*fd, iov, 2) ? read_response(*fd, buf, &closed) : -1;
+    if (closed) {
+        close(*fd);
+        *fd = -1;
+    }
+    if (code < 0 && reused && (*fd = dial()) >= 0) {
+        iov[0] = (struct iovec) { head, (size_t) len };
+        iov[1] = (struct iovec) { body, op == PUT ? object_size : 0 };
+        code = write_all(*fd, iov, 2) ? read_response(*fd, buf, &closed) : -1;
+        if (closed) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+    return code;
+}
+
+static void *client(void *arg) {
+    client_t *c = arg;
+    char *buf = malloc(BUF_SIZE);
+    int fd = -1;
+    uint64_t seq = 0;
+    // Spread the connections' schedules over one interval so they don't fire together
+    double due = c->start + c->interval * rand_unit(&c->rng);
+    while (due < c->end) {
+        if (c->interval > 0) {
+            sleep_until(due);
+        } else {
+            due = now_s();
+        }
+        int op = (int) (next_rand(&c->rng) % 100) < put_pct ? PUT : GET;
+        int key = pick_key(&c->rng);
+        uint64_t id = ((uint64_t) (c->id + 1) << 40) | ++seq;
+        int code = request(&fd, buf, op, key, id);
+        if (code == 200 || code == 201) {
+            record(&c->hist[op], now_s() - due);
+        } else {
+            c->hist[op].errors++;
+        }
+        due = c->interval > 0 ? due + c->interval : now_s();
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    return NULL;
+}
+
+// Function to PUT every key once so that GETs find them
+static bool preload(void) {
+    char *buf = malloc(BUF_SIZE);
+    int fd = -1;
+    bool ok = true;
+    for (int key = 0; key < nkeys && ok; key++) {
+        int code = request(&fd, buf, PUT, key, (uint64_t) key + 1);
+        ok = code == 200 || code == 201;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(buf);
+    return ok;
+}
+
+static void print_row(const char *label, const char *mode, int conns, double rate,
+    const char *op, const histogram_t *h, double secs) {
+    printf("%s,%s,%d,%.0f,%s,%llu,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu\n", label, mode, conns,
+        rate, op, (unsigned long long) h->requests, (unsigned long long) h->errors,
+        (double) h->requests / secs, (unsigned long long) percentile(h, 0.50),
+        (unsigned long long) percentile(h, 0.90), (unsigned long long) percentile(h, 0.99),
+        (unsigned long long) percentile(h, 0.999), (unsigned long long) percentile(h, 0.9999),
+        (unsigned long long) h->max);
+}
+
+static void write_histogram(const char *path, const histogram_t *h) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return;
+    }
+    fprintf(f, "value_us,count,cumulative\n");
+    uint64_t seen = 0;
+    for (int b = 0; b < NBUCKETS; b++) {
+        if (h->counts[b] > 0) {
+            seen += h->counts[b];
+            fprintf(f, "%llu,%llu,%.6f\n", (unsigned long long) bucket_value(b),
+                (unsigned long long) h->counts[b], (double) seen / (double) h->requests);
+        }
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    int conns = 8;
+    double secs = 10.0, rate = 0, theta = 0;
+    bool load = true;
+    const char *label = "httpserver", *hist_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:R:w:s:k:z:iePl:H:")) != -1) {
+        switch (opt) {
+        case 'c': conns = atoi(optarg); break;
+        case 'd': secs = atof(optarg); break;
+        case 'R': rate = atof(optarg); break;
+        case 'w': put_pct = atoi(optarg); break;
+        case 's': object_size = strtoul(optarg, NULL, 10); break;
+        case 'k': nkeys = atoi(optarg); break;
+        case 'z': theta = atof(optarg); break;
+        case 'i': tag_requests = true; break;
+        case 'e': accept_gzip = true; break;
+        case 'P': load = false; break;
+        case 'l': label = optarg; break;
+        case 'H': hist_path = optarg; break;
+        default: optind = argc; break;
+        }
+    }
+    if (argc - optind != 1 || conns < 1 || nkeys < 1 || put_pct < 0 || put_pct > 100 || rate < 0) {
+        fprintf(stderr,
+            "usage: %s [-c conns] [-d seconds] [-R rate] [-w put_pct] [-s size] [-k keys] "
+            "[-z theta] [-i] [-e] [-P] [-l label] [-H hist.csv] <port>\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+    port = atoi(argv[optind]);
+    body = malloc(object_size + 1);
+    memset(body, 'x', object_size);
+    if (theta > 0) {
+        zipf_cdf = zipf_new(nkeys, theta);
+    }
+    if (load && !preload()) {
+        fprintf(stderr, "%s: could not PUT the keys on port %d\n", argv[0], port);
+        return EXIT_FAILURE;
+    }
+
+    client_t *c = calloc((size_t) conns, sizeof(client_t));
+    pthread_t *tid = calloc((size_t) conns, sizeof(pthread_t));
+    double start = now_s();
+    for (int i = 0; i < conns; i++) {
+        c[i].id = i;
+        c[i].interval = rate > 0 ? conns / rate : 0;
+        c[i].start = start;
+        c[i].end = start + secs;
+        c[i].rng = 0x9E3779B97F4A7C15ULL * (uint64_t) (i + 1);
+        pthread_create(&tid[i], NULL, client, &c[i]);
+    }
+    histogram_t *total = calloc(NOPS + 1, sizeof(histogram_t));
+    for (int i = 0; i < conns; i++) {
+        pthread_join(tid[i], NULL);
+        for (int op = 0; op < NOPS; op++) {
+            merge(&total[op], &c[i].hist[op]);
+            merge(&total[NOPS], &c[i].hist[op]);
+        }
+    }
+    double elapsed = now_s() - start;
+
+    const char *mode = rate > 0 ? "open" : "closed";
+    printf("label,mode,conns,target_rps,op,requests,errors,rps,"
+           "p50_us,p90_us,p99_us,p999_us,p9999_us,max_us\n");
+    print_row(label, mode, conns, rate, "GET", &total[GET], elapsed);
+    print_row(label, mode, conns, rate, "PUT", &total[PUT], elapsed);
+    print_row(label, mode, conns, rate, "ALL", &total[NOPS], elapsed);
+    if (hist_path != NULL) {
+        write_histogram(hist_path, &total[NOPS]);
+    }
+
+    free(total);
+    free(c);
+    free(tid);
+    free(body);
+    free(zipf_cdf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/**
+ * @File lock_table_bench.c
+ *
+ * Measures the latency of looking up and acquiring a URI's rwlock with
+ * N resident keys, for the sharded lock_table_t and for the single-mutex
+ * linked list it replaced.
+ *
+ * usage: ./bench/lock_table_bench [-t threads] [-d seconds] [keys ...]
+ *        (keys defaults to 10000 1000000 10000000)
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lock_table.h"
+
+#define MAX_SAMPLES 1000000
+
+// The old design: one global mutex in front of a singly linked list
+typedef struct legacyNodeObj *legacyNode;
+typedef struct legacyNodeObj {
+    char *uri;
+    rwlock_t *rwlock;
+    legacyNode next;
+} legacyNodeObj;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    legacyNode head;
+    rwlock_t *shared;
+} legacy_t;
+
+typedef struct {
+    int legacy;
+    legacy_t *list;
+    lock_table_t *table;
+    size_t keys;
+    double seconds;
+    uint64_t seed;
+    uint64_t ops;
+    uint64_t *samples;
+    size_t nsamples;
+} worker_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static void key_name(char *buf, size_t size, uint64_t i) {
+    snprintf(buf, size, "obj-%010llu", (unsigned long long) i);
+}
+
+// The list is built by prepending; the old append walked the whole list and
+// would take hours to reach millions of keys.  Every node shares one rwlock
+// because only the lookup cost is being measured.
+static legacy_t *legacy_build(size_t keys) {
+    legacy_t *list = malloc(sizeof(legacy_t));
+    pthread_mutex_init(&list->mutex, NULL);
+    list->head = NULL;
+    list->shared = rwlock_new(N_WAY, 1);
+    char key[32];
+    for (size_t i = 0; i < keys; i++) {
+        key_name(key, sizeof(key), i);
+        legacyNode node = malloc(sizeof(legacyNodeObj));
+        node->uri = strdup(key);
+        node->rwlock = list->shared;
+        node->next = list->head;
+        list->head = node;
+    }
+    return list;
+}
+
+static void legacy_free(legacy_t *list) {
+    for (legacyNode node = list->head; node != NULL;) {
+        legacyNode next = node->next;
+        free(node->uri);
+        free(node);
+        node = next;
+    }
+    rwlock_delete(&list->shared);
+    pthread_mutex_destroy(&list->mutex);
+    free(list);
+}
+
+static rwlock_t *legacy_lookup(legacy_t *list, const char *uri) {
+    for (legacyNode node = list->head; node != NULL; node = node->next) {
+        if (strcmp(node->uri, uri) == 0) {
+            return node->rwlock;
+        }
+    }
+    return NULL;
+}
+
+static lock_table_t *table_build(size_t keys) {
+    lock_table_t *table = lock_table_new(0);
+    char key[32];
+    // Each key keeps one reference so that it stays resident for the run
+    for (size_t i = 0; i < keys; i++) {
+        key_name(key, sizeof(key), i);
+        lock_table_acquire(table, key);
+    }
+    return table;
+}
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    char key[32];
+    uint64_t deadline = now_ns() + (uint64_t) (w->seconds * 1e9);
+    for (;;) {
+        key_name(key, sizeof(key), xorshift(&w->seed) % w->keys);
+        uint64_t start = now_ns();
+        if (w->legacy) {
+            pthread_mutex_lock(&w->list->mutex);
+            rwlock_t *lock = legacy_lookup(w->list, key);
+            pthread_mutex_unlock(&w->list->mutex);
+            reader_lock(lock);
+            reader_unlock(lock);
+        } else {
+            lock_entry_t *entry = lock_table_acquire(w->table, key);
+            rwlock_t *lock = lock_entry_rwlock(entry);
+            reader_lock(lock);
+            reader_unlock(lock);
+            lock_table_release(w->table, entry);
+        }
+        uint64_t end = now_ns();
+        if (w->nsamples < MAX_SAMPLES) {
+            w->samples[w->nsamples++] = end - start;
+        }
+        w->ops++;
+        if (end >= deadline) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *name, int legacy, void *impl, size_t keys, int threads,
+    double seconds) {
+    worker_t w[threads];
+    pthread_t tid[threads];
+    for (int i = 0; i < threads; i++) {
+        w[i].legacy = legacy;
+        w[i].list = legacy ? impl : NULL;
+        w[i].table = legacy ? NULL : impl;
+        w[i].keys = keys;
+        w[i].seconds = seconds;
+        w[i].seed = 0x9E3779B97F4A7C15ULL * (uint64_t) (i + 1);
+        w[i].ops = 0;
+        w[i].samples = malloc(MAX_SAMPLES * sizeof(uint64_t));
+        w[i].nsamples = 0;
+    }
+    uint64_t start = now_ns();
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&tid[i], NULL, worker, &w[i]);
+    }
+    uint64_t ops = 0;
+    size_t total = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+        ops += w[i].ops;
+        total += w[i].nsamples;
+    }
+    double elapsed = (double) (now_ns() - start) / 1e9;
+
+    uint64_t *all = malloc(total * sizeof(uint64_t));
+    size_t n = 0;
+    for (int i = 0; i < threads; i++) {
+        memcpy(all + n, w[i].samples, w[i].nsamples * sizeof(uint64_t));
+        n += w[i].nsamples;
+        free(w[i].samples);
+    }
+    qsort(all, n, sizeof(uint64_t), cmp_u64);
+    printf("%-11s %10zu %8d %14.0f %12llu %12llu %12llu\n", name, keys, threads,
+        (double) ops / elapsed, (unsigned long long) all[n / 2],
+        (unsigned long long) all[(size_t) (n * 0.99)], (unsigned long long) all[n - 1]);
+    fflush(stdout);
+    free(all);
+}
+
+int main(int argc, char **argv) {
+    int threads = 4;
+    double seconds = 1.0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t:d:")) != -1) {
+        switch (opt) {
+        case 't': threads = atoi(optarg); break;
+        case 'd': seconds = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-d seconds] [keys ...]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t defaults[] = { 10000, 1000000, 10000000 };
+    size_t nkeys = argc > optind ? (size_t) (argc - optind) : 3;
+    size_t keys[nkeys];
+    for (size_t i = 0; i < nkeys; i++) {
+        keys[i] = argc > optind ? strtoull(argv[optind + i], NULL, 10) : defaults[i];
+    }
+
+    printf("%-11s %10s %8s %14s %12s %12s %12s\n", "impl", "keys", "threads", "ops/s", "p50_ns",
+        "p99_ns", "max_ns");
+    for (size_t i = 0; i < nkeys; i++) {
+        legacy_t *list = legacy_build(keys[i]);
+        run("list", 1, list, keys[i], threads, seconds);
+        legacy_free(list);
+
+        lock_table_t *table = table_build(keys[i]);
+        run("lock_table", 0, table, keys[i], threads, seconds);
+        lock_table_delete(&table);
+    }
+    return EXIT_SUCCESS;
+}
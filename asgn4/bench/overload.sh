@@ -0,0 +1,70 @@
+#!/bin/bash
+
+# Shows what admission control does while every worker is stuck.  Runs
+# httpserver with two workers (-t 2 -T 2, so the pool can't grow), has two
+# slow clients each download a large object at a trickle so that both
+# workers block sending it, and meanwhile runs bench/loadgen with GETs of
+# small objects.  Once without load shedding (-q 0) and once with the
+# defaults, it prints loadgen's GET row (errors are the 503s; the latencies
+# are those of the requests that were served) and the shed counters.
+#
+# usage: bench/overload.sh [loadgen options]    (default: -c 32 -d 10)
+#        STALL_MB=64 sets the size of the slow downloads, which must be more
+#        than the socket buffers hold, and RATE=1M their speed
+
+cd "$(dirname "$0")/.." || exit 1
+
+opts=("$@")
+if [ ${#opts[@]} -eq 0 ]; then
+    opts=(-c 32 -d 10)
+fi
+stall_mb=${STALL_MB:-64}
+rate=${RATE:-1M}
+
+work=$(mktemp -d)
+server=
+slow=()
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    [ ${#slow[@]} -gt 0 ] && kill "${slow[@]}" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+make -s clean && make -s httpserver bench/loadgen || exit 1
+cp httpserver bench/loadgen "$work"
+make -s clean
+
+header=1
+for shedding in off on; do
+    rm -rf "$work/data" && mkdir "$work/data"
+    head -c $((stall_mb << 20)) /dev/zero > "$work/data/stall"
+    target=$([ $shedding = on ] && echo "" || echo "-q 0")
+    port=$((20000 + RANDOM % 20000))
+    # shellcheck disable=SC2086
+    (cd "$work/data" && exec "$work/httpserver" -t 2 -T 2 -c 0 $target "$port" 2>/dev/null) &
+    server=$!
+    sleep 0.5
+
+    # Put the objects first, while the workers are free
+    "$work/loadgen" -c 4 -d 1 -s 4096 -w 0 "$port" > /dev/null
+    slow=()
+    for _ in 1 2; do
+        curl -s --limit-rate "$rate" -o /dev/null "http://localhost:$port/stall" &
+        slow+=($!)
+    done
+    sleep 0.5
+
+    "$work/loadgen" -l "shedding-$shedding" -w 0 -s 4096 -P "${opts[@]}" "$port" \
+        | awk -F, -v h=$header '(NR == 1 && h) || $5 == "GET"'
+    header=0
+    kill "${slow[@]}" 2>/dev/null
+    wait "${slow[@]}" 2>/dev/null
+    slow=()
+    curl -s "http://localhost:$port/metrics" | grep -E '^httpserver_shed_total'
+
+    kill $server
+    wait $server 2>/dev/null
+    server=
+done
@@ -0,0 +1,249 @@
+/**
+ * @File parser_bench.c
+ *
+ * Measures how many request heads per second one core can parse, with
+ * http_parser.c and with the POSIX regexes it replaced.  Each request is
+ * copied into a receive buffer before it is parsed, as it would be read
+ * off a socket; "parser_chunked" hands it to the parser 64 bytes at a
+ * time, as if it arrived in small segments.
+ *
+ * Before timing anything, both parsers are run over a set of valid and
+ * malformed heads, and the benchmark fails if they disagree on any.
+ *
+ * usage: ./bench/parser_bench [-d seconds]
+ *
+ * Prints CSV: impl,request,bytes,requests,seconds,requests_per_sec_per_core,ns_per_request
+ */
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "http_parser.h"
+
+#define BUFFER_SIZE 4096
+#define CHUNK       64
+
+typedef struct {
+    const char *name;
+    const char *text;
+} sample_t;
+
+static const sample_t samples[] = {
+    { "curl_get", "GET /foo.txt HTTP/1.1\r\nHost: localhost:8080\r\nUser-Agent: curl/8.5.0\r\n"
+                  "Accept: */*\r\n\r\n" },
+    { "loadgen_put", "PUT /lg-4242.obj HTTP/1.1\r\nHost: localhost:8080\r\nContent-Length: 4096\r\n"
+                     "Request-Id: 1234567\r\n\r\n" },
+    { "browser_get",
+        "GET /index.html HTTP/1.1\r\nHost: www.example.com:8080\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate, br, zstd\r\n"
+        "Connection: keep-alive\r\nUpgrade-Insecure-Requests: 1\r\nSec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\nSec-Fetch-Site: none\r\nSec-Fetch-User: ?1\r\n"
+        "Priority: u=0, i\r\nIf-None-Match: \"5f2b-61a8c3e0\"\r\n\r\n" },
+};
+#define NUM_SAMPLES (sizeof(samples) / sizeof(samples[0]))
+
+// Heads the two parsers must agree on, valid or not
+static const char *cases[] = {
+    "GET /a HTTP/1.1\r\n\r\n",
+    "GET /a.b-c HTTP/1.1\r\nKey: v\r\n\r\n",
+    "get /a HTTP/1.1\r\n\r\n",
+    "ABCDEFGH /a HTTP/1.1\r\n\r\n",
+    "ABCDEFGHI /a HTTP/1.1\r\n\r\n",
+    " /a HTTP/1.1\r\n\r\n",
+    "GET a HTTP/1.1\r\n\r\n",
+    "GET / HTTP/1.1\r\n\r\n",
+    "GET /a_b HTTP/1.1\r\n\r\n",
+    "GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa HTTP/1.1\r\n\r\n",
+    "GET /aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa HTTP/1.1\r\n\r\n",
+    "GET /a HTTP/1.0\r\n\r\n",
+    "GET /a HTTP/1x1\r\n\r\n",
+    "GET /a HTTP/a.1\r\n\r\n",
+    "GET /a HTTP/1.1 \r\n\r\n",
+    "GET /a HTTP/1.1\n\r\n",
+    "GET  /a HTTP/1.1\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey:v\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey:  v\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey: \r\n\r\n",
+    "GET /a HTTP/1.1\r\nK_y: v\r\n\r\n",
+    "GET /a HTTP/1.1\r\n: v\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey: a\tb\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey: a:b: c\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey: v\rx\r\n\r\n",
+    "GET /a HTTP/1.1\r\nKey: v\r\n",
+    "GET /a HTTP/1.1\r\nKey: v\r\n\r",
+    "PUT /a HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello",
+};
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+static regex_t request_line_re;
+static regex_t header_field_re;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// The replaced parser, as connection.c had it: find "\r\n\r\n", then match the request line and
+// each header, NUL-terminating fields in place.  Returns the head's length, or 0 if it is bad.
+static size_t regex_parse(char *text, size_t len, char **uri) {
+    size_t head = 0;
+    for (size_t i = 0; i + 4 <= len && head == 0; i++) {
+        if (memcmp(text + i, "\r\n\r\n", 4) == 0) {
+            head = i + 4;
+        }
+    }
+    if (head == 0 || head > MAX_HEADER_LENGTH) {
+        return 0;
+    }
+    regmatch_t m[4];
+    char saved = text[head];
+    text[head] = '\0';
+    if (regexec(&request_line_re, text, 4, m, 0) != 0) {
+        text[head] = saved;
+        return 0;
+    }
+    *uri = text + m[2].rm_so;
+    char *p = text + m[0].rm_eo;
+    text[m[1].rm_eo] = '\0';
+    text[m[2].rm_eo] = '\0';
+    text[m[3].rm_eo] = '\0';
+    while (strncmp(p, "\r\n", 2) != 0) {
+        if (regexec(&header_field_re, p, 3, m, 0) != 0) {
+            text[head] = saved;
+            return 0;
+        }
+        char *next = p + m[0].rm_eo;
+        p[m[1].rm_eo] = '\0';
+        p[m[2].rm_eo] = '\0';
+        p = next;
+    }
+    text[head] = saved;
+    return head;
+}
+
+// Function to run http_parse over text, chunk bytes at a time (0 for all at once)
+static http_parse_status_t parser_parse(
+    http_parser_t *p, const char *text, size_t len, size_t chunk) {
+    http_parser_init(p);
+    if (chunk == 0) {
+        return http_parse(p, text, len);
+    }
+    http_parse_status_t status = HTTP_PARSE_INCOMPLETE;
+    for (size_t have = 0; have < len && status == HTTP_PARSE_INCOMPLETE;) {
+        have = have + chunk < len ? have + chunk : len;
+        status = http_parse(p, text, have);
+    }
+    return status;
+}
+
+// Function to check that the parsers accept the same heads and find the same URI in them
+static bool agree(void) {
+    char a[BUFFER_SIZE + 1], b[BUFFER_SIZE + 1];
+    bool ok = true;
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        size_t len = strlen(cases[i]);
+        memcpy(a, cases[i], len);
+        memcpy(b, cases[i], len);
+        char *uri = NULL;
+        size_t head = regex_parse(a, len, &uri);
+        for (size_t chunk = 0; chunk <= 3; chunk++) {
+            http_parser_t p;
+            http_parse_status_t status = parser_parse(&p, b, len, chunk);
+            bool same = (status == HTTP_PARSE_DONE) == (head != 0);
+            if (same && head != 0) {
+                same = p.head == head && p.uri_len == strlen(uri)
+                       && memcmp(b + p.uri, uri, p.uri_len) == 0;
+            }
+            if (!same) {
+                fprintf(stderr, "parsers disagree (chunk %zu) on: ", chunk);
+                fwrite(cases[i], 1, len, stderr);
+                fprintf(stderr, "\n");
+                ok = false;
+            }
+        }
+    }
+
+    // A head that never ends is an error once it reaches MAX_HEADER_LENGTH, not before
+    char *longhead = malloc(BUFFER_SIZE);
+    size_t len = (size_t) snprintf(longhead, BUFFER_SIZE, "GET /a HTTP/1.1\r\n");
+    while (len + 12 < BUFFER_SIZE) {
+        memcpy(longhead + len, "Key: value\r\n", 12);
+        len += 12;
+    }
+    http_parser_t p;
+    if (parser_parse(&p, longhead, MAX_HEADER_LENGTH - 1, 0) != HTTP_PARSE_INCOMPLETE
+        || parser_parse(&p, longhead, len, 0) != HTTP_PARSE_ERROR) {
+        fprintf(stderr, "parser mishandles a head longer than %d bytes\n", MAX_HEADER_LENGTH);
+        ok = false;
+    }
+    free(longhead);
+    return ok;
+}
+
+// Function to parse one sample over and over for the given time, printing its CSV row
+static void run(const char *impl, const sample_t *sample, size_t chunk, double seconds) {
+    char buf[BUFFER_SIZE + 1];
+    size_t len = strlen(sample->text);
+    bool regex = strcmp(impl, "regex") == 0;
+    uint64_t requests = 0, checksum = 0;
+    uint64_t start = now_ns(), deadline = start + (uint64_t) (seconds * 1e9), end;
+    do {
+        for (int i = 0; i < 1000; i++) {
+            memcpy(buf, sample->text, len);
+            if (regex) {
+                char *uri = NULL;
+                checksum += regex_parse(buf, len, &uri);
+            } else {
+                http_parser_t p;
+                parser_parse(&p, buf, len, chunk);
+                checksum += p.head;
+            }
+        }
+        requests += 1000;
+    } while ((end = now_ns()) < deadline);
+
+    if (checksum != requests * (uint64_t) len) {
+        fprintf(stderr, "%s rejected %s\n", impl, sample->name);
+        exit(EXIT_FAILURE);
+    }
+    double elapsed = (double) (end - start) / 1e9;
+    printf("%s,%s,%zu,%llu,%.3f,%.0f,%.1f\n", impl, sample->name, len,
+        (unsigned long long) requests, elapsed, (double) requests / elapsed,
+        elapsed * 1e9 / (double) requests);
+}
+
+int main(int argc, char **argv) {
+    double seconds = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        if (opt == 'd') {
+            seconds = atof(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-d seconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    regcomp(&request_line_re, "^" REQUEST_LINE_REGEX, REG_EXTENDED);
+    regcomp(&header_field_re, "^" HEADER_FIELD_REGEX, REG_EXTENDED);
+    if (!agree()) {
+        return EXIT_FAILURE;
+    }
+
+    printf("impl,request,bytes,requests,seconds,requests_per_sec_per_core,ns_per_request\n");
+    for (size_t i = 0; i < NUM_SAMPLES; i++) {
+        run("regex", &samples[i], 0, seconds);
+        run("parser", &samples[i], 0, seconds);
+        run("parser_chunked", &samples[i], CHUNK, seconds);
+    }
+    return EXIT_SUCCESS;
+}
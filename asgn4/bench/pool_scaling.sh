@@ -0,0 +1,58 @@
+#!/bin/bash
+
+# Compares the work-stealing worker pool (WORK_STEALING=1) with one queue
+# shared by all workers (WORK_STEALING=0).  Builds httpserver both ways,
+# then runs bench/loadgen against each with every thread count and prints
+# loadgen's ALL row for each run, prefixed with the design and -t.  The
+# pool is held at that size (-T = -t) so the designs are compared like
+# for like.
+#
+# usage: bench/pool_scaling.sh [thread counts ...]    (default: 4 8 16 32 64)
+#        LOADGEN="-c 64 -d 5 -w 10" overrides the load; PIN=1 adds -a
+
+cd "$(dirname "$0")/.." || exit 1
+
+threads=("$@")
+if [ ${#threads[@]} -eq 0 ]; then
+    threads=(4 8 16 32 64)
+fi
+loadgen=${LOADGEN:-"-c 64 -d 5 -w 10"}
+pin=$([ "${PIN:-0}" -eq 1 ] && echo -a)
+
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+for ws in 0 1; do
+    make -s clean && make -s WORK_STEALING=$ws httpserver bench/loadgen || exit 1
+    cp httpserver "$work/httpserver-$ws"
+done
+cp bench/loadgen "$work/loadgen"
+make -s clean
+
+header=1
+for ws in 0 1; do
+    name=$([ $ws -eq 1 ] && echo stealing || echo shared)
+    for t in "${threads[@]}"; do
+        rm -rf "$work/data" && mkdir -p "$work/data"
+        port=$((20000 + RANDOM % 20000))
+        (cd "$work/data" && exec "$work/httpserver-$ws" -t "$t" -T "$t" $pin "$port" 2>/dev/null) &
+        server=$!
+        sleep 0.5
+
+        # shellcheck disable=SC2086
+        "$work/loadgen" $loadgen -l "$name" "$port" | awk -F, -v t="$t" -v h=$header \
+            'NR == 1 && h { print "design,threads," $0 } $5 == "ALL" { print $1 "," t "," $0 }' \
+            | cut -d, -f1,2,4-
+        header=0
+
+        kill $server
+        wait $server 2>/dev/null
+        server=
+    done
+done
@@ -0,0 +1,79 @@
+#!/bin/bash
+
+# Compares keeping small objects in a file each with keeping them in the
+# log-structured store (-s).  For each backend, PUTs many small objects with
+# bench/loadgen, then GETs them back with the object cache off (so that
+# every GET reads the file or the segment), and prints the throughput and
+# p99 latency of each run, along with the files (inodes) and disk space the
+# objects took afterwards.  A restart after the PUTs measures how long the
+# store takes to read its segments back.
+#
+# usage: bench/store.sh [loadgen options]    (default: -c 8 -d 5)
+#        KEYS=20000 SIZE=1024 override the number and size of the objects
+
+cd "$(dirname "$0")/.." || exit 1
+
+opts=("$@")
+if [ ${#opts[@]} -eq 0 ]; then
+    opts=(-c 8 -d 5)
+fi
+keys=${KEYS:-20000}
+size=${SIZE:-1024}
+
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+make -s clean && make -s httpserver bench/loadgen || exit 1
+cp httpserver bench/loadgen "$work"
+make -s clean
+
+# Function to start the server on a new port in $work/data, and wait until it answers
+start() {
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data" && exec "$work/httpserver" -c 0 "${server_flags[@]}" "$port" 2>/dev/null) &
+    server=$!
+    until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+        kill -0 $server 2>/dev/null || exit 1
+        sleep 0.01
+    done
+}
+
+stop() {
+    kill $server
+    wait $server 2>/dev/null
+    server=
+}
+
+echo "backend,op,requests,rps,p99_us,files,disk_kb,startup_ms"
+for backend in files store; do
+    case $backend in
+    files) server_flags=() ;;
+    store) server_flags=(-s 64) ;;
+    esac
+    rm -rf "$work/data" && mkdir "$work/data"
+    start
+    put=$("$work/loadgen" -P -w 100 -k "$keys" -s "$size" "${opts[@]}" "$port" \
+        | awk -F, '$5 == "PUT" { print $6, $8, $11 }')
+    stop
+
+    # The GETs run against a fresh server, which has to find every object again first
+    t0=$(date +%s%N)
+    start
+    t1=$(date +%s%N)
+    get=$("$work/loadgen" -P -w 0 -k "$keys" -s "$size" "${opts[@]}" "$port" \
+        | awk -F, '$5 == "GET" { print $6, $8, $11 }')
+    stop
+
+    files=$(find "$work/data" -type f | wc -l)
+    disk=$(du -sk "$work/data" | cut -f1)
+    for row in "PUT $put" "GET $get"; do
+        read -r op requests rps p99 <<< "$row"
+        echo "$backend,$op,$requests,$rps,$p99,$files,$disk,$(((t1 - t0) / 1000000))"
+    done
+done
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Compares the buffered (ZERO_COPY=0) and sendfile/splice (ZERO_COPY=1)
+# data paths.  Builds httpserver both ways, then PUTs and GETs an object of
+# each size and reports the wall time and the server's CPU time.
+#
+# usage: bench/zero_copy.sh [sizes in MB ...]    (default: 1 100 4096)
+
+cd "$(dirname "$0")/.." || exit 1
+
+sizes=("$@")
+if [ ${#sizes[@]} -eq 0 ]; then
+    sizes=(1 100 4096)
+fi
+
+work=$(mktemp -d)
+hz=$(getconf CLK_TCK)
+
+cleanup() {
+    kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+for zc in 0 1; do
+    make -s clean && make -s ZERO_COPY=$zc httpserver || exit 1
+    cp httpserver "$work/httpserver-$zc"
+done
+make -s clean
+
+# Objects up to 100 MB are random; larger ones are sparse so that building them is quick
+for mb in "${sizes[@]}"; do
+    if [ "$mb" -le 100 ]; then
+        head -c "$((mb * 1024 * 1024))" /dev/urandom > "$work/src-$mb"
+    else
+        truncate -s "$((mb * 1024 * 1024))" "$work/src-$mb"
+    fi
+done
+
+cpu_ticks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+printf "%-9s %-4s %8s %10s %10s %10s\n" "path" "op" "size_mb" "seconds" "MB/s" "cpu_ms"
+for zc in 0 1; do
+    name=$([ $zc -eq 1 ] && echo zerocopy || echo buffered)
+    mkdir -p "$work/data-$zc"
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data-$zc" && exec "$work/httpserver-$zc" -t 4 "$port" 2>/dev/null) &
+    server=$!
+    sleep 0.5
+
+    for mb in "${sizes[@]}"; do
+        for op in PUT GET; do
+            before=$(cpu_ticks $server)
+            if [ $op = PUT ]; then
+                secs=$(curl -s -H "Expect:" -o /dev/null -w "%{time_total}" \
+                    -T "$work/src-$mb" "http://localhost:$port/obj$mb")
+            else
+                secs=$(curl -s -o /dev/null -w "%{time_total}" "http://localhost:$port/obj$mb")
+            fi
+            after=$(cpu_ticks $server)
+            awk -v n="$name" -v op=$op -v mb="$mb" -v s="$secs" -v t=$((after - before)) -v hz="$hz" \
+                'BEGIN { printf "%-9s %-4s %8d %10.3f %10.1f %10d\n", n, op, mb, s, mb / s, t * 1000 / hz }'
+        done
+        rm -f "$work/data-$zc/obj$mb"
+    done
+
+    kill $server
+    wait $server 2>/dev/null || true
+done
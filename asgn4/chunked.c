@@ -0,0 +1,132 @@
+#include <stdbool.h>
+
+#include "chunked.h"
+
+// Where the decoder is in the framing
+enum {
+    SIZE, // chunk-size hex digits
+    EXT, // chunk extensions, up to the CR that ends the size line
+    SIZE_LF,
+    DATA,
+    DATA_CR, // the CRLF that follows a chunk's data
+    DATA_LF,
+    TRAILER, // the start of a trailer line, or of the CRLF that ends the body
+    TRAILER_LINE,
+    TRAILER_LF,
+    END_LF
+};
+
+void chunked_init(chunked_decoder_t *d) {
+    d->state = SIZE;
+    d->status = CHUNKED_MORE;
+    d->size = 0;
+    d->total = 0;
+    d->digits = 0;
+    d->framing = 0;
+}
+
+// Function to get the value of a hex digit, or -1
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Function to step over one byte of framing; returns false if it is malformed
+static bool step(chunked_decoder_t *d, char c) {
+    switch (d->state) {
+    case SIZE: {
+        int v = hex_value(c);
+        if (v >= 0) {
+            // Sizes of 2^60 bytes or more are not worth telling from garbage
+            if (++d->digits > 15) {
+                return false;
+            }
+            d->size = d->size * 16 + (uint64_t) v;
+            return true;
+        }
+        if (d->digits == 0) {
+            return false;
+        }
+        if (c == '\r') {
+            d->state = SIZE_LF;
+            return true;
+        }
+        d->state = EXT;
+        return c == ';' || c == ' ' || c == '\t';
+    }
+    case EXT:
+        if (c == '\r') {
+            d->state = SIZE_LF;
+        }
+        return c != '\n';
+    case SIZE_LF:
+        d->state = d->size == 0 ? TRAILER : DATA;
+        return c == '\n';
+    case DATA_CR:
+        d->state = DATA_LF;
+        return c == '\r';
+    case DATA_LF:
+        d->state = SIZE;
+        d->digits = 0;
+        return c == '\n';
+    case TRAILER:
+        d->state = c == '\r' ? END_LF : TRAILER_LINE;
+        return c != '\n';
+    case TRAILER_LINE:
+        if (c == '\r') {
+            d->state = TRAILER_LF;
+        }
+        return c != '\n';
+    case TRAILER_LF:
+        d->state = TRAILER;
+        return c == '\n';
+    case END_LF:
+        d->status = CHUNKED_DONE;
+        return c == '\n';
+    }
+    return false;
+}
+
+size_t chunked_decode(
+    chunked_decoder_t *d, const char *buf, size_t len, const char **data, size_t *data_len) {
+    size_t i = 0;
+    *data = NULL;
+    *data_len = 0;
+    while (i < len && d->status == CHUNKED_MORE) {
+        if (d->state == DATA) {
+            // The data is left where it is; the caller takes it from buf
+            size_t n = len - i < d->size ? len - i : (size_t) d->size;
+            *data = buf + i;
+            *data_len = n;
+            chunked_skip_data(d, n);
+            return i + n;
+        }
+        if (!step(d, buf[i++]) || ++d->framing > CHUNKED_MAX_FRAMING) {
+            d->status = CHUNKED_ERROR;
+        }
+    }
+    return i;
+}
+
+chunked_status_t chunked_status(const chunked_decoder_t *d) {
+    return d->status;
+}
+
+uint64_t chunked_data_left(const chunked_decoder_t *d) {
+    return d->state == DATA ? d->size : 0;
+}
+
+void chunked_skip_data(chunked_decoder_t *d, uint64_t n) {
+    d->size -= n;
+    d->total += n;
+    d->framing = 0;
+    if (d->size == 0) {
+        d->state = DATA_CR;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @File chunked.h
+ *
+ * An incremental decoder for the chunked transfer coding (RFC 9112,
+ * section 7.1).  Like http_parser, it never copies: it walks the framing
+ * a byte at a time and hands back where the data of each chunk is in the
+ * caller's buffer, so the caller can write it out from there.
+ *
+ * Input may arrive in pieces, split anywhere, even inside a chunk-size
+ * line.  Chunk extensions and trailer fields are checked for framing and
+ * otherwise ignored.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHUNKED_MAX_FRAMING 4096 // longest run of framing (size line, trailers) accepted
+
+/** @brief What chunked_decode made of the body so far.
+ */
+typedef enum {
+    CHUNKED_MORE, /**< the body has not ended yet */
+    CHUNKED_DONE, /**< the last chunk and the trailers have been read */
+    CHUNKED_ERROR /**< the framing is malformed, or a size or framing run too long */
+} chunked_status_t;
+
+/** @brief The decoder's progress.
+ */
+typedef struct chunked_decoder {
+    int state;
+    chunked_status_t status;
+    uint64_t size; /**< bytes of the current chunk's data not yet decoded */
+    uint64_t total; /**< data bytes decoded so far */
+    size_t digits; /**< hex digits read of the current chunk-size */
+    size_t framing; /**< framing bytes read since the last data */
+} chunked_decoder_t;
+
+/** @brief Get a decoder ready for a new body.
+ */
+void chunked_init(chunked_decoder_t *d);
+
+/** @brief Decode from the start of buf[0..len) until a run of chunk data
+ *         has been found, the body ends, the framing turns out to be
+ *         malformed, or the buffer runs out.  The data found, if any, is
+ *         always the last thing consumed: *data points at it within buf,
+ *         and *data_len says how long it is (0 if there is none).
+ *
+ *  @return how many bytes of buf were consumed, framing and data.
+ */
+size_t chunked_decode(
+    chunked_decoder_t *d, const char *buf, size_t len, const char **data, size_t *data_len);
+
+/** @brief Get what the decoder made of the body so far.
+ */
+chunked_status_t chunked_status(const chunked_decoder_t *d);
+
+/** @brief Get how many bytes that come next are chunk data, so the caller
+ *         can move them without passing them through chunked_decode.
+ */
+uint64_t chunked_data_left(const chunked_decoder_t *d);
+
+/** @brief Account for n bytes of chunk data (at most chunked_data_left)
+ *         that the caller moved itself.
+ */
+void chunked_skip_data(chunked_decoder_t *d, uint64_t n);
@@ -0,0 +1,882 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "asgn2_helper_funcs.h"
+#include "chunked.h"
+#include "connection.h"
+#include "gzip.h"
+#include "http_parser.h"
+#include "metrics.h"
+
+#define CONN_BUFFER_SIZE 4096
+#define SPLICE_PIPE_SIZE (1 << 20)
+#define SEND_BUFFER_SIZE 16384
+#define MAX_CHUNK        (1 << 30)
+#define CONN_POOL_SIZE   256 // freed connections kept for the next accepts
+
+// Build with ZERO_COPY=0 to force the buffered read/write paths, for comparison
+#ifndef ZERO_COPY
+#define ZERO_COPY 1
+#endif
+
+struct Conn {
+    int fd;
+    const Request_t *request;
+    char *uri;
+    uint64_t content_length;
+    uint64_t body_left; // body bytes not yet read off the connection, UINT64_MAX if unknown
+    bool chunked; // the body is in the chunked transfer coding
+    bool close; // send "Connection: close" and don't reuse the connection
+    uint32_t served; // requests already answered on this connection
+    uint16_t status; // code of the response sent for the current request, 0 until then
+    uint64_t queued_at; // when the reactor handed the request to the workers (ns)
+    char validators[160]; // the ETag, Last-Modified and Vary header lines, or ""
+    bool gzip; // the object goes out gzip-compressed
+    bool parsed;
+    const Response_t *parse_res;
+    size_t len; // bytes in buf
+    http_parser_t parser; // its offsets point into buf
+    size_t head; // length of the request head, or 0 until the parser is done with it
+    size_t pos; // first body byte not yet consumed
+    char buf[CONN_BUFFER_SIZE + 1];
+    conn_t *next_free; // in the pool
+};
+
+// Connections freed by workers, handed out again by conn_new instead of going back to malloc
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static conn_t *pool;
+static int pooled;
+
+conn_t *conn_new(int connfd) {
+    pthread_mutex_lock(&pool_mutex);
+    conn_t *conn = pool;
+    if (conn != NULL) {
+        pool = conn->next_free;
+        pooled--;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    if (conn == NULL) {
+        conn = malloc(sizeof(conn_t));
+        if (conn == NULL) {
+            return NULL;
+        }
+    }
+    conn->fd = connfd;
+    conn->request = NULL;
+    conn->uri = NULL;
+    conn->content_length = 0;
+    conn->body_left = 0;
+    conn->chunked = false;
+    conn->close = false;
+    conn->served = 0;
+    conn->status = 0;
+    conn->queued_at = 0;
+    conn->validators[0] = '\0';
+    conn->gzip = false;
+    conn->parsed = false;
+    conn->parse_res = NULL;
+    conn->len = 0;
+    conn->head = 0;
+    conn->pos = 0;
+    http_parser_init(&conn->parser);
+    return conn;
+}
+
+void conn_delete(conn_t **conn) {
+    if (conn == NULL || *conn == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool_mutex);
+    if (pooled < CONN_POOL_SIZE) {
+        (*conn)->next_free = pool;
+        pool = *conn;
+        pooled++;
+        *conn = NULL;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+    free(*conn);
+    *conn = NULL;
+}
+
+int conn_get_fd(conn_t *conn) {
+    return conn->fd;
+}
+
+// Function to parse whatever has arrived of the request head since the last call
+static void scan_head(conn_t *conn) {
+    if (http_parse(&conn->parser, conn->buf, conn->len) != HTTP_PARSE_INCOMPLETE) {
+        conn->head = conn->parser.head;
+    }
+}
+
+// Function to NUL-terminate the fields of a parsed head in place and check what they say
+static const Response_t *parse_head(conn_t *conn) {
+    http_parser_t *p = &conn->parser;
+    char *text = conn->buf;
+    char *method = text + p->method;
+    char *version = text + p->version;
+    conn->uri = text + p->uri;
+    method[p->method_len] = '\0';
+    conn->uri[p->uri_len] = '\0';
+    version[VERSION_LENGTH] = '\0';
+    for (int i = 0; i < p->nheaders; i++) {
+        text[p->headers[i].key + p->headers[i].key_len] = '\0';
+        text[p->headers[i].value + p->headers[i].value_len] = '\0';
+    }
+    conn->pos = conn->head;
+
+    if (strcmp(version, HTTP_VERSION_REGEX) != 0) {
+        return &RESPONSE_VERSION_NOT_SUPPORTED;
+    }
+
+    conn->request = &REQUEST_UNSUPPORTED;
+    for (int i = 0; i < NUM_REQUESTS - 1; i++) {
+        if (strcmp(method, request_get_str(requests[i])) == 0) {
+            conn->request = requests[i];
+        }
+    }
+
+    char *coding = conn_get_header(conn, "Transfer-Encoding");
+    char *length = conn_get_header(conn, "Content-Length");
+    if (coding != NULL) {
+        // A body framed both ways is an attempt at smuggling (RFC 9112, section 6.1), and
+        // chunked is the only coding we can undo
+        if (length != NULL) {
+            return &RESPONSE_BAD_REQUEST;
+        }
+        if (strcasecmp(coding, "chunked") != 0) {
+            return &RESPONSE_NOT_IMPLEMENTED;
+        }
+        conn->chunked = true;
+        conn->body_left = UINT64_MAX;
+    } else if (length != NULL) {
+        char *end = NULL;
+        errno = 0;
+        conn->content_length = strtoull(length, &end, 10);
+        if (*length < '0' || *length > '9' || *end != '\0' || errno != 0) {
+            return &RESPONSE_BAD_REQUEST;
+        }
+        conn->body_left = conn->content_length;
+    } else if (conn->request == &REQUEST_PUT) {
+        return &RESPONSE_BAD_REQUEST;
+    }
+    return NULL;
+}
+
+// Function to parse the buffered head, once
+static const Response_t *finish_parse(conn_t *conn) {
+    if (!conn->parsed) {
+        conn->parsed = true;
+        if (conn->parser.status == HTTP_PARSE_DONE) {
+            conn->parse_res = parse_head(conn);
+        } else {
+            // Whatever headers were recorded are neither terminated nor to be trusted
+            conn->parse_res = &RESPONSE_BAD_REQUEST;
+            conn->parser.nheaders = 0;
+        }
+
+        // After a malformed request we can't tell where the next one would start
+        char *connection = conn_get_header(conn, "Connection");
+        if (conn->parse_res != NULL
+            || (connection != NULL && strcasecmp(connection, "close") == 0)) {
+            conn->close = true;
+        }
+    }
+    return conn->parse_res;
+}
+
+// Function to read once from the socket into the receive buffer
+static ssize_t fill_once(conn_t *conn) {
+    ssize_t n;
+    do {
+        n = read(conn->fd, conn->buf + conn->len, CONN_BUFFER_SIZE - conn->len);
+    } while (n < 0 && errno == EINTR);
+    if (n > 0) {
+        conn->len += (size_t) n;
+        metrics_count_bytes((uint64_t) n, 0);
+    }
+    return n;
+}
+
+// Function to check whether all of a chunked body is in the receive buffer
+static bool chunked_buffered(conn_t *conn) {
+    chunked_decoder_t d;
+    chunked_init(&d);
+    const char *data;
+    size_t data_len;
+    for (size_t at = conn->pos; at < conn->len && chunked_status(&d) == CHUNKED_MORE;) {
+        at += chunked_decode(&d, conn->buf + at, conn->len - at, &data, &data_len);
+    }
+    return chunked_status(&d) != CHUNKED_MORE;
+}
+
+// Function to decide what to do with the bytes buffered so far, without reading more
+static conn_status_t check_buffered(conn_t *conn) {
+    if (!conn->parsed) {
+        scan_head(conn);
+        if (conn->parser.status == HTTP_PARSE_INCOMPLETE) {
+            return CONN_PENDING;
+        }
+        if (finish_parse(conn) != NULL) {
+            return CONN_READY;
+        }
+    }
+
+    // Small PUT bodies are buffered here so that the worker never waits on the client.  A
+    // chunked one is small if its last chunk has arrived before the buffer filled up.
+    if (conn->request == &REQUEST_PUT && conn->chunked) {
+        return conn->len < CONN_BUFFER_SIZE && !chunked_buffered(conn) ? CONN_PENDING : CONN_READY;
+    }
+    if (conn->request == &REQUEST_PUT && conn->content_length <= CONN_BUFFER_SIZE - conn->head
+        && conn->len - conn->head < conn->content_length) {
+        return CONN_PENDING;
+    }
+    return CONN_READY;
+}
+
+conn_status_t conn_fill(conn_t *conn) {
+    while (conn->len < CONN_BUFFER_SIZE) {
+        ssize_t n = fill_once(conn);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (n <= 0) {
+            // A peer that hangs up mid-request still gets its 400
+            if (conn->len == 0 || conn->parsed) {
+                return CONN_CLOSED;
+            }
+            finish_parse(conn);
+            return CONN_READY;
+        }
+    }
+    return check_buffered(conn);
+}
+
+conn_status_t conn_next(conn_t *conn) {
+    // Pipelined bytes that followed the last request become the start of the next one
+    memmove(conn->buf, conn->buf + conn->pos, conn->len - conn->pos);
+    conn->len -= conn->pos;
+    conn->pos = 0;
+    conn->head = 0;
+    http_parser_init(&conn->parser);
+    conn->request = NULL;
+    conn->uri = NULL;
+    conn->content_length = 0;
+    conn->body_left = 0;
+    conn->chunked = false;
+    conn->parsed = false;
+    conn->parse_res = NULL;
+    conn->status = 0;
+    conn->validators[0] = '\0';
+    conn->gzip = false;
+    conn->served++;
+    if (conn->len == 0) {
+        return CONN_PENDING;
+    }
+    return check_buffered(conn);
+}
+
+bool conn_keep_alive(conn_t *conn) {
+    return !conn->close;
+}
+
+void conn_set_close(conn_t *conn) {
+    conn->close = true;
+}
+
+uint32_t conn_get_served(conn_t *conn) {
+    return conn->served;
+}
+
+uint16_t conn_get_status(conn_t *conn) {
+    return conn->status;
+}
+
+void conn_set_queued_at(conn_t *conn, uint64_t ns) {
+    conn->queued_at = ns;
+}
+
+uint64_t conn_get_queued_at(conn_t *conn) {
+    return conn->queued_at;
+}
+
+// Whether an object is sent compressed depends on the request's Accept-Encoding, so caches
+// have to key on it too
+void conn_set_validator(conn_t *conn, const validator_t *validator) {
+    snprintf(conn->validators, sizeof(conn->validators),
+        "ETag: %s\r\nLast-Modified: %s\r\nVary: Accept-Encoding\r\n", validator->etag,
+        validator->last_modified);
+}
+
+void conn_set_gzip(conn_t *conn) {
+    conn->gzip = true;
+}
+
+// Function to skip an unread request body so the connection can be reused, if it is all here
+static void discard_body(conn_t *conn) {
+    if (conn->body_left > 0 && conn->len - conn->pos >= conn->body_left) {
+        conn->pos += conn->body_left;
+        conn->body_left = 0;
+    }
+    if (conn->body_left > 0) {
+        conn->close = true;
+    }
+}
+
+const Response_t *conn_parse(conn_t *conn) {
+    if (!conn->parsed) {
+        scan_head(conn);
+    }
+    while (!conn->parsed && conn->parser.status == HTTP_PARSE_INCOMPLETE && fill_once(conn) > 0) {
+        scan_head(conn);
+    }
+    return finish_parse(conn);
+}
+
+const Request_t *conn_get_request(conn_t *conn) {
+    return conn->request;
+}
+
+const char *conn_get_method(conn_t *conn) {
+    if (conn->request == NULL || conn->request == &REQUEST_UNSUPPORTED) {
+        return NULL;
+    }
+    return request_get_str(conn->request);
+}
+
+char *conn_get_uri(conn_t *conn) {
+    return conn->uri;
+}
+
+char *conn_get_header(conn_t *conn, char *header) {
+    for (int i = 0; i < conn->parser.nheaders; i++) {
+        if (strcasecmp(conn->buf + conn->parser.headers[i].key, header) == 0) {
+            return conn->buf + conn->parser.headers[i].value;
+        }
+    }
+    return NULL;
+}
+
+// Function to check whether fd is a regular file, which sendfile and splice need
+static bool is_regular(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// Function to send count bytes of fd from offset on: a regular file without copying them
+// through user space, anything else with pread.  The descriptor's own offset is left alone,
+// so several ranges can be sent from one descriptor.
+static ssize_t send_file_range(int sock, int fd, bool regular, uint64_t offset, uint64_t count) {
+    uint64_t sent = 0;
+    char buf[SEND_BUFFER_SIZE];
+    while (sent < count) {
+        ssize_t n;
+        if (ZERO_COPY && regular) {
+            off_t off = (off_t) (offset + sent);
+            n = sendfile(sock, fd, &off, count - sent < MAX_CHUNK ? count - sent : MAX_CHUNK);
+        } else {
+            size_t chunk = count - sent < sizeof(buf) ? count - sent : sizeof(buf);
+            n = pread(fd, buf, chunk, (off_t) (offset + sent));
+            if (n > 0 && write_n_bytes(sock, buf, (size_t) n) != n) {
+                return -1;
+            }
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return n < 0 ? -1 : (ssize_t) sent;
+        }
+        sent += (uint64_t) n;
+    }
+    return (ssize_t) sent;
+}
+
+// Each worker keeps one pipe for splicing; it is thrown away if a transfer fails midway
+static _Thread_local int splice_pipe[2] = { -1, -1 };
+
+static void drop_splice_pipe(void) {
+    close(splice_pipe[0]);
+    close(splice_pipe[1]);
+    splice_pipe[0] = splice_pipe[1] = -1;
+}
+
+// Function to move count bytes from a socket to a file through a pipe, socket -> pipe -> file
+static ssize_t splice_n_bytes(int sock, int fd, uint64_t count) {
+    if (splice_pipe[0] < 0) {
+        if (pipe2(splice_pipe, O_CLOEXEC) < 0) {
+            return -1;
+        }
+        fcntl(splice_pipe[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    }
+    uint64_t moved = 0;
+    while (moved < count) {
+        size_t chunk = count - moved < MAX_CHUNK ? count - moved : MAX_CHUNK;
+        ssize_t in = splice(sock, NULL, splice_pipe[1], NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (in < 0 && errno == EINTR) {
+            continue;
+        }
+        if (in <= 0) {
+            return in < 0 ? -1 : (ssize_t) moved;
+        }
+        while (in > 0) {
+            ssize_t out = splice(splice_pipe[0], NULL, fd, NULL, in, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (out < 0 && errno == EINTR) {
+                continue;
+            }
+            if (out <= 0) {
+                drop_splice_pipe();
+                return -1;
+            }
+            in -= out;
+            moved += (uint64_t) out;
+        }
+    }
+    return (ssize_t) moved;
+}
+
+// Function to decode a chunked request body into fd, for conn_recv_file.  Chunk data is written
+// out of the receive buffer where it landed; once the buffer is drained, a large chunk's data is
+// spliced straight from the socket instead, so only the framing around it passes through buf.
+static const Response_t *recv_chunked(conn_t *conn, int fd) {
+    chunked_decoder_t d;
+    chunked_init(&d);
+    bool regular = ZERO_COPY && is_regular(fd);
+    while (chunked_status(&d) == CHUNKED_MORE) {
+        if (conn->pos == conn->len) {
+            // Everything after the head has been consumed, so the space can be reused; the
+            // head itself holds the URI and headers, which the caller still needs
+            conn->pos = conn->len = conn->head;
+            uint64_t left = chunked_data_left(&d);
+            bool splicing = regular && left >= CONN_BUFFER_SIZE;
+            ssize_t n = splicing ? splice_n_bytes(conn->fd, fd, left) : fill_once(conn);
+            if (n <= 0) {
+                conn->close = true;
+                return &RESPONSE_INTERNAL_SERVER_ERROR;
+            }
+            if (splicing) {
+                metrics_count_bytes((uint64_t) n, 0);
+                chunked_skip_data(&d, (uint64_t) n);
+                continue;
+            }
+        }
+        const char *data;
+        size_t data_len;
+        conn->pos += chunked_decode(&d, conn->buf + conn->pos, conn->len - conn->pos, &data,
+            &data_len);
+        if (data_len > 0 && write_n_bytes(fd, (char *) data, data_len) != (ssize_t) data_len) {
+            conn->close = true;
+            return &RESPONSE_INTERNAL_SERVER_ERROR;
+        }
+    }
+    if (chunked_status(&d) == CHUNKED_ERROR) {
+        // There is no telling where the next request would start
+        conn->close = true;
+        return &RESPONSE_BAD_REQUEST;
+    }
+    conn->body_left = 0;
+    return NULL;
+}
+
+// Function to move the request body into fd, for conn_recv_file
+static const Response_t *recv_file(conn_t *conn, int fd) {
+    if (conn->chunked) {
+        return recv_chunked(conn, fd);
+    }
+    uint64_t remaining = conn->content_length;
+
+    // Part (or all) of the body may have arrived along with the head
+    size_t buffered = conn->len - conn->pos;
+    if (buffered > remaining) {
+        buffered = remaining;
+    }
+    if (buffered > 0) {
+        if (write_n_bytes(fd, conn->buf + conn->pos, buffered) != (ssize_t) buffered) {
+            return &RESPONSE_INTERNAL_SERVER_ERROR;
+        }
+        conn->pos += buffered;
+        conn->body_left -= buffered;
+        remaining -= buffered;
+    }
+    if (remaining > 0) {
+        ssize_t passed = ZERO_COPY && is_regular(fd) ? splice_n_bytes(conn->fd, fd, remaining)
+                                                     : pass_n_bytes(conn->fd, fd, remaining);
+        if (passed > 0) {
+            conn->body_left -= (uint64_t) passed;
+            metrics_count_bytes((uint64_t) passed, 0);
+        }
+        if (passed != (ssize_t) remaining) {
+            conn->close = true;
+            return &RESPONSE_INTERNAL_SERVER_ERROR;
+        }
+    }
+    return NULL;
+}
+
+uint64_t conn_get_content_length(conn_t *conn) {
+    return conn->chunked ? UINT64_MAX : conn->content_length;
+}
+
+const Response_t *conn_recv_file(conn_t *conn, int fd) {
+    uint64_t start = metrics_now();
+    const Response_t *res = recv_file(conn, fd);
+    metrics_observe(PHASE_RECV, metrics_now() - start);
+    return res;
+}
+
+// Function to account for a response once it is written (or failed to be)
+static void sent(conn_t *conn, uint16_t code, uint64_t start, uint64_t bytes) {
+    conn->status = code;
+    metrics_count_bytes(0, bytes);
+    metrics_observe(PHASE_SEND, metrics_now() - start);
+}
+
+// Function to write all of an iovec array, resuming after partial writes
+static bool writev_all(int fd, struct iovec *iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return false;
+        }
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= (ssize_t) iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= (size_t) n;
+        }
+    }
+    return true;
+}
+
+// Where an object's body comes from: data if it is in memory, otherwise fd
+typedef struct body {
+    int fd;
+    bool regular;
+    const char *data;
+} body_t;
+
+// Function to write a head (or a multipart part's head) and then count bytes of the body from
+// offset on, returning how many bytes went out, or -1
+static ssize_t write_part(
+    conn_t *conn, const char *head, size_t head_len, const body_t *body, uint64_t offset,
+    uint64_t count) {
+    if (body->data != NULL || count == 0) {
+        const char *data = body->data != NULL ? body->data + offset : NULL;
+        struct iovec iov[2] = { { (void *) head, head_len }, { (void *) data, count } };
+        return writev_all(conn->fd, iov, count > 0 ? 2 : 1) ? (ssize_t) (head_len + count) : -1;
+    }
+    if (write_n_bytes(conn->fd, (char *) head, head_len) != (ssize_t) head_len) {
+        return -1;
+    }
+    ssize_t n = send_file_range(conn->fd, body->fd, body->regular, offset, count);
+    return n == (ssize_t) count ? (ssize_t) (head_len + count) : -1;
+}
+
+// What precedes each range in a multipart/byteranges body
+#define PART_HEAD "\r\n--%s\r\nContent-Range: bytes %lu-%lu/%lu\r\n\r\n"
+
+// Function to send the ranges of a multipart/byteranges response, after its head
+static ssize_t write_multipart(conn_t *conn, const char *head, size_t head_len,
+    const char *boundary, const body_t *body, uint64_t size, const byte_range_t *ranges, int n) {
+    ssize_t total = write_part(conn, head, head_len, body, 0, 0);
+    char part[128];
+    for (int i = 0; i < n && total >= 0; i++) {
+        int len = snprintf(
+            part, sizeof(part), PART_HEAD, boundary, ranges[i].first, ranges[i].last, size);
+        ssize_t w = write_part(
+            conn, part, (size_t) len, body, ranges[i].first, ranges[i].last - ranges[i].first + 1);
+        total = w < 0 ? -1 : total + w;
+    }
+    if (total >= 0) {
+        int len = snprintf(part, sizeof(part), "\r\n--%s--\r\n", boundary);
+        ssize_t w = write_part(conn, part, (size_t) len, body, 0, 0);
+        total = w < 0 ? -1 : total + w;
+    }
+    return total;
+}
+
+// Function to send a chunk of n bytes (the last chunk if n is 0), preceded by the head if
+// *head_len isn't 0 yet, and to add the bytes that went out to *total
+static bool write_chunk(conn_t *conn, const char *head, size_t *head_len, const char *data,
+    size_t n, uint64_t *total) {
+    char size[24];
+    int len = snprintf(size, sizeof(size), n > 0 ? "%zx\r\n" : "0\r\n\r\n", n);
+    struct iovec iov[4] = { { (void *) head, *head_len }, { size, (size_t) len },
+        { (void *) data, n }, { "\r\n", 2 } };
+    if (!writev_all(conn->fd, iov, n > 0 ? 4 : 2)) {
+        return false;
+    }
+    *total += *head_len + (uint64_t) len + (n > 0 ? (uint64_t) n + 2 : 0);
+    *head_len = 0;
+    return true;
+}
+
+// Function to read a body that is read until end of file.  A FIFO is opened without blocking, so
+// that opening it doesn't wait for a producer while the URI is locked; until one has opened it,
+// reading it would return end of file, so wait for it (or its data) first.  The wait gives up,
+// returning -1, if the client hangs up or nothing comes for as long as the socket's receive
+// timeout (the idle timeout), so that a producer that never shows up can't keep the worker.
+static ssize_t read_stream(conn_t *conn, int fd, char *buf, size_t len) {
+    struct timeval tv = { 0, 0 };
+    socklen_t tv_len = sizeof(tv);
+    int timeout_ms = -1;
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, &tv_len) == 0
+        && (tv.tv_sec > 0 || tv.tv_usec > 0)) {
+        timeout_ms = (int) (tv.tv_sec * 1000 + tv.tv_usec / 1000);
+    }
+    for (;;) {
+        struct pollfd p[2] = { { fd, POLLIN, 0 }, { conn->fd, POLLRDHUP, 0 } };
+        int n = poll(p, 2, timeout_ms);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || (p[1].revents & (POLLRDHUP | POLLHUP | POLLERR)) != 0) {
+            return -1;
+        }
+        ssize_t r = read(fd, buf, len);
+        if (r >= 0 || (errno != EINTR && errno != EAGAIN)) {
+            return r;
+        }
+    }
+}
+
+// Function to send a head and then fd, read until end of file, as a chunked body; for objects
+// whose length isn't known when the head goes out.  Returns how many bytes went out, or -1.
+static ssize_t write_chunked(conn_t *conn, const char *head, size_t head_len, int fd) {
+    char buf[SEND_BUFFER_SIZE];
+    uint64_t total = 0;
+    for (;;) {
+        ssize_t n = read_stream(conn, fd, buf, sizeof(buf));
+        if (n < 0) {
+            // Without the last chunk, the client can tell the body was cut short
+            return -1;
+        }
+
+        // The head goes out with the first chunk, and the last chunk is empty
+        if (!write_chunk(conn, head, &head_len, buf, (size_t) n, &total)) {
+            return -1;
+        }
+        if (n == 0) {
+            return (ssize_t) total;
+        }
+    }
+}
+
+// Function to send a head and then a body compressed while it goes out, as a chunked body: the
+// size bytes of data if there is any, or else fd read until end of file.  Returns how many
+// bytes went out, or -1.
+static ssize_t write_gzip(
+    conn_t *conn, const char *head, size_t head_len, const body_t *body, uint64_t size) {
+    z_stream *z = gzip_stream(GZIP_STREAM_LEVEL);
+    if (z == NULL) {
+        return -1;
+    }
+    char in[SEND_BUFFER_SIZE];
+    char out[SEND_BUFFER_SIZE];
+    uint64_t total = 0;
+    int flush = Z_NO_FLUSH;
+    if (body->data != NULL) {
+        z->next_in = (Bytef *) body->data;
+        z->avail_in = (uInt) size;
+        flush = Z_FINISH;
+    }
+    for (;;) {
+        if (z->avail_in == 0 && flush != Z_FINISH) {
+            ssize_t n = read(body->fd, in, sizeof(in));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return -1;
+            }
+            z->next_in = (Bytef *) in;
+            z->avail_in = (uInt) n;
+            flush = n == 0 ? Z_FINISH : Z_NO_FLUSH;
+        }
+        z->next_out = (Bytef *) out;
+        z->avail_out = sizeof(out);
+        int rc = deflate(z, flush);
+        if (rc == Z_STREAM_ERROR) {
+            return -1;
+        }
+        size_t n = sizeof(out) - z->avail_out;
+        if (n > 0 && !write_chunk(conn, head, &head_len, out, n, &total)) {
+            return -1;
+        }
+        if (rc == Z_STREAM_END) {
+            break;
+        }
+    }
+    return write_chunk(conn, head, &head_len, NULL, 0, &total) ? (ssize_t) total : -1;
+}
+
+const Response_t *conn_send_object(conn_t *conn, int fd, const char *data, uint64_t size,
+    const byte_range_t *ranges, int n) {
+    char head[384];
+    uint64_t start = metrics_now();
+    bool head_only = conn->request == &REQUEST_HEAD;
+    body_t body = { fd, data == NULL && is_regular(fd), data };
+    discard_body(conn);
+    const char *closing = conn->close ? "Connection: close\r\n" : "";
+    if (n == 0) {
+        const char *reason = response_get_message(&RESPONSE_RANGE_NOT_SATISFIABLE);
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 416 %s\r\nContent-Range: bytes */%lu\r\nContent-Length: %zu\r\n%s\r\n%s\n",
+            reason, size, strlen(reason) + 1, closing, reason);
+        if (head_only) {
+            len -= (int) strlen(reason) + 1;
+        }
+        ssize_t w = write_part(conn, head, (size_t) len, &body, 0, 0);
+        sent(conn, 416, start, w > 0 ? (uint64_t) w : 0);
+        if (w < 0) {
+            conn->close = true;
+            return &RESPONSE_INTERNAL_SERVER_ERROR;
+        }
+        return NULL;
+    }
+
+    ssize_t w;
+    uint16_t code = n < 0 ? 200 : 206;
+    if (n < 0 && conn->gzip) {
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n%s%s\r\n",
+            conn->validators, closing);
+        w = head_only ? write_part(conn, head, (size_t) len, &body, 0, 0)
+                      : write_gzip(conn, head, (size_t) len, &body, size);
+    } else if (n < 0 && data == NULL && !body.regular) {
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n%s\r\n", closing);
+        w = head_only ? write_part(conn, head, (size_t) len, &body, 0, 0)
+                      : write_chunked(conn, head, (size_t) len, fd);
+    } else if (n < 0) {
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 200 OK\r\nContent-Length: %lu\r\nAccept-Ranges: bytes\r\n%s%s\r\n", size,
+            conn->validators, closing);
+        w = write_part(conn, head, (size_t) len, &body, 0, head_only ? 0 : size);
+    } else if (n == 1) {
+        uint64_t count = ranges[0].last - ranges[0].first + 1;
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %lu-%lu/%lu\r\n"
+            "Content-Length: %lu\r\n%s%s\r\n",
+            ranges[0].first, ranges[0].last, size, count, conn->validators, closing);
+        w = write_part(conn, head, (size_t) len, &body, ranges[0].first, head_only ? 0 : count);
+    } else {
+        // The body's length is known up front: every part's head, its bytes, and the closing
+        // delimiter.  No object byte can be confused with a delimiter, as parts have lengths.
+        char boundary[24];
+        snprintf(boundary, sizeof(boundary), "%016lx", metrics_now());
+        uint64_t length = strlen(boundary) + 8;
+        for (int i = 0; i < n; i++) {
+            int part
+                = snprintf(NULL, 0, PART_HEAD, boundary, ranges[i].first, ranges[i].last, size);
+            length += (uint64_t) part + ranges[i].last - ranges[i].first + 1;
+        }
+        int len = snprintf(head, sizeof(head),
+            "HTTP/1.1 206 Partial Content\r\nContent-Type: multipart/byteranges; boundary=%s\r\n"
+            "Content-Length: %lu\r\n%s%s\r\n",
+            boundary, length, conn->validators, closing);
+        w = head_only ? write_part(conn, head, (size_t) len, &body, 0, 0)
+                      : write_multipart(conn, head, (size_t) len, boundary, &body, size, ranges, n);
+    }
+    sent(conn, code, start, w > 0 ? (uint64_t) w : 0);
+    if (w < 0) {
+        conn->close = true;
+        return &RESPONSE_INTERNAL_SERVER_ERROR;
+    }
+    return NULL;
+}
+
+const Response_t *conn_send_data(conn_t *conn, const char *data, uint64_t count) {
+    char head[128];
+    uint64_t start = metrics_now();
+    discard_body(conn);
+    int len = snprintf(head, sizeof(head), "HTTP/1.1 %d %s\r\nContent-Length: %lu\r\n%s\r\n",
+        response_get_code(&RESPONSE_OK), response_get_message(&RESPONSE_OK), count,
+        conn->close ? "Connection: close\r\n" : "");
+    struct iovec iov[2] = { { head, (size_t) len }, { (void *) data, count } };
+    bool ok = writev_all(conn->fd, iov, conn->request == &REQUEST_HEAD ? 1 : 2);
+    sent(conn, 200, start, ok ? (uint64_t) len + count : 0);
+    if (!ok) {
+        conn->close = true;
+        return &RESPONSE_INTERNAL_SERVER_ERROR;
+    }
+    return NULL;
+}
+
+const Response_t *conn_send_gzip(conn_t *conn, const char *data, uint64_t count) {
+    char head[384];
+    uint64_t start = metrics_now();
+    discard_body(conn);
+    int len = snprintf(head, sizeof(head),
+        "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %lu\r\n%s%s\r\n", count,
+        conn->validators, conn->close ? "Connection: close\r\n" : "");
+    struct iovec iov[2] = { { head, (size_t) len }, { (void *) data, count } };
+    bool ok = writev_all(conn->fd, iov, conn->request == &REQUEST_HEAD ? 1 : 2);
+    sent(conn, 200, start, ok ? (uint64_t) len + count : 0);
+    if (!ok) {
+        conn->close = true;
+        return &RESPONSE_INTERNAL_SERVER_ERROR;
+    }
+    return NULL;
+}
+
+const Response_t *conn_send_response(conn_t *conn, const Response_t *res) {
+    char msg[256];
+    uint64_t start = metrics_now();
+    const char *reason = response_get_message(res);
+    discard_body(conn);
+    const char *closing = conn->close ? "Connection: close\r\n" : "";
+    int len;
+    if (res == &RESPONSE_NOT_MODIFIED) {
+        len = snprintf(msg, sizeof(msg), "HTTP/1.1 304 %s\r\n%s%s\r\n", reason, conn->validators,
+            closing);
+    } else {
+        const char *retry = res == &RESPONSE_SERVICE_UNAVAILABLE ? "Retry-After: 1\r\n" : "";
+        len = snprintf(msg, sizeof(msg), "HTTP/1.1 %d %s\r\nContent-Length: %lu\r\n%s%s\r\n%s\n",
+            response_get_code(res), reason, strlen(reason) + 1, retry, closing, reason);
+
+        // A response to HEAD says how long its body would be, but leaves it out
+        if (conn->request == &REQUEST_HEAD) {
+            len -= (int) strlen(reason) + 1;
+        }
+    }
+    bool ok = write_n_bytes(conn->fd, msg, len) == len;
+    sent(conn, response_get_code(res), start, ok ? (uint64_t) len : 0);
+    if (!ok) {
+        conn->close = true;
+        return &RESPONSE_INTERNAL_SERVER_ERROR;
+    }
+    return NULL;
+}
+
+char *conn_str(conn_t *conn) {
+    static _Thread_local char str[512];
+    char *length = conn_get_header(conn, "Content-Length");
+    char *id = conn_get_header(conn, "Request-Id");
+    snprintf(str, sizeof(str),
+        "Conn {\n   type: %s,\n    uri: %s,\n   heads: [\n       cl: %s\n       rid: %s\n"
+        "          ]\n}",
+        conn->request ? request_get_str(conn->request) : "(none)", conn->uri ? conn->uri : "",
+        length ? length : "(none)", id ? id : "(none)");
+    return str;
+}
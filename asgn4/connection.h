@@ -0,0 +1,195 @@
+/**
+ * @File connection.h
+ *
+ * A client connection and the HTTP request being read from it.  The
+ * request head can be read either all at once (conn_parse blocks until it
+ * has arrived) or incrementally from a non-blocking socket (conn_fill),
+ * which is how the reactor front end feeds requests to the workers.
+ *
+ * Connections are persistent (HTTP/1.1 keep-alive): after a response,
+ * conn_next moves any pipelined bytes to the front of the buffer and
+ * starts on the next request.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "range.h"
+#include "request.h"
+#include "response.h"
+#include "validator.h"
+
+/** @struct conn_t
+ *
+ *  @brief A connection with its receive buffer and parsed request.
+ */
+typedef struct Conn conn_t;
+
+/** @brief The outcome of a conn_fill call.
+ */
+typedef enum {
+    CONN_PENDING, /**< more bytes are needed before the request can run */
+    CONN_READY, /**< the request is parsed and can be handed to a worker */
+    CONN_CLOSED /**< the peer went away or the socket failed */
+} conn_status_t;
+
+/** @brief Allocates a connection for an accepted socket, reusing one that
+ *         was deleted earlier if there is one.  The caller still owns
+ *         connfd and must close it.
+ */
+conn_t *conn_new(int connfd);
+
+/** @brief Free a connection (but not its socket), keeping it for the
+ *         next conn_new if the pool has room; *conn is set to NULL.
+ */
+void conn_delete(conn_t **conn);
+
+/** @brief Get the socket that a connection reads from and writes to.
+ */
+int conn_get_fd(conn_t *conn);
+
+/** @brief Read whatever the (non-blocking) socket has available and parse
+ *         the request head once it is complete.  A PUT whose body fits in
+ *         the receive buffer stays pending until the whole body arrived;
+ *         larger bodies are left for the worker to stream.
+ *
+ *  @return CONN_PENDING, CONN_READY or CONN_CLOSED.
+ */
+conn_status_t conn_fill(conn_t *conn);
+
+/** @brief Get ready for the next request on a kept-alive connection.
+ *         Bytes that followed the current request (pipelining) are kept.
+ *
+ *  @return CONN_READY if the next request is already fully buffered,
+ *          otherwise CONN_PENDING.
+ */
+conn_status_t conn_next(conn_t *conn);
+
+/** @brief Whether the connection may be reused once the current
+ *         response is sent.  A request that was malformed, asked for
+ *         "Connection: close", or left its body unread is the last one.
+ */
+bool conn_keep_alive(conn_t *conn);
+
+/** @brief Make the current response the last one on this connection.
+ *         Must be called before the response is sent.
+ */
+void conn_set_close(conn_t *conn);
+
+/** @brief Get the number of requests already answered on a connection.
+ */
+uint32_t conn_get_served(conn_t *conn);
+
+/** @brief Get the status code of the response sent for the current
+ *         request, or 0 if none was sent yet.
+ */
+uint16_t conn_get_status(conn_t *conn);
+
+/** @brief Stamp the time (metrics_now) at which the current request was
+ *         queued for the workers, so its queue wait can be measured.
+ */
+void conn_set_queued_at(conn_t *conn, uint64_t ns);
+
+/** @brief Get the time the current request was queued, or 0.
+ */
+uint64_t conn_get_queued_at(conn_t *conn);
+
+/** @brief Send the ETag and Last-Modified of the object being sent with
+ *         the current response (a 200, 206 or 304), and that it varies
+ *         with Accept-Encoding.
+ */
+void conn_set_validator(conn_t *conn, const validator_t *validator);
+
+/** @brief Send the object of the current response (a 200, without
+ *         ranges) gzip-compressed: conn_send_object compresses it as it
+ *         goes out.  conn_send_gzip sends a body that was compressed
+ *         beforehand instead.
+ */
+void conn_set_gzip(conn_t *conn);
+
+/** @brief Parse the request head, blocking for the rest of it if
+ *         conn_fill has not already buffered it.
+ *
+ *  @return NULL if the request is valid, otherwise the error response
+ *          that should be sent back to the client.
+ */
+const Response_t *conn_parse(conn_t *conn);
+
+/** @brief Get the method of a parsed request.
+ */
+const Request_t *conn_get_request(conn_t *conn);
+
+/** @brief Get the method name of a parsed request, for counting it, or
+ *         NULL if there is none or the server doesn't support it.
+ */
+const char *conn_get_method(conn_t *conn);
+
+/** @brief Get the URI of a parsed request, without its leading '/'.
+ */
+char *conn_get_uri(conn_t *conn);
+
+/** @brief Look up a request header by (case-insensitive) name.
+ *
+ *  @return the header's value, or NULL if the request did not send it.
+ */
+char *conn_get_header(conn_t *conn, char *header);
+
+/** @brief Get the Content-Length of a request's body, 0 if it has none,
+ *         or UINT64_MAX if it is chunked and its length is unknown.
+ */
+uint64_t conn_get_content_length(conn_t *conn);
+
+/** @brief Write the request's body to fd: its Content-Length bytes or,
+ *         if it came with "Transfer-Encoding: chunked", its decoded data.
+ *
+ *  @return NULL on success, otherwise the error response to send (400
+ *          if the chunked framing is malformed).
+ */
+const Response_t *conn_recv_file(conn_t *conn, int fd);
+
+/** @brief Send an object of size bytes, from memory (data) or, if data is
+ *         NULL, from fd at offset 0: all of it (200) if n < 0, a 416 if
+ *         n is 0, or else the n ranges (206, as multipart/byteranges if
+ *         there is more than one).  A HEAD request gets the same head and
+ *         no body.  If fd is not a regular file (a FIFO a producer is still
+ *         writing to, say), size is meaningless: n must be negative, and
+ *         fd is read until end of file and sent as a chunked body.  After
+ *         conn_set_gzip, the body is compressed and sent chunked too.
+ *
+ *  @return NULL on success, otherwise the error response to send.
+ */
+const Response_t *conn_send_object(
+    conn_t *conn, int fd, const char *data, uint64_t size, const byte_range_t *ranges, int n);
+
+/** @brief Send a 200 response whose body is count bytes of memory that
+ *         are already gzip-compressed, with the validators and the head
+ *         in a single write (just the head, for HEAD).
+ *
+ *  @return NULL on success, otherwise the error response to send.
+ */
+const Response_t *conn_send_gzip(conn_t *conn, const char *data, uint64_t count);
+
+/** @brief Send a 200 response whose body is count bytes of memory, with
+ *         the head and the body in a single write (just the head, for
+ *         HEAD).
+ *
+ *  @return NULL on success, otherwise the error response to send.
+ */
+const Response_t *conn_send_data(conn_t *conn, const char *data, uint64_t count);
+
+/** @brief Send a response whose body is its reason phrase (left out for
+ *         HEAD).  A 304 (RESPONSE_NOT_MODIFIED) has no body at all, and
+ *         carries the validators set with conn_set_validator instead; a
+ *         503 (RESPONSE_SERVICE_UNAVAILABLE) asks the client to retry in
+ *         a second.
+ *
+ *  @return NULL on success, otherwise the error response to send.
+ */
+const Response_t *conn_send_response(conn_t *conn, const Response_t *res);
+
+/** @brief Describe a connection's request, for debugging.  The string
+ *         is valid until the calling thread's next call.
+ */
+char *conn_str(conn_t *conn);
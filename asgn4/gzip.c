@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "gzip.h"
+
+#define WINDOW_BITS (15 + 16) // the largest window, with a gzip header and trailer
+#define MEM_LEVEL   8
+
+static _Thread_local z_stream stream;
+static _Thread_local bool stream_ready;
+
+// Function to check one Accept-Encoding element's name, ending at end, against a coding
+static bool coding_is(const char *name, const char *end, const char *coding) {
+    size_t len = strlen(coding);
+    return (size_t) (end - name) == len && strncasecmp(name, coding, len) == 0;
+}
+
+bool gzip_accepted(const char *accept_encoding) {
+    if (accept_encoding == NULL) {
+        return false;
+    }
+    double gzip = -1; // the qvalue gzip was given, or -1 if it isn't listed
+    double any = -1; // the same for *
+    const char *p = accept_encoding;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        const char *name = p;
+        while (*p != '\0' && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') {
+            p++;
+        }
+        const char *end = p;
+
+        // Only the q parameter matters; a malformed one counts as 0
+        double q = 1;
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == ';') {
+            p++;
+            while (*p == ' ' || *p == '\t') {
+                p++;
+            }
+            q = strncasecmp(p, "q=", 2) == 0 ? strtod(p + 2, NULL) : 0;
+        }
+        while (*p != '\0' && *p != ',') {
+            p++;
+        }
+
+        if (coding_is(name, end, "gzip") || coding_is(name, end, "x-gzip")) {
+            gzip = q;
+        } else if (coding_is(name, end, "*")) {
+            any = q;
+        }
+    }
+    return gzip >= 0 ? gzip > 0 : any > 0;
+}
+
+z_stream *gzip_stream(int level) {
+    if (!stream_ready) {
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, WINDOW_BITS, MEM_LEVEL, Z_DEFAULT_STRATEGY)
+            != Z_OK) {
+            return NULL;
+        }
+        stream_ready = true;
+        return &stream;
+    }
+    if (deflateReset(&stream) != Z_OK
+        || deflateParams(&stream, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    return &stream;
+}
+
+char *gzip_compress(const char *data, uint64_t size, int level, uint64_t *out_size) {
+    z_stream *z = gzip_stream(level);
+    if (z == NULL || size > UINT32_MAX) {
+        return NULL;
+    }
+    uLong bound = deflateBound(z, (uLong) size);
+    char *out = malloc(bound);
+    if (out == NULL) {
+        return NULL;
+    }
+    z->next_in = (Bytef *) data;
+    z->avail_in = (uInt) size;
+    z->next_out = (Bytef *) out;
+    z->avail_out = (uInt) bound;
+    if (deflate(z, Z_FINISH) != Z_STREAM_END) {
+        free(out);
+        return NULL;
+    }
+    *out_size = z->total_out;
+    return out;
+}
+
+void gzip_detach(void) {
+    if (stream_ready) {
+        deflateEnd(&stream);
+        stream_ready = false;
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * @File gzip.h
+ *
+ * The gzip content coding (RFC 9110, section 8.4.1.3): deciding from a
+ * request's Accept-Encoding whether the client takes it, and compressing
+ * with zlib.  Each thread keeps one deflate stream and resets it for every
+ * body, since setting a stream up allocates a few hundred kilobytes.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#define GZIP_STREAM_LEVEL 1 // for bodies compressed while they are sent, once per request
+#define GZIP_CACHE_LEVEL  6 // for copies that are compressed once and kept
+
+/** @brief Whether an Accept-Encoding header value (NULL if the request
+ *         had none) accepts gzip: it lists gzip (or x-gzip), or else *,
+ *         with a qvalue that isn't 0.
+ */
+bool gzip_accepted(const char *accept_encoding);
+
+/** @brief Get the calling thread's deflate stream, reset to start a new
+ *         gzip member at the given level.  Feed it with deflate() until
+ *         it returns Z_STREAM_END.
+ *
+ *  @return the stream, or NULL if there is no memory for it.
+ */
+z_stream *gzip_stream(int level);
+
+/** @brief Compress size bytes of data into a new buffer from malloc.
+ *
+ *  @return the buffer, with its length in *out_size, or NULL on failure.
+ */
+char *gzip_compress(const char *data, uint64_t size, int level, uint64_t *out_size);
+
+/** @brief Free the calling thread's deflate stream; for threads that are
+ *         about to exit.
+ */
+void gzip_detach(void);
@@ -0,0 +1,148 @@
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "http_parser.h"
+
+void http_parser_init(http_parser_t *p) {
+    p->status = HTTP_PARSE_INCOMPLETE;
+    p->line = 0;
+    p->scanned = 0;
+    p->head = 0;
+    p->method = 0;
+    p->method_len = 0;
+    p->uri = 0;
+    p->uri_len = 0;
+    p->version = 0;
+    p->nheaders = 0;
+}
+
+// Function to find the first '\r' in [s, end), or NULL
+static const char *find_cr(const char *s, const char *end) {
+#ifdef __SSE2__
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; end - s >= 16; s += 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) s), cr));
+        if (mask != 0) {
+            return s + __builtin_ctz((unsigned) mask);
+        }
+    }
+#endif
+    for (; s < end; s++) {
+        if (*s == '\r') {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+static bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// [a-zA-Z0-9.-], what URIs and header keys are made of
+static bool is_name(char c) {
+    return is_alpha(c) || is_digit(c) || c == '.' || c == '-';
+}
+
+// Function to advance over at most max characters that pass is, returning how many there were
+static size_t span(const char *s, const char *end, size_t max, bool (*is)(char)) {
+    size_t n = 0;
+    while (s + n < end && n <= max && is(s[n])) {
+        n++;
+    }
+    return n;
+}
+
+// Function to check a request line, [s, end), against REQUEST_LINE_REGEX
+static bool parse_request_line(http_parser_t *p, const char *buf, const char *s, const char *end) {
+    size_t n = span(s, end, MAX_METHOD_LENGTH, is_alpha);
+    if (n == 0 || n > MAX_METHOD_LENGTH || end - s < (long) n + 2 || s[n] != ' '
+        || s[n + 1] != '/') {
+        return false;
+    }
+    p->method = (uint16_t) (s - buf);
+    p->method_len = (uint16_t) n;
+    s += n + 2;
+
+    n = span(s, end, MAX_URI_LENGTH, is_name);
+    if (n == 0 || n > MAX_URI_LENGTH || end - s < (long) n + 1 || s[n] != ' ') {
+        return false;
+    }
+    p->uri = (uint16_t) (s - buf);
+    p->uri_len = (uint16_t) n;
+    s += n + 1;
+
+    // "HTTP/" digit, any character, digit; whether it is 1.1 is for the caller to judge
+    if (end - s != VERSION_LENGTH || memcmp(s, "HTTP/", 5) != 0 || !is_digit(s[5])
+        || !is_digit(s[7])) {
+        return false;
+    }
+    p->version = (uint16_t) (s - buf);
+    return true;
+}
+
+// Function to check a header line, [s, end), against HEADER_FIELD_REGEX
+static bool parse_header(http_parser_t *p, const char *buf, const char *s, const char *end) {
+    size_t n = span(s, end, MAX_KEY_LENGTH, is_name);
+    if (n == 0 || n > MAX_KEY_LENGTH || end - s < (long) n + 2 || s[n] != ':' || s[n + 1] != ' ') {
+        return false;
+    }
+    const char *value = s + n + 2;
+
+    // [ -~]; the line ends at its first CR, so only the other control characters need checking
+    size_t value_len = (size_t) (end - value);
+    if (value_len == 0 || value_len > MAX_VALUE_LENGTH) {
+        return false;
+    }
+    for (size_t i = 0; i < value_len; i++) {
+        if (value[i] < ' ' || value[i] > '~') {
+            return false;
+        }
+    }
+    if (p->nheaders < HTTP_MAX_HEADERS) {
+        http_header_t *h = &p->headers[p->nheaders++];
+        h->key = (uint16_t) (s - buf);
+        h->key_len = (uint16_t) n;
+        h->value = (uint16_t) (value - buf);
+        h->value_len = (uint16_t) value_len;
+    }
+    return true;
+}
+
+http_parse_status_t http_parse(http_parser_t *p, const char *buf, size_t len) {
+    while (p->status == HTTP_PARSE_INCOMPLETE) {
+        const char *cr = find_cr(buf + p->scanned, buf + len);
+        if (cr == NULL || cr + 1 == buf + len) {
+            // Nothing to do until the line's "\r\n" arrives, unless it never can
+            p->scanned = cr == NULL ? len : (size_t) (cr - buf);
+            if (len >= MAX_HEADER_LENGTH) {
+                p->status = HTTP_PARSE_ERROR;
+            }
+            break;
+        }
+
+        const char *s = buf + p->line;
+        size_t next = (size_t) (cr - buf) + 2;
+        if (cr[1] != '\n' || next > MAX_HEADER_LENGTH) {
+            p->status = HTTP_PARSE_ERROR;
+        } else if (p->method_len == 0) {
+            p->status
+                = parse_request_line(p, buf, s, cr) ? HTTP_PARSE_INCOMPLETE : HTTP_PARSE_ERROR;
+        } else if (cr == s) {
+            p->head = next;
+            p->status = HTTP_PARSE_DONE;
+        } else if (!parse_header(p, buf, s, cr)) {
+            p->status = HTTP_PARSE_ERROR;
+        }
+        p->line = p->scanned = next;
+    }
+    return p->status;
+}
@@ -0,0 +1,68 @@
+/**
+ * @File http_parser.h
+ *
+ * An incremental parser for HTTP request heads.  It accepts exactly what
+ * the regexes in protocol.h describe, but walks the buffer once, a line
+ * at a time, finding each CR sixteen bytes at a time with SSE2.  It never
+ * allocates or copies: the method, URI, version and headers are recorded
+ * as offsets into the caller's buffer.
+ *
+ * Input may arrive in pieces.  Call http_parse again with the same buffer
+ * after appending to it, and the parser picks up at the first line it
+ * has not seen the end of.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "protocol.h"
+
+#define HTTP_MAX_HEADERS 64 // headers past this many are validated but not recorded
+
+/** @brief What http_parse made of the buffer so far.
+ */
+typedef enum {
+    HTTP_PARSE_INCOMPLETE, /**< every line so far is valid; the head has not ended */
+    HTTP_PARSE_DONE, /**< the head is complete and valid */
+    HTTP_PARSE_ERROR /**< a line is malformed, or the head is longer than MAX_HEADER_LENGTH */
+} http_parse_status_t;
+
+/** @brief Where a header's key and value are in the buffer.
+ */
+typedef struct http_header {
+    uint16_t key;
+    uint16_t key_len;
+    uint16_t value;
+    uint16_t value_len;
+} http_header_t;
+
+/** @brief The parser's progress and what it found.  Offsets are from the
+ *         start of the buffer.
+ */
+typedef struct http_parser {
+    http_parse_status_t status;
+    size_t line; /**< start of the first line not yet parsed */
+    size_t scanned; /**< how far that line has been searched for its CR */
+    size_t head; /**< length of the head, "\r\n\r\n" included, once DONE */
+    uint16_t method;
+    uint16_t method_len;
+    uint16_t uri; /**< the URI without its leading '/' */
+    uint16_t uri_len;
+    uint16_t version; /**< "HTTP/x.y", always 8 bytes */
+    int nheaders;
+    http_header_t headers[HTTP_MAX_HEADERS];
+} http_parser_t;
+
+/** @brief Get a parser ready for a new request head.
+ */
+void http_parser_init(http_parser_t *p);
+
+/** @brief Parse the next complete lines of buf[0..len).  buf must hold
+ *         everything passed in earlier calls, unchanged.  Once DONE or
+ *         ERROR, further calls return the same.
+ *
+ *  @return HTTP_PARSE_INCOMPLETE, HTTP_PARSE_DONE or HTTP_PARSE_ERROR.
+ */
+http_parse_status_t http_parse(http_parser_t *p, const char *buf, size_t len);
@@ -1,3 +1,6 @@
+#define _GNU_SOURCE
+
+#include <sched.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <limits.h>
@@ -12,145 +15,96 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
 
 #include "debug.h"
-#include "queue.h"
+#include "admission.h"
+#include "worker_pool.h"
 #include "rwlock.h"
+#include "lock_table.h"
+#include "connection.h"
+#include "gzip.h"
+#include "reactor.h"
+#include "audit_log.h"
+#include "object_cache.h"
+#include "store.h"
+#include "metrics.h"
+#include "uring.h"
 #include "asgn2_helper_funcs.h"
 
 // Constants and type definitions
-#define BUFFER_SIZE 2048
-typedef struct Request {
-    const char *name;
-} Request_t;
-
-#define NUM_REQUESTS 3
-const Request_t REQUEST_GET = { "GET" };
-const Request_t REQUEST_PUT = { "PUT" };
-const Request_t REQUEST_UNSUPPORTED = { "UNSUPPORTED" };
-const Request_t *requests[NUM_REQUESTS] = { &REQUEST_GET, &REQUEST_PUT, &REQUEST_UNSUPPORTED };
-
-const char *request_get_str(const Request_t *request) {
-    return request->name;
-}
+#define BUFFER_SIZE          2048
+#define DEFAULT_IDLE_SECONDS 5
+#define DEFAULT_MAX_REQUESTS 100
+#define DEFAULT_CACHE_MB     64
+#define DEFAULT_TARGET_MS    5 // queue wait to shed down to; 0 (-q 0) never sheds
+#define DEFAULT_WAIT_MS      10 // for the reactor to wait for room in the queues
+#define SHED_INTERVAL_MS     100 // how long queue waits must stay above target to shed
+#define TEMP_PREFIX          ".put_"
+#define STORE_DIR            "_store" // '_' can't appear in a URI, so no object can have this name
+#define MAX_STORE_KB         1024
+#define METRICS_URI          "metrics" // GET serves the metrics; no object may have this name
+#define GZIP_MIN_SIZE        256 // smaller objects aren't worth compressing
+#define GZIP_STREAM_MAX      (1 << 20) // larger ones are only compressed if the cache keeps them
 
-typedef struct Response {
-    uint16_t code;
-    const char *message;
-} Response_t;
-
-const Response_t RESPONSE_OK = { 200, "OK" };
-const Response_t RESPONSE_CREATED = { 201, "Created" };
-const Response_t RESPONSE_BAD_REQUEST = { 400, "Bad Request" };
-const Response_t RESPONSE_FORBIDDEN = { 403, "Forbidden" };
-const Response_t RESPONSE_NOT_FOUND = { 404, "Not Found" };
-const Response_t RESPONSE_INTERNAL_SERVER_ERROR = { 500, "Internal Server Error" };
-const Response_t RESPONSE_NOT_IMPLEMENTED = { 501, "Not Implemented" };
-const Response_t RESPONSE_VERSION_NOT_SUPPORTED = { 505, "HTTP Version Not Supported" };
-
-uint16_t response_get_code(const Response_t *response) {
-    return response->code;
-}
+// The last request a connection may make before the server closes it
+uint32_t max_requests = DEFAULT_MAX_REQUESTS;
 
-const char *response_get_message(const Response_t *response) {
-    return response->message;
-}
+// Where the GET/PUT audit lines go (stderr unless -l is given)
+audit_log_t *audit = NULL;
 
-pthread_mutex_t mutex;
-
-typedef struct Conn conn_t;
-
-// Function prototypes
-conn_t *conn_new(int connfd);
-void conn_delete(conn_t **conn);
-const Response_t *conn_parse(conn_t *conn);
-const Request_t *conn_get_request(conn_t *conn);
-char *conn_get_uri(conn_t *conn);
-char *conn_get_header(conn_t *conn, char *header);
-const Response_t *conn_recv_file(conn_t *conn, int fd);
-const Response_t *conn_send_file(conn_t *conn, int fd, uint64_t count);
-const Response_t *conn_send_response(conn_t *conn, const Response_t *res);
-char *conn_str(conn_t *conn);
-
-typedef struct rwlockNodeObj *rwlockNode;
-typedef struct rwlockNodeObj {
-    char *uri;
-    rwlock_t *rwlock;
-    rwlockNode next;
-} rwlockNodeObj;
-
-typedef struct rwlockHTObj *rwlockHT;
-typedef struct rwlockHTObj {
-    rwlockNode head;
-    int length;
-} rwlockHTObj;
-
-typedef struct ThreadObj *Thread;
-typedef struct ThreadObj {
-    pthread_t thread;
-    int id;
-    rwlockHT *rwlockHT;
-    queue_t *queue;
-} ThreadObj;
+// Contents of recently read objects (-c sets its size in MB; 0 turns it off)
+object_cache_t *cache = NULL;
 
-void handle_connection(int, rwlockHT);
-void handle_get(conn_t *, rwlockHT);
-void handle_put(conn_t *, rwlockHT);
-void handle_unsupported(conn_t *);
+// Where objects of up to -s KB go when they are PUT; NULL (-s 0, the default) keeps every object
+// in a file of its own
+store_t *store = NULL;
 
-// Function to create a new rwlock node
-rwlockNode create_rwlock_node(char *uri, rwlock_t *rwlock) {
-    rwlockNode node = malloc(sizeof(rwlockNodeObj));
-    node->uri = strdup(uri);
-    node->rwlock = rwlock;
-    node->next = NULL;
-    return node;
-}
+// The memfd each worker receives small PUT bodies into while the store is on
+_Thread_local int put_buffer_fd = -1;
 
-// Function to append a node to the rwlock hash table
-void append_rwlock_node(rwlockHT hashTable, char *uri, rwlock_t *lock) {
-    rwlockNodeObj *newNode = create_rwlock_node(uri, lock);
-    if (hashTable->length == 0) {
-        hashTable->head = newNode;
-    } else {
-        rwlockNodeObj *currNode = hashTable->head;
-        for (; currNode->next != NULL; currNode = currNode->next) {
-        }
-        currNode->next = newNode;
-    }
-    hashTable->length++;
-}
+// A listener with its own reactor and worker pool; -n sets how many share the port.  The pool
+// hands its shard to worker_start, worker_serve and worker_stop.
+typedef struct ShardObj *Shard;
+typedef struct ShardObj {
+    int id;
+    pthread_t thread; // runs the reactor (the main thread does for shard 0)
+    Listener_Socket sock;
+    worker_pool_t *pool;
+    admission_t *admission; // sheds requests that waited in pool's queues too long
+    reactor_t *reactor;
+    lock_table_t *locks; // shared by every shard, as one URI may come in on any of them
+} ShardObj;
 
-// Function to create a new lock hash table
-rwlockHT create_lock_hash_table(void) {
-    rwlockHT lockNode = malloc(sizeof(rwlockHTObj));
-    lockNode->length = 0;
-    lockNode->head = NULL;
-    return lockNode;
-}
+Shard shards = NULL;
+int nshards = 1;
 
-// Function to free all nodes in the hash table
-void free_rwlock_nodes(rwlockHT *lockNode) {
-    for (rwlockNode node = (*lockNode)->head; node != NULL;) {
-        rwlockNode nextNode = node->next;
-        free(node->uri);
-        free(node);
-        node = nextNode;
-    }
-    free(*lockNode);
-}
+// The shard the calling worker thread belongs to
+_Thread_local Shard my_shard = NULL;
 
-// Function to lookup a rwlock in the hash table linked list
-rwlock_t *lookup_rwlock(rwlockNode head, char *uri) {
-    rwlockNode node = head;
-    while (node != NULL) {
-        if (strcmp(node->uri, uri) == 0) {
-            return node->rwlock;
-        }
-        node = node->next;
-    }
-    return NULL;
-}
+// Whether to pin threads to CPUs (-a), and the CPUs there are to pin to
+bool pin = false;
+cpu_set_t allowed_cpus;
+
+void handle_connection(conn_t *, lock_table_t *);
+void handle_get(conn_t *, lock_table_t *);
+void handle_put(conn_t *, lock_table_t *);
+void handle_unsupported(conn_t *);
+void handle_metrics(conn_t *, lock_table_t *);
+void reader_lock_timed(rwlock_t *);
+void writer_lock_timed(rwlock_t *);
+void pin_thread(pthread_t, int, int);
+void audit_request(conn_t *, const char *, uint16_t);
+int get_ranges(conn_t *, uint64_t, byte_range_t *);
+uint16_t range_status(int);
+bool not_modified(conn_t *, const validator_t *);
+bool use_gzip(conn_t *, uint64_t);
+bool set_version(conn_t *, const validator_t *, bool);
+int put_buffer(void);
+bool stamp_file(int);
+void send_cached(conn_t *, object_t *, const byte_range_t *, int, bool);
+object_t *read_object(const char *, int, const char *, uint64_t, const validator_t *);
 
 // Function to verify the request method
 int verify_request_method(const char *str) {
@@ -217,180 +171,768 @@ bool is_alphanumeric_plus(const char *str) {
     return true;
 }
 
-// Thread worker function
-void *worker_thread(void *arg) {
-    Thread thread = (Thread) arg;
-    queue_t *queue = thread->queue;
-    while (1) {
-        uintptr_t connfd = 0;
-        queue_pop(queue, (void **) &connfd);
-        handle_connection((int) connfd, *thread->rwlockHT);
-        close((int) connfd);
+// Function to print the object cache's counters
+void print_cache_stats(void) {
+    object_cache_stats_t st;
+    object_cache_stats(cache, &st);
+    uint64_t lookups = st.hits + st.misses;
+    printf("cache: hits %lu misses %lu hit_rate %.1f%% insertions %lu evictions %lu "
+           "invalidations %lu objects %lu bytes %lu/%lu\n",
+        st.hits, st.misses, lookups ? 100.0 * (double) st.hits / (double) lookups : 0.0,
+        st.insertions, st.evictions, st.invalidations, st.objects, st.bytes, st.budget);
+    fflush(stdout);
+}
+
+// Thread that handles SIGHUP (reopen the audit log after rotation), SIGUSR1 (print the
+// cache's counters) and SIGTERM/SIGINT (write out the audit log, then exit), so that none of
+// them runs in a signal handler
+void *signal_thread(void *arg) {
+    sigset_t *signals = arg;
+    for (;;) {
+        int sig;
+        if (sigwait(signals, &sig) != 0) {
+            continue;
+        }
+        if (sig == SIGHUP) {
+            audit_log_rotate(audit);
+        } else if (sig == SIGUSR1) {
+            print_cache_stats();
+        } else {
+            audit_log_flush(audit);
+            exit(EXIT_SUCCESS);
+        }
     }
     return NULL;
 }
 
+// Function to pin a thread of shard to CPUs (-a).  The CPUs the process may run on are split
+// into one contiguous slice per shard (neighbouring CPUs usually share a cache, and a node);
+// worker i gets the i-th CPU of its slice, wrapping around, and i < 0, the reactor, gets all
+// of it.
+void pin_thread(pthread_t thread, int shard, int i) {
+    int n = CPU_COUNT(&allowed_cpus);
+    if (n == 0) {
+        return;
+    }
+    int first = shard * n / nshards;
+    int last = (shard + 1) * n / nshards;
+    if (last == first) {
+        first = shard % n;
+        last = first + 1;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0, k = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed_cpus)) {
+            continue;
+        }
+        if (k >= first && k < last && (i < 0 || k == first + i % (last - first))) {
+            CPU_SET(cpu, &set);
+        }
+        k++;
+    }
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+// Thread that runs the reactor of a shard other than the first
+void *reactor_thread(void *arg) {
+    Shard shard = (Shard) arg;
+    reactor_run(shard->reactor);
+    return NULL;
+}
+
+// Function run by each new worker thread before it serves anything
+void worker_start(void *arg, int id) {
+    my_shard = (Shard) arg;
+    if (pin) {
+        pin_thread(pthread_self(), my_shard->id, id);
+    }
+}
+
+// Function to serve a connection the reactor handed to the workers
+void worker_serve(void *arg, int id, void *item) {
+    Shard shard = (Shard) arg;
+    conn_t *conn = item;
+    (void) id;
+    uint64_t now = metrics_now();
+    uint64_t waited = now - conn_get_queued_at(conn);
+    metrics_observe(PHASE_QUEUE, waited);
+    worker_pool_note_wait(shard->pool, waited);
+
+    // A 503 is much cheaper than serving a request, so while the queues are backed up, turning
+    // away the requests that waited too long is what lets the ones behind them wait less
+    conn_status_t status = CONN_READY;
+    if (!admission_admit(shard->admission, now, waited)) {
+        conn_send_response(conn, &RESPONSE_SERVICE_UNAVAILABLE);
+        metrics_count_request(conn_get_method(conn), 503);
+        status = conn_keep_alive(conn) ? conn_next(conn) : CONN_CLOSED;
+    }
+
+    // Serve every request the client has already pipelined, then give the connection back
+    while (status == CONN_READY) {
+        if (conn_get_served(conn) + 1 >= max_requests) {
+            conn_set_close(conn);
+        }
+        uint64_t start = metrics_now();
+        handle_connection(conn, shard->locks);
+        metrics_observe(PHASE_TOTAL, metrics_now() - start);
+        metrics_count_request(conn_get_method(conn), conn_get_status(conn));
+        if (!conn_keep_alive(conn)) {
+            break;
+        }
+        status = conn_next(conn);
+    }
+
+    if (conn_keep_alive(conn)) {
+        reactor_resume(shard->reactor, conn);
+    } else {
+        close(conn_get_fd(conn));
+        conn_delete(&conn);
+        metrics_count_connections(-1);
+    }
+}
+
+// Function run by a worker thread the pool retires after it sat idle
+void worker_stop(void *arg, int id) {
+    (void) arg;
+    (void) id;
+    audit_log_detach(audit);
+    uring_detach();
+    gzip_detach();
+    metrics_detach();
+    if (put_buffer_fd >= 0) {
+        close(put_buffer_fd);
+        put_buffer_fd = -1;
+    }
+}
+
 int main(int argc, char **argv) {
     char *endptr = NULL;
-    long port = strtol(argv[1], &endptr, 10);
     int t = 4;
+    int max_t = 0;
+    int idle_seconds = DEFAULT_IDLE_SECONDS;
+    char *log_path = NULL;
+    long cache_mb = DEFAULT_CACHE_MB;
+    int target_ms = DEFAULT_TARGET_MS;
+    int wait_ms = DEFAULT_WAIT_MS;
+    long store_kb = 0;
     int opt;
-    int manualThread = 0;
 
     // Parsing command line options
-    for (; (opt = getopt(argc, argv, "t:")) != -1;) {
+    for (; (opt = getopt(argc, argv, "t:T:n:k:r:l:c:q:w:s:a")) != -1;) {
         if (opt == 't') {
             t = atoi(optarg);
-            manualThread = 1;
+        } else if (opt == 'T') {
+            max_t = atoi(optarg);
+        } else if (opt == 'n') {
+            nshards = atoi(optarg);
+        } else if (opt == 'k') {
+            idle_seconds = atoi(optarg);
+        } else if (opt == 'r') {
+            max_requests = (uint32_t) strtoul(optarg, NULL, 10);
+        } else if (opt == 'l') {
+            log_path = optarg;
+        } else if (opt == 'c') {
+            cache_mb = strtol(optarg, NULL, 10);
+        } else if (opt == 'q') {
+            target_ms = atoi(optarg);
+        } else if (opt == 'w') {
+            wait_ms = atoi(optarg);
+        } else if (opt == 's') {
+            store_kb = strtol(optarg, NULL, 10);
+        } else if (opt == 'a') {
+            pin = true;
         }
     }
 
+    // The pool starts with t workers and may grow to max_t (4t unless -T says otherwise)
+    if (max_t == 0) {
+        max_t = 4 * t;
+    }
+
     // Checking for valid port number
-    if (argc < 2) {
-        fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    if (optind >= argc || t < 1 || max_t < t || nshards < 1 || idle_seconds < 1
+        || max_requests < 1 || cache_mb < 0 || target_ms < 0 || wait_ms < 0 || store_kb < 0
+        || store_kb > MAX_STORE_KB) {
+        fprintf(stderr,
+            "usage: %s [-t threads] [-T max_threads] [-n listeners] [-k idle_seconds] "
+            "[-r max_requests] [-l logfile] [-c cache_mb] [-q target_ms] [-w wait_ms] "
+            "[-s small_kb] [-a] <port>\n",
+            argv[0]);
         return EXIT_FAILURE;
     }
 
-    if (manualThread)
-        port = strtol(argv[3], &endptr, 10);
-    else
-        port = strtol(argv[1], &endptr, 10);
-
+    long port = strtol(argv[optind], &endptr, 10);
     if (port < 1 || port > 65535 || (endptr && *endptr != '\0')) {
         fprintf(stderr, "Invalid Port\n");
         return 1;
     }
 
     signal(SIGPIPE, SIG_IGN);
-    Listener_Socket sock;
-    listener_init(&sock, (int) port);
 
-    Thread threads[t];
-    rwlockHT rwlock_ht = create_lock_hash_table();
-    queue_t *queue = queue_new(t);
+    // Every thread started from here on inherits this mask, leaving these to signal_thread
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR1);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    // Only workers record lines, and each has a ring of its own
+    audit = audit_log_new(log_path, nshards * max_t);
+    if (audit == NULL) {
+        fprintf(stderr, "Failed to open the audit log %s\n", log_path);
+        return EXIT_FAILURE;
+    }
+    cache = object_cache_new((size_t) cache_mb << 20);
+    if (cache == NULL) {
+        fprintf(stderr, "Failed to allocate the object cache\n");
+        return EXIT_FAILURE;
+    }
+
+    // Small objects are appended to the store's segments instead of getting a file (and an
+    // inode) each; what earlier runs put there is read back first
+    if (store_kb > 0) {
+        store = store_open(STORE_DIR, (uint64_t) store_kb << 10);
+        if (store == NULL) {
+            fprintf(stderr, "Failed to open the object store %s\n", STORE_DIR);
+            return EXIT_FAILURE;
+        }
+    }
+    pthread_t signal_tid;
+    pthread_create(&signal_tid, NULL, signal_thread, &signals);
+
+    // With more than one listener, each sets SO_REUSEPORT and the kernel spreads connections
+    // over them
+    shards = calloc(nshards, sizeof(ShardObj));
+    if (shards == NULL) {
+        fprintf(stderr, "Failed to allocate the listeners\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < nshards; i++) {
+        shards[i].id = i;
+        int rc = nshards == 1 ? listener_init(&shards[i].sock, (int) port)
+                              : listener_init_reuseport(&shards[i].sock, (int) port);
+        if (rc < 0) {
+            fprintf(stderr, "Failed to listen on port %ld\n", port);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Idle connections only cost a file descriptor now, so allow as many as we may
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0) {
+        CPU_ZERO(&allowed_cpus);
+    }
+
+    // Workers read small objects with io_uring where the kernel lets them
+    uring_init();
+
+    lock_table_t *locks = lock_table_new(0);
+    for (int i = 0; i < nshards; i++) {
+        Shard shard = &shards[i];
+        shard->locks = locks;
+        shard->pool = worker_pool_new(t, max_t);
+        if (shard->pool == NULL) {
+            fprintf(stderr, "Failed to allocate the worker queues\n");
+            return EXIT_FAILURE;
+        }
+
+        // Requests are shed once they wait more than target_ms for a worker, or the reactor
+        // waits more than wait_ms to queue them; with -q 0, neither happens
+        shard->admission = admission_new(
+            (uint64_t) target_ms * 1000000, (uint64_t) SHED_INTERVAL_MS * 1000000);
+        if (shard->admission == NULL) {
+            fprintf(stderr, "Failed to allocate the load shedder\n");
+            return EXIT_FAILURE;
+        }
 
-    // Creating threads
-    for (int i = 0; i < t; i++) {
-        threads[i] = malloc(sizeof(ThreadObj));
-        threads[i]->id = i;
-        threads[i]->rwlockHT = &rwlock_ht;
-        threads[i]->queue = queue;
-        pthread_create(&threads[i]->thread, NULL, worker_thread, threads[i]);
+        // Each reactor accepts connections from its listener and reads their requests
+        shard->reactor = reactor_new(&shard->sock, shard->pool, shard->admission,
+            idle_seconds * 1000, target_ms > 0 ? wait_ms : -1);
+        if (shard->reactor == NULL) {
+            fprintf(stderr, "Failed to start the event loop\n");
+            return EXIT_FAILURE;
+        }
+
+        // Starting the workers
+        worker_pool_ops_t ops = { worker_start, worker_serve, worker_stop, shard };
+        if (worker_pool_start(shard->pool, &ops) < 0) {
+            fprintf(stderr, "Failed to start the workers\n");
+            return EXIT_FAILURE;
+        }
     }
 
-    // Dispatcher thread to accept connections
-    while (1) {
-        uintptr_t connfd = listener_accept(&sock);
-        queue_push(queue, (void *) connfd);
+    // The main thread runs the first shard's reactor, after the others have threads of their own
+    for (int i = 1; i < nshards; i++) {
+        pthread_create(&shards[i].thread, NULL, reactor_thread, &shards[i]);
+        if (pin) {
+            pin_thread(shards[i].thread, i, -1);
+        }
     }
+    shards[0].thread = pthread_self();
+    if (pin) {
+        pin_thread(shards[0].thread, 0, -1);
+    }
+    reactor_run(shards[0].reactor);
 
     return EXIT_SUCCESS;
 }
 
 // Function to handle an incoming connection
-void handle_connection(int connfd, rwlockHT rwlock_HT) {
-    conn_t *conn = conn_new(connfd);
+void handle_connection(conn_t *conn, lock_table_t *locks) {
     const Response_t *res = conn_parse(conn);
 
     if (res != NULL) {
         conn_send_response(conn, res);
-        conn_delete(&conn);
         return;
     }
 
     debug("%s", conn_str(conn));
     const Request_t *req = conn_get_request(conn);
 
-    if (req == &REQUEST_GET) {
-        handle_get(conn, rwlock_HT);
+    if ((req == &REQUEST_GET || req == &REQUEST_HEAD)
+        && strcmp(conn_get_uri(conn), METRICS_URI) == 0) {
+        handle_metrics(conn, locks);
+    } else if (req == &REQUEST_GET || req == &REQUEST_HEAD) {
+        handle_get(conn, locks);
     } else if (req == &REQUEST_PUT) {
-        handle_put(conn, rwlock_HT);
+        handle_put(conn, locks);
     } else {
         handle_unsupported(conn);
     }
+}
 
-    conn_delete(&conn);
+// Function to read a whole file into a new cache object, or to copy it if it has already been
+// read (contents)
+object_t *read_object(const char *uri, int fd, const char *contents, uint64_t size,
+    const validator_t *validator) {
+    char *data = malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        return NULL;
+    }
+    if (contents != NULL) {
+        memcpy(data, contents, size);
+        return object_cache_put(cache, uri, data, size, validator);
+    }
+    uint64_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, data + done, size - done, (off_t) done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            free(data);
+            return NULL;
+        }
+        done += (uint64_t) n;
+    }
+    return object_cache_put(cache, uri, data, size, validator);
 }
 
 // Function to handle a GET request
-void handle_get(conn_t *conn, rwlockHT rwlock_HT) {
+void handle_get(conn_t *conn, lock_table_t *locks) {
     char *uri = conn_get_uri(conn);
+    const char *method = request_get_str(conn_get_request(conn));
+    bool head = conn_get_request(conn) == &REQUEST_HEAD;
     const Response_t *res = NULL;
 
-    pthread_mutex_lock(&mutex);
-    rwlock_t *lock = lookup_rwlock(rwlock_HT->head, uri);
-    if (lock == NULL) {
-        lock = rwlock_new(N_WAY, 1);
-        append_rwlock_node(rwlock_HT, uri, lock);
+    lock_entry_t *entry = lock_table_acquire(locks, uri);
+    if (entry == NULL) {
+        conn_send_response(conn, &RESPONSE_INTERNAL_SERVER_ERROR);
+        return;
     }
-    pthread_mutex_unlock(&mutex);
-    reader_lock(lock);
+    rwlock_t *lock = lock_entry_rwlock(entry);
+    reader_lock_timed(lock);
 
     if (!is_alphanumeric_plus(uri)) {
         res = &RESPONSE_BAD_REQUEST;
-        char *req = conn_get_header(conn, "Request-Id");
-        if (req == NULL)
-            req = "0";
-        fprintf(stderr, "GET,/%s,400,%s\n", uri, req);
+        audit_request(conn, method, 400);
         goto out;
     }
 
-    int fd = open(uri, O_RDONLY);
-    if (fd < 0) {
-        if (errno == ENOENT) {
-            res = &RESPONSE_NOT_FOUND;
-            char *req = conn_get_header(conn, "Request-Id");
-            if (req == NULL)
-                req = "0";
-            fprintf(stderr, "GET,/%s,404,%s\n", uri, req);
+    // Hot objects are served from memory without touching the file, and a client that already
+    // has the version cached is told so without being sent it
+    byte_range_t ranges[RANGE_MAX];
+    int nranges;
+    object_t *obj = object_cache_get(cache, uri);
+    if (obj != NULL) {
+        bool gzip = use_gzip(conn, object_size(obj));
+        if (set_version(conn, object_validator(obj), gzip)) {
+            object_cache_release(cache, obj);
+            res = &RESPONSE_NOT_MODIFIED;
+            audit_request(conn, method, 304);
             goto out;
-        } else if (errno == EACCES || errno == EISDIR) {
-            res = &RESPONSE_FORBIDDEN;
-            char *req = conn_get_header(conn, "Request-Id");
-            if (req == NULL)
-                req = "0";
-            fprintf(stderr, "GET,/%s,403,%s\n", uri, req);
+        }
+        nranges = get_ranges(conn, object_size(obj), ranges);
+        audit_request(conn, method, range_status(nranges));
+        reader_unlock(lock);
+        lock_table_release(locks, entry);
+        send_cached(conn, obj, ranges, nranges, gzip);
+        object_cache_release(cache, obj);
+        return;
+    }
+
+    // Small objects PUT while the store was on are records in its segments rather than files
+    store_ref_t ref;
+    if (store != NULL && store_get(store, uri, &ref)) {
+        validator_t validator;
+        validator_from_record(&validator, ref.version, ref.mtime_ns, ref.size);
+        bool gzip = use_gzip(conn, ref.size);
+        if (set_version(conn, &validator, gzip)) {
+            store_release(store, &ref);
+            res = &RESPONSE_NOT_MODIFIED;
+            audit_request(conn, method, 304);
             goto out;
-        } else {
+        }
+
+        // Like a file's, the contents are cached while the reader lock is held, and a HEAD
+        // doesn't read them
+        uint64_t disk_start = metrics_now();
+        char *data = head ? NULL : malloc(ref.size > 0 ? ref.size : 1);
+        bool ok = head || (data != NULL && store_read(store, &ref, data) == 0);
+        store_release(store, &ref);
+        if (ok && data != NULL && object_cache_admits(cache, ref.size)) {
+            obj = object_cache_put(cache, uri, data, ref.size, &validator);
+            ok = obj != NULL;
+            data = NULL;
+        }
+        metrics_observe(PHASE_DISK, metrics_now() - disk_start);
+        if (!ok) {
+            free(data);
             res = &RESPONSE_INTERNAL_SERVER_ERROR;
-            char *req = conn_get_header(conn, "Request-Id");
-            if (req == NULL)
-                req = "0";
-            fprintf(stderr, "GET,/%s,500,%s\n", uri, req);
+            audit_request(conn, method, 500);
             goto out;
         }
+        nranges = get_ranges(conn, ref.size, ranges);
+        audit_request(conn, method, range_status(nranges));
+        reader_unlock(lock);
+        lock_table_release(locks, entry);
+
+        if (obj != NULL) {
+            send_cached(conn, obj, ranges, nranges, gzip);
+            object_cache_release(cache, obj);
+        } else {
+            conn_send_object(conn, -1, data != NULL ? data : "", ref.size, ranges, nranges);
+            free(data);
+        }
+        return;
     }
 
+    // A small object is read whole with io_uring, in one submission that opens, reads and closes
+    // it; anything else is opened the usual way.  The path is looked up twice, but the reader lock
+    // keeps it naming the same file.  An object the client already has isn't read at all.
+    uint64_t disk_start = metrics_now();
     struct stat fileStat;
-    fstat(fd, &fileStat);
+    validator_t validator;
+    const char *data = NULL;
+    int fd = -1;
+    int err = stat(uri, &fileStat) == 0 ? 0 : errno;
+    bool regular = err == 0 && S_ISREG(fileStat.st_mode);
+    bool fresh = false;
+    bool gzip = false;
+    uint64_t fileSize = (uint64_t) fileStat.st_size;
+    if (regular) {
+        validator_from_stat(&validator, &fileStat);
+        gzip = use_gzip(conn, fileSize);
+        fresh = set_version(conn, &validator, gzip);
+    }
+    if (!head && regular && !fresh && uring_read(uri, fileSize, &data) != 0) {
+        data = NULL;
+    }
+    // Opening a FIFO blocks until a producer opens it too, and this worker holds the reader lock,
+    // so it is opened without blocking; sending it, without the lock, waits for the producer
+    if (err == 0 && data == NULL && !fresh && !S_ISDIR(fileStat.st_mode)) {
+        fd = open(uri, O_RDONLY | O_NONBLOCK);
+        err = fd < 0 ? errno : 0;
+    }
 
-    if (S_ISDIR(fileStat.st_mode)) {
-        res = &RESPONSE_FORBIDDEN;
-        char *req = conn_get_header(conn, "Request-Id");
-        if (req == NULL)
-            req = "0";
-        fprintf(stderr, "GET,/%s,403,%s\n", uri, req);
+    if (err != 0 || S_ISDIR(fileStat.st_mode)) {
+        metrics_observe(PHASE_DISK, metrics_now() - disk_start);
+        if (err == ENOENT) {
+            res = &RESPONSE_NOT_FOUND;
+            audit_request(conn, method, 404);
+        } else if (err == EACCES || err == 0) {
+            res = &RESPONSE_FORBIDDEN;
+            audit_request(conn, method, 403);
+        } else {
+            res = &RESPONSE_INTERNAL_SERVER_ERROR;
+            audit_request(conn, method, 500);
+        }
+        goto out;
+    }
+    if (fresh) {
+        metrics_observe(PHASE_DISK, metrics_now() - disk_start);
+        res = &RESPONSE_NOT_MODIFIED;
+        audit_request(conn, method, 304);
         goto out;
     }
 
-    int fileSize = (int) fileStat.st_size;
-    res = conn_send_file(conn, fd, fileSize);
-
-    if (res == NULL) {
-        res = &RESPONSE_OK;
-        char *req = conn_get_header(conn, "Request-Id");
-        if (req == NULL)
-            req = "0";
-        fprintf(stderr, "GET,/%s,200,%s\n", uri, req);
+    // Small enough objects are read into the cache while the reader lock keeps PUTs from
+    // publishing a new version, so the cached copy can't be stale.  A HEAD doesn't need the
+    // contents, so it doesn't read them.  Anything but a regular file (a FIFO a producer is still
+    // writing to) has no size to cache or take ranges of, and is streamed as it is written.
+    if (!head && regular && object_cache_admits(cache, fileSize)) {
+        obj = read_object(uri, fd, data, fileSize, &validator);
     }
+    metrics_observe(PHASE_DISK, metrics_now() - disk_start);
 
+    // This is where the GET takes effect. PUTs publish by renaming a new file over the object,
+    // so the open descriptor (or the copy uring_read made) keeps this version, and the body (or
+    // the ranges of it that were asked for) is sent without the lock.
+    nranges = regular ? get_ranges(conn, fileSize, ranges) : -1;
+    audit_request(conn, method, range_status(nranges));
     reader_unlock(lock);
-    close(fd);
+    lock_table_release(locks, entry);
+
+    if (obj != NULL) {
+        send_cached(conn, obj, ranges, nranges, gzip);
+        object_cache_release(cache, obj);
+    } else if (fd >= 0 && !regular) {
+        // Streaming a FIFO waits on its producer, so the pool may have to cover for this worker
+        worker_pool_block_begin(my_shard->pool);
+        conn_send_object(conn, fd, NULL, fileSize, ranges, nranges);
+        worker_pool_block_end(my_shard->pool);
+    } else {
+        conn_send_object(conn, fd, data, fileSize, ranges, nranges);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
     return;
 
 out:
-    conn_send_response(conn, res);
     reader_unlock(lock);
+    lock_table_release(locks, entry);
+    conn_send_response(conn, res);
+}
+
+// Function to resolve a GET's Range header, if any, against an object of size bytes; returns
+// what range_parse does, or -1 (send everything) for a HEAD or a GET without one
+int get_ranges(conn_t *conn, uint64_t size, byte_range_t *ranges) {
+    char *range = conn_get_header(conn, "Range");
+    if (range == NULL || conn_get_request(conn) != &REQUEST_GET) {
+        return -1;
+    }
+    return range_parse(range, size, ranges);
+}
+
+// Function to check a GET's (or HEAD's) conditional headers against the version of the object
+// it would be sent; whether to send a 304 instead
+bool not_modified(conn_t *conn, const validator_t *validator) {
+    return validator_not_modified(validator, conn_get_header(conn, "If-None-Match"),
+        conn_get_header(conn, "If-Modified-Since"));
+}
+
+// Function to decide whether a GET's (or HEAD's) object of size bytes goes out gzip-compressed:
+// if the client takes gzip, didn't ask for ranges, and the object is big enough to gain from it.
+// Objects the cache holds are compressed once; any other is compressed for every request, which
+// is only worth it up to GZIP_STREAM_MAX.
+bool use_gzip(conn_t *conn, uint64_t size) {
+    const Request_t *req = conn_get_request(conn);
+    if ((req != &REQUEST_GET && req != &REQUEST_HEAD) || size < GZIP_MIN_SIZE
+        || (size > GZIP_STREAM_MAX && !object_cache_admits(cache, size))
+        || conn_get_header(conn, "Range") != NULL) {
+        return false;
+    }
+    return gzip_accepted(conn_get_header(conn, "Accept-Encoding"));
+}
+
+// Function to set the validators of the version of an object a GET is answered with (of its gzip
+// form if gzip, which is then what is sent) and check the conditional headers against them;
+// whether to send a 304
+bool set_version(conn_t *conn, const validator_t *validator, bool gzip) {
+    validator_t version = *validator;
+    if (gzip) {
+        validator_gzip(&version);
+        conn_set_gzip(conn);
+    }
+    conn_set_validator(conn, &version);
+    return not_modified(conn, &version);
+}
+
+// Function to send a cached object; gzip-compressed from the copy the cache keeps if gzip, or,
+// if there is no memory for that copy, compressed as it goes out
+void send_cached(conn_t *conn, object_t *obj, const byte_range_t *ranges, int nranges, bool gzip) {
+    uint64_t size;
+    const char *data = gzip ? object_gzip(cache, obj, &size) : NULL;
+    if (data != NULL) {
+        conn_send_gzip(conn, data, size);
+    } else {
+        conn_send_object(conn, -1, object_data(obj), object_size(obj), ranges, nranges);
+    }
+}
+
+// Function to get the status code a GET answered with get_ranges' result will be sent with
+uint16_t range_status(int nranges) {
+    return nranges < 0 ? 200 : nranges == 0 ? 416 : 206;
+}
+
+// Function to record a request in the audit log. Called while the URI's lock is still held,
+// so the log's order matches the order in which requests took effect.
+void audit_request(conn_t *conn, const char *method, uint16_t code) {
+    char *req = conn_get_header(conn, "Request-Id");
+    if (req == NULL)
+        req = "0";
+    audit_log_record(audit, method, conn_get_uri(conn), code, req);
+}
+
+// Function to take a URI's lock for reading, recording how long that took (and letting the
+// pool know this worker may be stuck a while)
+void reader_lock_timed(rwlock_t *lock) {
+    uint64_t start = metrics_now();
+    worker_pool_block_begin(my_shard->pool);
+    reader_lock(lock);
+    worker_pool_block_end(my_shard->pool);
+    metrics_observe(PHASE_LOCK, metrics_now() - start);
+}
+
+// Function to take a URI's lock for writing, recording how long that took (and letting the
+// pool know this worker may be stuck a while)
+void writer_lock_timed(rwlock_t *lock) {
+    uint64_t start = metrics_now();
+    worker_pool_block_begin(my_shard->pool);
+    writer_lock(lock);
+    worker_pool_block_end(my_shard->pool);
+    metrics_observe(PHASE_LOCK, metrics_now() - start);
+}
+
+// Function to serve the metrics (and the server's own gauges) in the Prometheus text format.
+// Nothing is summed until someone asks, and it isn't an object request, so it isn't audited.
+void handle_metrics(conn_t *conn, lock_table_t *locks) {
+    char *text = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&text, &len);
+    if (f == NULL) {
+        conn_send_response(conn, &RESPONSE_INTERNAL_SERVER_ERROR);
+        return;
+    }
+    metrics_write(f);
+
+    // Every listener has its own pool; they are reported as one
+    worker_pool_stats_t ps = { 0 };
+    for (int i = 0; i < nshards; i++) {
+        worker_pool_stats_t one;
+        worker_pool_stats(shards[i].pool, &one);
+        ps.workers += one.workers;
+        ps.min += one.min;
+        ps.max += one.max;
+        ps.idle += one.idle;
+        ps.blocked += one.blocked;
+        ps.queued += one.queued;
+        ps.steals += one.steals;
+        ps.grown += one.grown;
+        ps.shrunk += one.shrunk;
+    }
+    uint64_t shed_delay = 0, shed_full = 0;
+    int overloaded = 0;
+    for (int i = 0; i < nshards; i++) {
+        admission_stats_t as;
+        admission_stats(shards[i].admission, &as);
+        shed_delay += as.shed;
+        overloaded += as.overloaded;
+        shed_full += reactor_shed(shards[i].reactor);
+    }
+    fprintf(f,
+        "# HELP httpserver_queue_depth Parsed requests waiting for a worker.\n"
+        "# TYPE httpserver_queue_depth gauge\n"
+        "httpserver_queue_depth %d\n"
+        "# HELP httpserver_steals_total Requests a worker took from another worker's queue.\n"
+        "# TYPE httpserver_steals_total counter\n"
+        "httpserver_steals_total %lu\n"
+        "# HELP httpserver_workers Worker threads, by state; min and max bound the total.\n"
+        "# TYPE httpserver_workers gauge\n"
+        "httpserver_workers{state=\"running\"} %d\n"
+        "httpserver_workers{state=\"idle\"} %d\n"
+        "httpserver_workers{state=\"blocked\"} %d\n"
+        "httpserver_workers{state=\"min\"} %d\n"
+        "httpserver_workers{state=\"max\"} %d\n"
+        "# HELP httpserver_pool_resizes_total Workers added because requests were waiting, and "
+        "workers retired after idling.\n"
+        "# TYPE httpserver_pool_resizes_total counter\n"
+        "httpserver_pool_resizes_total{direction=\"grow\"} %lu\n"
+        "httpserver_pool_resizes_total{direction=\"shrink\"} %lu\n",
+        ps.queued, ps.steals, ps.workers, ps.idle, ps.blocked, ps.min, ps.max, ps.grown,
+        ps.shrunk);
+    fprintf(f,
+        "# HELP httpserver_shed_total Requests answered with a 503: because they waited too "
+        "long for a worker, or because the queues had no room for them.\n"
+        "# TYPE httpserver_shed_total counter\n"
+        "httpserver_shed_total{reason=\"delay\"} %lu\n"
+        "httpserver_shed_total{reason=\"full\"} %lu\n"
+        "# HELP httpserver_overloaded Listeners whose queue waits stayed above the target for "
+        "the last interval.\n"
+        "# TYPE httpserver_overloaded gauge\n"
+        "httpserver_overloaded %d\n",
+        shed_delay, shed_full, overloaded);
+
+    fprintf(f, "# HELP httpserver_accepted_total Connections accepted, by listener.\n"
+               "# TYPE httpserver_accepted_total counter\n");
+    for (int i = 0; i < nshards; i++) {
+        fprintf(f, "httpserver_accepted_total{listener=\"%d\"} %lu\n", i,
+            reactor_accepted(shards[i].reactor));
+    }
+
+    object_cache_stats_t st;
+    object_cache_stats(cache, &st);
+    fprintf(f,
+        "# HELP httpserver_lock_table_entries URIs with requests in flight.\n"
+        "# TYPE httpserver_lock_table_entries gauge\n"
+        "httpserver_lock_table_entries %zu\n"
+        "# HELP httpserver_cache_lookups_total Object cache lookups, by result.\n"
+        "# TYPE httpserver_cache_lookups_total counter\n"
+        "httpserver_cache_lookups_total{result=\"hit\"} %lu\n"
+        "httpserver_cache_lookups_total{result=\"miss\"} %lu\n"
+        "# HELP httpserver_cache_insertions_total Objects added to the cache.\n"
+        "# TYPE httpserver_cache_insertions_total counter\n"
+        "httpserver_cache_insertions_total %lu\n"
+        "# HELP httpserver_cache_evictions_total Objects evicted to make room.\n"
+        "# TYPE httpserver_cache_evictions_total counter\n"
+        "httpserver_cache_evictions_total %lu\n"
+        "# HELP httpserver_cache_invalidations_total Objects dropped because of a PUT.\n"
+        "# TYPE httpserver_cache_invalidations_total counter\n"
+        "httpserver_cache_invalidations_total %lu\n"
+        "# HELP httpserver_cache_objects Objects in the cache.\n"
+        "# TYPE httpserver_cache_objects gauge\n"
+        "httpserver_cache_objects %lu\n"
+        "# HELP httpserver_cache_bytes Bytes of object data in the cache.\n"
+        "# TYPE httpserver_cache_bytes gauge\n"
+        "httpserver_cache_bytes %lu\n"
+        "# HELP httpserver_cache_budget_bytes How many bytes the cache may hold.\n"
+        "# TYPE httpserver_cache_budget_bytes gauge\n"
+        "httpserver_cache_budget_bytes %lu\n",
+        lock_table_size(locks), st.hits, st.misses, st.insertions, st.evictions, st.invalidations,
+        st.objects, st.bytes, st.budget);
+    if (store != NULL) {
+        store_stats_t ss;
+        store_stats(store, &ss);
+        fprintf(f,
+            "# HELP httpserver_store_objects Objects kept in the store's segments.\n"
+            "# TYPE httpserver_store_objects gauge\n"
+            "httpserver_store_objects %lu\n"
+            "# HELP httpserver_store_bytes Bytes of the store's segments, by whether the index "
+            "still points at them.\n"
+            "# TYPE httpserver_store_bytes gauge\n"
+            "httpserver_store_bytes{state=\"live\"} %lu\n"
+            "httpserver_store_bytes{state=\"dead\"} %lu\n"
+            "# HELP httpserver_store_segments Segment files.\n"
+            "# TYPE httpserver_store_segments gauge\n"
+            "httpserver_store_segments %lu\n"
+            "# HELP httpserver_store_compactions_total Segments compacted and deleted.\n"
+            "# TYPE httpserver_store_compactions_total counter\n"
+            "httpserver_store_compactions_total %lu\n",
+            ss.objects, ss.live_bytes, ss.bytes - ss.live_bytes, ss.segments, ss.compactions);
+    }
+    fclose(f);
+
+    conn_send_data(conn, text, len);
+    free(text);
 }
 
 // Function to handle unsupported requests
@@ -399,63 +941,139 @@ void handle_unsupported(conn_t *conn) {
     conn_send_response(conn, &RESPONSE_NOT_IMPLEMENTED);
 }
 
+// Function to get the calling worker's memfd for small PUT bodies, emptied
+int put_buffer(void) {
+    if (put_buffer_fd < 0) {
+        put_buffer_fd = memfd_create("put", MFD_CLOEXEC);
+    } else if (ftruncate(put_buffer_fd, 0) < 0 || lseek(put_buffer_fd, 0, SEEK_SET) < 0) {
+        return -1;
+    }
+    return put_buffer_fd;
+}
+
+// Function to set the modification time of a file that is about to replace an object to one
+// the store orders after every record it has, so that the file wins over them on startup
+bool stamp_file(int fd) {
+    int64_t ns = store_stamp(store);
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { ns / 1000000000, ns % 1000000000 } };
+    return futimens(fd, times) == 0;
+}
+
 // Function to handle a PUT request
-void handle_put(conn_t *conn, rwlockHT rwlock_HT) {
+void handle_put(conn_t *conn, lock_table_t *locks) {
     char *uri = conn_get_uri(conn);
     const Response_t *res = NULL;
+    uint16_t code = 0;
     debug("handling put request for %s", uri);
 
-    bool existed = access(uri, F_OK) == 0;
-    debug("%s existed? %d", uri, existed);
+    // The body is received without holding any lock: into memory if it is small enough for the
+    // store, or else into a temporary file next to the object; '_' can't appear in a URI, so the
+    // name can't collide with an object
+    if (strcmp(uri, METRICS_URI) == 0) {
+        audit_request(conn, "PUT", 403);
+        conn_send_response(conn, &RESPONSE_FORBIDDEN);
+        return;
+    }
+    uint64_t size = conn_get_content_length(conn);
+    bool small = store != NULL && store_admits(store, size);
+    char tmp[] = TEMP_PREFIX "XXXXXX";
+    uint64_t disk_start = metrics_now();
+    int fd = small ? put_buffer() : mkstemp(tmp);
+    metrics_observe(PHASE_DISK, metrics_now() - disk_start);
+    if (fd < 0) {
+        debug("%s: %d", tmp, errno);
+        res = errno == EACCES ? &RESPONSE_FORBIDDEN : &RESPONSE_INTERNAL_SERVER_ERROR;
+        conn_send_response(conn, res);
+        return;
+    }
+    bool temp = fd != put_buffer_fd; // whether tmp is still to be renamed or unlinked
+    res = conn_recv_file(conn, fd);
 
-    pthread_mutex_lock(&mutex);
-    rwlock_t *lock = lookup_rwlock(rwlock_HT->head, uri);
-    if (lock == NULL) {
-        lock = rwlock_new(N_WAY, 1);
-        append_rwlock_node(rwlock_HT, uri, lock);
+    // A chunked body's length isn't known until it has been received, so it always goes to a
+    // file, but may still turn out small enough for the store
+    struct stat st;
+    if (res == NULL && !small && store != NULL && fstat(fd, &st) == 0
+        && store_admits(store, (uint64_t) st.st_size)) {
+        small = true;
+        size = (uint64_t) st.st_size;
+    }
+    if (res != NULL) {
+        if (temp) {
+            close(fd);
+            unlink(tmp);
+        }
+        conn_send_response(conn, res);
+        return;
     }
-    pthread_mutex_unlock(&mutex);
-    writer_lock(lock);
 
-    int fd = open(uri, O_CREAT | O_TRUNC | O_WRONLY, 0600);
-    if (fd < 0) {
+    lock_entry_t *entry = lock_table_acquire(locks, uri);
+    if (entry == NULL) {
+        if (temp) {
+            close(fd);
+            unlink(tmp);
+        }
+        conn_send_response(conn, &RESPONSE_INTERNAL_SERVER_ERROR);
+        return;
+    }
+    rwlock_t *lock = lock_entry_rwlock(entry);
+
+    // Only publishing takes the writer lock. Appending the record, or the rename, is where the
+    // PUT takes effect, so the audit line is written here too. GETs that opened the old version
+    // keep reading it.
+    writer_lock_timed(lock);
+    object_cache_invalidate(cache, uri);
+
+    disk_start = metrics_now();
+    bool file = stat(uri, &st) == 0;
+    bool existed = file || (store != NULL && store_has(store, uri));
+    debug("%s existed? %d", uri, existed);
+    if (file && (S_ISDIR(st.st_mode) || access(uri, W_OK) != 0)) {
+        res = &RESPONSE_FORBIDDEN;
+        code = 403;
+    } else if (small) {
+        // The record supersedes the object's file, if it had one, which can go once the record
+        // is in place
+        if (store_put(store, uri, fd, size) < 0) {
+            res = &RESPONSE_INTERNAL_SERVER_ERROR;
+            code = 500;
+        } else {
+            if (file) {
+                unlink(uri);
+            }
+            res = existed ? &RESPONSE_OK : &RESPONSE_CREATED;
+            code = existed ? 200 : 201;
+        }
+    } else if (store != NULL && !stamp_file(fd)) {
+        // On startup, the store only gives way to a file modified after the URI's last record
+        res = &RESPONSE_INTERNAL_SERVER_ERROR;
+        code = 500;
+    } else if (rename(tmp, uri) < 0) {
         debug("%s: %d", uri, errno);
         if (errno == EACCES || errno == EISDIR || errno == ENOENT) {
             res = &RESPONSE_FORBIDDEN;
-            char *req = conn_get_header(conn, "Request-Id");
-            if (req == NULL)
-                req = "0";
-            fprintf(stderr, "PUT,/%s,403,%s\n", uri, req);
-            goto out;
+            code = 403;
         } else {
             res = &RESPONSE_INTERNAL_SERVER_ERROR;
-            char *req = conn_get_header(conn, "Request-Id");
-            if (req == NULL)
-                req = "0";
-            fprintf(stderr, "PUT,/%s,500,%s\n", uri, req);
-            goto out;
+            code = 500;
         }
+    } else {
+        temp = false;
+        if (store != NULL) {
+            store_drop(store, uri);
+        }
+        res = existed ? &RESPONSE_OK : &RESPONSE_CREATED;
+        code = existed ? 200 : 201;
     }
-
-    res = conn_recv_file(conn, fd);
-
-    if (res == NULL && existed) {
-        res = &RESPONSE_OK;
-        char *req = conn_get_header(conn, "Request-Id");
-        if (req == NULL)
-            req = "0";
-        fprintf(stderr, "PUT,/%s,200,%s\n", uri, req);
-    } else if (res == NULL && !existed) {
-        res = &RESPONSE_CREATED;
-        char *req = conn_get_header(conn, "Request-Id");
-        if (req == NULL)
-            req = "0";
-        fprintf(stderr, "PUT,/%s,201,%s\n", uri, req);
-    }
+    metrics_observe(PHASE_DISK, metrics_now() - disk_start);
+    audit_request(conn, "PUT", code);
 
     writer_unlock(lock);
-    close(fd);
-
-out:
+    lock_table_release(locks, entry);
+    if (fd != put_buffer_fd) {
+        close(fd);
+    }
+    if (temp) {
+        unlink(tmp);
+    }
     conn_send_response(conn, res);
 }
@@ -0,0 +1,240 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lock_table.h"
+
+#define DEFAULT_SHARDS      64
+#define INITIAL_BUCKETS     16
+#define SPARE_ENTRIES       8
+#define ENTRY_URI_SIZE      64 // room every entry has for its URI, so that spares fit most URIs
+#define CACHE_LINE_SIZE     64
+
+struct lock_entry {
+    lock_entry_t *next;
+    uint64_t hash;
+    uint32_t refs;
+    rwlock_t *rwlock;
+    size_t cap; // bytes uri has room for
+    char uri[];
+};
+
+// Each shard sits on its own cache line so that shards don't false share
+typedef struct lock_shard {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t mutex;
+    lock_entry_t **buckets;
+    size_t nbuckets;
+    size_t count;
+    lock_entry_t *spare; // released entries, with their rwlocks, for the next URIs to reuse
+    int nspare;
+} lock_shard_t;
+
+struct lock_table {
+    lock_shard_t *shards;
+    size_t nshards;
+};
+
+// Function to hash a URI (64-bit FNV-1a)
+static uint64_t hash_uri(const char *uri) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *) uri; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Function to pick the shard for a hash; buckets use the low bits, shards the high ones
+static lock_shard_t *shard_for(lock_table_t *lt, uint64_t hash) {
+    return &lt->shards[(hash >> 32) & (lt->nshards - 1)];
+}
+
+// Function to double a shard's bucket array once its load factor reaches 1
+static void grow_shard(lock_shard_t *shard) {
+    size_t nbuckets = shard->nbuckets * 2;
+    lock_entry_t **buckets = calloc(nbuckets, sizeof(lock_entry_t *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < shard->nbuckets; i++) {
+        lock_entry_t *entry = shard->buckets[i];
+        while (entry != NULL) {
+            lock_entry_t *next = entry->next;
+            size_t b = entry->hash & (nbuckets - 1);
+            entry->next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->nbuckets = nbuckets;
+}
+
+// Function to allocate an entry and its rwlock, with room for a URI of len bytes or more
+static lock_entry_t *entry_new(size_t len) {
+    size_t cap = len + 1 > ENTRY_URI_SIZE ? len + 1 : ENTRY_URI_SIZE;
+    lock_entry_t *entry = malloc(sizeof(lock_entry_t) + cap);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->rwlock = rwlock_new(N_WAY, 1);
+    if (entry->rwlock == NULL) {
+        free(entry);
+        return NULL;
+    }
+    entry->cap = cap;
+    return entry;
+}
+
+lock_table_t *lock_table_new(size_t shards) {
+    size_t nshards = 1;
+    if (shards == 0) {
+        shards = DEFAULT_SHARDS;
+    }
+    while (nshards < shards) {
+        nshards <<= 1;
+    }
+
+    lock_table_t *lt = malloc(sizeof(lock_table_t));
+    if (lt == NULL) {
+        return NULL;
+    }
+    if (posix_memalign((void **) &lt->shards, CACHE_LINE_SIZE, nshards * sizeof(lock_shard_t))
+        != 0) {
+        free(lt);
+        return NULL;
+    }
+    lt->nshards = nshards;
+    for (size_t i = 0; i < nshards; i++) {
+        lock_shard_t *shard = &lt->shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        shard->buckets = calloc(INITIAL_BUCKETS, sizeof(lock_entry_t *));
+        shard->nbuckets = INITIAL_BUCKETS;
+        shard->count = 0;
+        shard->spare = NULL;
+        shard->nspare = 0;
+        if (shard->buckets == NULL) {
+            lt->nshards = i + 1;
+            lock_table_delete(&lt);
+            return NULL;
+        }
+    }
+    return lt;
+}
+
+void lock_table_delete(lock_table_t **lt) {
+    if (lt == NULL || *lt == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < (*lt)->nshards; i++) {
+        lock_shard_t *shard = &(*lt)->shards[i];
+        for (size_t b = 0; shard->buckets != NULL && b < shard->nbuckets; b++) {
+            lock_entry_t *entry = shard->buckets[b];
+            while (entry != NULL) {
+                lock_entry_t *next = entry->next;
+                rwlock_delete(&entry->rwlock);
+                free(entry);
+                entry = next;
+            }
+        }
+        while (shard->spare != NULL) {
+            lock_entry_t *next = shard->spare->next;
+            rwlock_delete(&shard->spare->rwlock);
+            free(shard->spare);
+            shard->spare = next;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    free((*lt)->shards);
+    free(*lt);
+    *lt = NULL;
+}
+
+lock_entry_t *lock_table_acquire(lock_table_t *lt, const char *uri) {
+    uint64_t hash = hash_uri(uri);
+    lock_shard_t *shard = shard_for(lt, hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    lock_entry_t **bucket = &shard->buckets[hash & (shard->nbuckets - 1)];
+    for (lock_entry_t *entry = *bucket; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && strcmp(entry->uri, uri) == 0) {
+            entry->refs++;
+            pthread_mutex_unlock(&shard->mutex);
+            return entry;
+        }
+    }
+
+    // Most URIs in flight come and go with a single request, so their entries are recycled
+    // rather than freed and allocated again
+    size_t len = strlen(uri);
+    lock_entry_t *entry = shard->spare;
+    if (entry != NULL && entry->cap > len) {
+        shard->spare = entry->next;
+        shard->nspare--;
+    } else {
+        entry = entry_new(len);
+        if (entry == NULL) {
+            pthread_mutex_unlock(&shard->mutex);
+            return NULL;
+        }
+    }
+    memcpy(entry->uri, uri, len + 1);
+    entry->hash = hash;
+    entry->refs = 1;
+    entry->next = *bucket;
+    *bucket = entry;
+
+    if (++shard->count > shard->nbuckets) {
+        grow_shard(shard);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return entry;
+}
+
+void lock_table_release(lock_table_t *lt, lock_entry_t *entry) {
+    lock_shard_t *shard = shard_for(lt, entry->hash);
+
+    pthread_mutex_lock(&shard->mutex);
+    if (--entry->refs > 0) {
+        pthread_mutex_unlock(&shard->mutex);
+        return;
+    }
+
+    // Last reference: nobody holds or waits on the rwlock, so unlink and reclaim it
+    lock_entry_t **link = &shard->buckets[entry->hash & (shard->nbuckets - 1)];
+    while (*link != entry) {
+        link = &(*link)->next;
+    }
+    *link = entry->next;
+    shard->count--;
+
+    if (shard->nspare < SPARE_ENTRIES) {
+        entry->next = shard->spare;
+        shard->spare = entry;
+        shard->nspare++;
+        entry = NULL;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (entry != NULL) {
+        rwlock_delete(&entry->rwlock);
+        free(entry);
+    }
+}
+
+rwlock_t *lock_entry_rwlock(lock_entry_t *entry) {
+    return entry->rwlock;
+}
+
+size_t lock_table_size(lock_table_t *lt) {
+    size_t size = 0;
+    for (size_t i = 0; i < lt->nshards; i++) {
+        pthread_mutex_lock(&lt->shards[i].mutex);
+        size += lt->shards[i].count;
+        pthread_mutex_unlock(&lt->shards[i].mutex);
+    }
+    return size;
+}
@@ -0,0 +1,73 @@
+/**
+ * @File lock_table.h
+ *
+ * A sharded hash table that maps URIs to reference-counted reader/writer
+ * locks.  Entries exist only while some request holds a reference, so the
+ * table stays proportional to the number of URIs in flight rather than the
+ * number of URIs ever seen.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "rwlock.h"
+
+/** @struct lock_table_t
+ *
+ *  @brief The sharded URI -> rwlock table.
+ */
+typedef struct lock_table lock_table_t;
+
+/** @struct lock_entry_t
+ *
+ *  @brief A reference to a single URI's entry in a lock_table_t.
+ */
+typedef struct lock_entry lock_entry_t;
+
+/** @brief Dynamically allocates and initializes a new lock table.
+ *
+ *  @param shards The number of independently locked shards.  Rounded
+ *                up to a power of two; 0 selects a default.
+ *
+ *  @return a pointer to a new lock_table_t, or NULL on failure.
+ */
+lock_table_t *lock_table_new(size_t shards);
+
+/** @brief Delete the table and every rwlock it still owns.  Callers
+ *         must have released all of their references first.
+ *
+ *  @param lt the table to delete; *lt is set to NULL.
+ */
+void lock_table_delete(lock_table_t **lt);
+
+/** @brief Look up the entry for uri, creating it if it does not exist,
+ *         and take a reference to it.
+ *
+ *  @param lt the table to search.
+ *
+ *  @param uri the key.  The table keeps its own copy.
+ *
+ *  @return the entry, or NULL if memory could not be allocated.
+ */
+lock_entry_t *lock_table_acquire(lock_table_t *lt, const char *uri);
+
+/** @brief Drop a reference taken with lock_table_acquire.  When the last
+ *         reference goes away the entry and its rwlock are reclaimed, so
+ *         the caller must not hold the rwlock at this point.
+ *
+ *  @param lt the table the entry belongs to.
+ *
+ *  @param entry the entry to release.
+ */
+void lock_table_release(lock_table_t *lt, lock_entry_t *entry);
+
+/** @brief Get the rwlock that guards an entry's URI.
+ *
+ *  @param entry an entry the caller holds a reference to.
+ */
+rwlock_t *lock_entry_rwlock(lock_entry_t *entry);
+
+/** @brief Get the number of entries currently resident in the table.
+ */
+size_t lock_table_size(lock_table_t *lt);
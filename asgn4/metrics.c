@@ -0,0 +1,231 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+#define MAX_BLOCKS        256
+#define NUM_BUCKETS       25 // upper bounds 1us, 2us, 4us, ... 2^23us (about 8s), then +Inf
+#define LOCK_CONTENDED_NS 10000 // far longer than an uncontended rwlock ever takes
+#define CACHE_LINE_SIZE   64
+
+enum { METHOD_GET, METHOD_PUT, METHOD_HEAD, METHOD_OTHER, NUM_METHODS };
+
+static const char *method_names[NUM_METHODS] = { "GET", "PUT", "HEAD", "other" };
+static const char *phase_names[NUM_PHASES]
+    = { "queue_wait", "lock_wait", "disk_io", "socket_read", "socket_write", "total" };
+
+// Every status the server sends; anything else is counted under "other"
+static const uint16_t codes[] = { 200, 201, 206, 304, 400, 403, 404, 416, 500, 501, 503, 505 };
+#define NUM_CODES (sizeof(codes) / sizeof(codes[0]) + 1)
+
+typedef struct histogram {
+    _Atomic uint64_t buckets[NUM_BUCKETS];
+    _Atomic uint64_t sum_ns;
+} histogram_t;
+
+// Only the owning thread writes a block, so its counters are atomic only so that
+// metrics_write may read them while they change
+typedef struct metrics_block {
+    _Alignas(CACHE_LINE_SIZE) _Atomic bool owned;
+    histogram_t phases[NUM_PHASES];
+    _Atomic uint64_t requests[NUM_METHODS][NUM_CODES];
+    _Atomic uint64_t bytes_in;
+    _Atomic uint64_t bytes_out;
+    _Atomic int64_t connections;
+    _Atomic uint64_t lock_contended;
+} metrics_block_t;
+
+static _Atomic(metrics_block_t *) blocks[MAX_BLOCKS];
+static _Atomic int nblocks;
+static pthread_mutex_t claim_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Stands in for a thread's block once all MAX_BLOCKS are taken; shared, so its counts are
+// approximate
+static metrics_block_t overflow;
+
+static _Thread_local metrics_block_t *my_block = NULL;
+
+uint64_t metrics_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Function to find the calling thread a block, reusing one given up by an exited thread
+static metrics_block_t *claim_block(void) {
+    pthread_mutex_lock(&claim_mutex);
+    metrics_block_t *block = NULL;
+    int n = atomic_load(&nblocks);
+    for (int i = 0; i < n && block == NULL; i++) {
+        metrics_block_t *b = atomic_load(&blocks[i]);
+        if (!atomic_load(&b->owned)) {
+            block = b;
+        }
+    }
+    if (block == NULL && n < MAX_BLOCKS) {
+        block = aligned_alloc(CACHE_LINE_SIZE, sizeof(metrics_block_t));
+        if (block != NULL) {
+            memset(block, 0, sizeof(metrics_block_t));
+            atomic_store(&blocks[n], block);
+            atomic_store(&nblocks, n + 1);
+        }
+    }
+    if (block == NULL) {
+        block = &overflow;
+    }
+    atomic_store(&block->owned, true);
+    pthread_mutex_unlock(&claim_mutex);
+    return block;
+}
+
+static metrics_block_t *get_block(void) {
+    if (my_block == NULL) {
+        my_block = claim_block();
+    }
+    return my_block;
+}
+
+// Function to add to a counter that only the calling thread writes
+static void bump(_Atomic uint64_t *counter, uint64_t v) {
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static int bucket_of(uint64_t ns) {
+    uint64_t us = (ns + 999) / 1000;
+    int b = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+    return b < NUM_BUCKETS - 1 ? b : NUM_BUCKETS - 1;
+}
+
+void metrics_observe(metrics_phase_t phase, uint64_t ns) {
+    metrics_block_t *block = get_block();
+    histogram_t *h = &block->phases[phase];
+    bump(&h->buckets[bucket_of(ns)], 1);
+    bump(&h->sum_ns, ns);
+    if (phase == PHASE_LOCK && ns >= LOCK_CONTENDED_NS) {
+        bump(&block->lock_contended, 1);
+    }
+}
+
+void metrics_count_request(const char *method, uint16_t code) {
+    int m = METHOD_OTHER;
+    if (method != NULL && strcmp(method, "GET") == 0) {
+        m = METHOD_GET;
+    } else if (method != NULL && strcmp(method, "PUT") == 0) {
+        m = METHOD_PUT;
+    } else if (method != NULL && strcmp(method, "HEAD") == 0) {
+        m = METHOD_HEAD;
+    }
+    size_t c = 0;
+    while (c < NUM_CODES - 1 && codes[c] != code) {
+        c++;
+    }
+    bump(&get_block()->requests[m][c], 1);
+}
+
+void metrics_count_bytes(uint64_t in, uint64_t out) {
+    metrics_block_t *block = get_block();
+    if (in > 0) {
+        bump(&block->bytes_in, in);
+    }
+    if (out > 0) {
+        bump(&block->bytes_out, out);
+    }
+}
+
+void metrics_count_connections(int delta) {
+    _Atomic int64_t *c = &get_block()->connections;
+    atomic_store_explicit(
+        c, atomic_load_explicit(c, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+void metrics_detach(void) {
+    if (my_block != NULL && my_block != &overflow) {
+        atomic_store(&my_block->owned, false);
+    }
+    my_block = NULL;
+}
+
+// Function to sum one counter over every block
+#define SUM(total, field)                                                                          \
+    do {                                                                                           \
+        int n_ = atomic_load(&nblocks);                                                            \
+        total = atomic_load_explicit(&overflow.field, memory_order_relaxed);                       \
+        for (int i_ = 0; i_ < n_; i_++) {                                                          \
+            total += atomic_load_explicit(&atomic_load(&blocks[i_])->field, memory_order_relaxed); \
+        }                                                                                          \
+    } while (0)
+
+static void write_histogram(FILE *f, int phase) {
+    uint64_t cumulative = 0;
+    for (int b = 0; b < NUM_BUCKETS; b++) {
+        uint64_t count;
+        SUM(count, phases[phase].buckets[b]);
+        cumulative += count;
+        if (b < NUM_BUCKETS - 1) {
+            fprintf(f, "httpserver_phase_seconds_bucket{phase=\"%s\",le=\"%g\"} %lu\n",
+                phase_names[phase], (double) (1ULL << b) / 1e6, cumulative);
+        } else {
+            fprintf(f, "httpserver_phase_seconds_bucket{phase=\"%s\",le=\"+Inf\"} %lu\n",
+                phase_names[phase], cumulative);
+        }
+    }
+    uint64_t sum_ns;
+    SUM(sum_ns, phases[phase].sum_ns);
+    fprintf(f, "httpserver_phase_seconds_sum{phase=\"%s\"} %.9f\n", phase_names[phase],
+        (double) sum_ns / 1e9);
+    fprintf(f, "httpserver_phase_seconds_count{phase=\"%s\"} %lu\n", phase_names[phase],
+        cumulative);
+}
+
+void metrics_write(FILE *f) {
+    fprintf(f, "# HELP httpserver_requests_total Requests answered, by method and status.\n"
+               "# TYPE httpserver_requests_total counter\n");
+    for (int m = 0; m < NUM_METHODS; m++) {
+        for (size_t c = 0; c < NUM_CODES; c++) {
+            uint64_t count;
+            SUM(count, requests[m][c]);
+            if (count == 0) {
+                continue;
+            }
+            if (c < NUM_CODES - 1) {
+                fprintf(f, "httpserver_requests_total{method=\"%s\",code=\"%u\"} %lu\n",
+                    method_names[m], codes[c], count);
+            } else {
+                fprintf(f, "httpserver_requests_total{method=\"%s\",code=\"other\"} %lu\n",
+                    method_names[m], count);
+            }
+        }
+    }
+
+    fprintf(f, "# HELP httpserver_phase_seconds Time requests spent in each phase.\n"
+               "# TYPE httpserver_phase_seconds histogram\n");
+    for (int p = 0; p < NUM_PHASES; p++) {
+        write_histogram(f, p);
+    }
+
+    uint64_t in, out, contended;
+    int64_t connections;
+    SUM(in, bytes_in);
+    SUM(out, bytes_out);
+    SUM(contended, lock_contended);
+    SUM(connections, connections);
+    fprintf(f,
+        "# HELP httpserver_received_bytes_total Bytes read from clients.\n"
+        "# TYPE httpserver_received_bytes_total counter\n"
+        "httpserver_received_bytes_total %lu\n"
+        "# HELP httpserver_sent_bytes_total Bytes written to clients.\n"
+        "# TYPE httpserver_sent_bytes_total counter\n"
+        "httpserver_sent_bytes_total %lu\n"
+        "# HELP httpserver_open_connections Client connections currently open.\n"
+        "# TYPE httpserver_open_connections gauge\n"
+        "httpserver_open_connections %ld\n"
+        "# HELP httpserver_lock_contended_total URI lock acquisitions that waited %dus or more.\n"
+        "# TYPE httpserver_lock_contended_total counter\n"
+        "httpserver_lock_contended_total %lu\n",
+        in, out, (long) connections, LOCK_CONTENDED_NS / 1000, contended);
+}
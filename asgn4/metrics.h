@@ -0,0 +1,67 @@
+/**
+ * @File metrics.h
+ *
+ * Process-wide request metrics.  Every thread that records something gets
+ * its own block of counters and histograms, which only that thread writes
+ * (plain loads and stores, no locked instructions), so recording costs a
+ * few cache-local adds.  metrics_write sums the blocks when someone asks,
+ * which is the only time the other threads' blocks are read.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief The parts of a request whose time is tracked.
+ *
+ *  PHASE_QUEUE: waiting in the worker queue after the reactor parsed it.
+ *  PHASE_LOCK:  waiting for the URI's rwlock.
+ *  PHASE_DISK:  opening, reading, creating and renaming files.
+ *  PHASE_RECV:  reading a PUT body off the socket into its file.
+ *  PHASE_SEND:  writing the response, including a GET's file contents.
+ *  PHASE_TOTAL: the whole request, from the worker picking it up.
+ */
+typedef enum {
+    PHASE_QUEUE,
+    PHASE_LOCK,
+    PHASE_DISK,
+    PHASE_RECV,
+    PHASE_SEND,
+    PHASE_TOTAL,
+    NUM_PHASES
+} metrics_phase_t;
+
+/** @brief Get the monotonic clock in nanoseconds, for timing phases.
+ */
+uint64_t metrics_now(void);
+
+/** @brief Record that the calling thread spent ns nanoseconds in phase.
+ *         Lock waits of LOCK_CONTENDED_NS or more also count as contended
+ *         acquisitions.
+ */
+void metrics_observe(metrics_phase_t phase, uint64_t ns);
+
+/** @brief Count a finished request by method and status code.
+ *
+ *  @param method "GET", "PUT", "HEAD", or NULL for anything else.
+ */
+void metrics_count_request(const char *method, uint16_t code);
+
+/** @brief Count bytes read from and written to client sockets.
+ */
+void metrics_count_bytes(uint64_t in, uint64_t out);
+
+/** @brief Count connections opened (+1) or closed (-1).
+ */
+void metrics_count_connections(int delta);
+
+/** @brief Give up the calling thread's block, e.g. before the thread
+ *         exits.  What it recorded still counts; the next thread to
+ *         record something may reuse the block.
+ */
+void metrics_detach(void);
+
+/** @brief Write every metric in the Prometheus text format.
+ */
+void metrics_write(FILE *f);
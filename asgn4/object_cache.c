@@ -0,0 +1,297 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gzip.h"
+#include "object_cache.h"
+
+#define INITIAL_BUCKETS 256
+#define ADMIT_FRACTION  16 // objects above budget / ADMIT_FRACTION are not cached
+
+struct object {
+    object_t *next; // hash chain
+    object_t *clock_prev;
+    object_t *clock_next;
+    uint64_t hash;
+    _Atomic uint32_t refs; // one for the cache while resident, one per caller
+    bool referenced; // CLOCK's second-chance bit
+    bool resident; // in the table, and charged against the budget
+    char *data;
+    uint64_t size;
+    _Atomic(char *) gzip; // the data gzip-compressed, once a client has asked for that
+    uint64_t gzip_size;
+    uint64_t charge; // what the object counts against the budget
+    validator_t validator;
+    char uri[];
+};
+
+struct object_cache {
+    pthread_mutex_t mutex;
+    object_t **buckets;
+    size_t nbuckets;
+    object_t *hand; // CLOCK hand; new objects go in just behind it
+    uint64_t budget;
+    object_cache_stats_t stats;
+};
+
+// Function to hash a URI (64-bit FNV-1a)
+static uint64_t hash_uri(const char *uri) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *) uri; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void free_object(object_t *obj) {
+    free(obj->data);
+    free(atomic_load_explicit(&obj->gzip, memory_order_relaxed));
+    free(obj);
+}
+
+void object_cache_release(object_cache_t *cache, object_t *obj) {
+    (void) cache;
+    if (obj != NULL && atomic_fetch_sub(&obj->refs, 1) == 1) {
+        free_object(obj);
+    }
+}
+
+const char *object_data(object_t *obj) {
+    return obj->data;
+}
+
+uint64_t object_size(object_t *obj) {
+    return obj->size;
+}
+
+const validator_t *object_validator(object_t *obj) {
+    return &obj->validator;
+}
+
+// Function to find a URI's object; call with the mutex held
+static object_t **find(object_cache_t *cache, const char *uri, uint64_t hash) {
+    object_t **link = &cache->buckets[hash & (cache->nbuckets - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->uri, uri) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Function to take an object out of the table and the CLOCK ring and drop the cache's reference
+static void unlink_object(object_cache_t *cache, object_t **link) {
+    object_t *obj = *link;
+    *link = obj->next;
+    obj->resident = false;
+    if (obj->clock_next == obj) {
+        cache->hand = NULL;
+    } else {
+        obj->clock_prev->clock_next = obj->clock_next;
+        obj->clock_next->clock_prev = obj->clock_prev;
+        if (cache->hand == obj) {
+            cache->hand = obj->clock_next;
+        }
+    }
+    cache->stats.objects--;
+    cache->stats.bytes -= obj->charge;
+    object_cache_release(cache, obj);
+}
+
+// Function to advance the hand until it finds an object that was not used since its last visit
+static void evict_one(object_cache_t *cache) {
+    while (cache->hand->referenced) {
+        cache->hand->referenced = false;
+        cache->hand = cache->hand->clock_next;
+    }
+    object_t *victim = cache->hand;
+    unlink_object(cache, find(cache, victim->uri, victim->hash));
+    cache->stats.evictions++;
+}
+
+static void grow(object_cache_t *cache) {
+    size_t nbuckets = cache->nbuckets * 2;
+    object_t **buckets = calloc(nbuckets, sizeof(object_t *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < cache->nbuckets; i++) {
+        object_t *obj = cache->buckets[i];
+        while (obj != NULL) {
+            object_t *next = obj->next;
+            size_t b = obj->hash & (nbuckets - 1);
+            obj->next = buckets[b];
+            buckets[b] = obj;
+            obj = next;
+        }
+    }
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->nbuckets = nbuckets;
+}
+
+object_cache_t *object_cache_new(size_t budget) {
+    object_cache_t *cache = calloc(1, sizeof(object_cache_t));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->buckets = calloc(INITIAL_BUCKETS, sizeof(object_t *));
+    if (cache->buckets == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->nbuckets = INITIAL_BUCKETS;
+    cache->budget = budget;
+    cache->stats.budget = budget;
+    pthread_mutex_init(&cache->mutex, NULL);
+    return cache;
+}
+
+void object_cache_delete(object_cache_t **cache) {
+    if (cache == NULL || *cache == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < (*cache)->nbuckets; i++) {
+        while ((*cache)->buckets[i] != NULL) {
+            unlink_object(*cache, &(*cache)->buckets[i]);
+        }
+    }
+    free((*cache)->buckets);
+    pthread_mutex_destroy(&(*cache)->mutex);
+    free(*cache);
+    *cache = NULL;
+}
+
+int object_cache_admits(object_cache_t *cache, uint64_t size) {
+    return size <= cache->budget / ADMIT_FRACTION;
+}
+
+object_t *object_cache_get(object_cache_t *cache, const char *uri) {
+    if (cache->budget == 0) {
+        return NULL;
+    }
+    uint64_t hash = hash_uri(uri);
+    pthread_mutex_lock(&cache->mutex);
+    object_t *obj = *find(cache, uri, hash);
+    if (obj != NULL) {
+        obj->referenced = true;
+        atomic_fetch_add(&obj->refs, 1);
+        cache->stats.hits++;
+    } else {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return obj;
+}
+
+object_t *object_cache_put(object_cache_t *cache, const char *uri, char *data, uint64_t size,
+    const validator_t *validator) {
+    size_t urilen = strlen(uri);
+    object_t *obj = malloc(sizeof(object_t) + urilen + 1);
+    if (obj == NULL) {
+        free(data);
+        return NULL;
+    }
+    memcpy(obj->uri, uri, urilen + 1);
+    obj->hash = hash_uri(uri);
+    obj->data = data;
+    obj->size = size;
+    atomic_init(&obj->gzip, NULL);
+    obj->gzip_size = 0;
+    obj->charge = sizeof(object_t) + urilen + 1 + size;
+    obj->validator = *validator;
+    obj->referenced = false;
+    obj->resident = false;
+    atomic_init(&obj->refs, 1);
+    if (!object_cache_admits(cache, size)) {
+        return obj; // the caller's reference is the only one
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+    object_t **link = find(cache, uri, obj->hash);
+    if (*link != NULL) {
+        unlink_object(cache, link);
+        link = find(cache, uri, obj->hash);
+    }
+    while (cache->hand != NULL && cache->stats.bytes + obj->charge > cache->budget) {
+        evict_one(cache);
+        link = find(cache, uri, obj->hash);
+    }
+
+    atomic_fetch_add(&obj->refs, 1);
+    obj->resident = true;
+    obj->next = *link;
+    *link = obj;
+    if (cache->hand == NULL) {
+        obj->clock_prev = obj->clock_next = obj;
+        cache->hand = obj;
+    } else {
+        obj->clock_next = cache->hand;
+        obj->clock_prev = cache->hand->clock_prev;
+        obj->clock_prev->clock_next = obj;
+        cache->hand->clock_prev = obj;
+    }
+    cache->stats.objects++;
+    cache->stats.bytes += obj->charge;
+    cache->stats.insertions++;
+    if (cache->stats.objects > cache->nbuckets) {
+        grow(cache);
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    return obj;
+}
+
+const char *object_gzip(object_cache_t *cache, object_t *obj, uint64_t *size) {
+    char *gzip = atomic_load_explicit(&obj->gzip, memory_order_acquire);
+    if (gzip != NULL) {
+        *size = obj->gzip_size;
+        return gzip;
+    }
+
+    // Compressing happens outside the mutex; if another thread got there first, its copy is kept
+    uint64_t gzip_size;
+    gzip = gzip_compress(obj->data, obj->size, GZIP_CACHE_LEVEL, &gzip_size);
+    if (gzip == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache->mutex);
+    char *kept = atomic_load_explicit(&obj->gzip, memory_order_relaxed);
+    if (kept != NULL) {
+        free(gzip);
+        gzip = kept;
+    } else {
+        obj->gzip_size = gzip_size;
+        atomic_store_explicit(&obj->gzip, gzip, memory_order_release);
+        if (obj->resident) {
+            obj->charge += gzip_size;
+            cache->stats.bytes += gzip_size;
+            while (cache->hand != NULL && cache->stats.bytes > cache->budget) {
+                evict_one(cache);
+            }
+        }
+    }
+    *size = obj->gzip_size;
+    pthread_mutex_unlock(&cache->mutex);
+    return gzip;
+}
+
+void object_cache_invalidate(object_cache_t *cache, const char *uri) {
+    if (cache->budget == 0) {
+        return;
+    }
+    uint64_t hash = hash_uri(uri);
+    pthread_mutex_lock(&cache->mutex);
+    object_t **link = find(cache, uri, hash);
+    if (*link != NULL) {
+        unlink_object(cache, link);
+        cache->stats.invalidations++;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void object_cache_stats(object_cache_t *cache, object_cache_stats_t *stats) {
+    pthread_mutex_lock(&cache->mutex);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,118 @@
+/**
+ * @File object_cache.h
+ *
+ * A memory-bounded cache of object contents keyed by URI, evicted with
+ * the CLOCK (second chance) algorithm.  The cache knows nothing about the
+ * per-URI rwlocks: callers fill it only while holding a URI's reader lock
+ * and invalidate it while holding the writer lock, which is what keeps
+ * readers from seeing stale contents.
+ *
+ * Objects are reference counted, so an object that is evicted or
+ * invalidated while a response is still being sent from it stays valid
+ * until that sender releases it.
+ *
+ * An object also keeps a gzip-compressed copy of its contents once a
+ * client has asked for one, so hot objects are compressed only once.  The
+ * copy goes with the object, so invalidating the object drops it too.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "validator.h"
+
+/** @struct object_cache_t
+ *
+ *  @brief The cache: a hash table of objects and the CLOCK ring.
+ */
+typedef struct object_cache object_cache_t;
+
+/** @struct object_t
+ *
+ *  @brief The contents of one object.
+ */
+typedef struct object object_t;
+
+/** @brief Counters describing how well the cache is doing.
+ */
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t objects;
+    uint64_t bytes;
+    uint64_t budget;
+} object_cache_stats_t;
+
+/** @brief Creates a cache that holds at most budget bytes.  Objects
+ *         larger than a sixteenth of the budget are never cached.
+ *
+ *  @return a pointer to a new object_cache_t, or NULL on failure.
+ */
+object_cache_t *object_cache_new(size_t budget);
+
+/** @brief Free the cache; *cache is set to NULL.  Objects still held
+ *         by callers are freed when they are released.
+ */
+void object_cache_delete(object_cache_t **cache);
+
+/** @brief Whether an object of the given size would be cached, i.e.
+ *         whether it is worth reading it into memory on a miss.
+ */
+int object_cache_admits(object_cache_t *cache, uint64_t size);
+
+/** @brief Look up a URI.  Call with the URI's lock held.
+ *
+ *  @return the object, which the caller must release, or NULL on a miss.
+ */
+object_t *object_cache_get(object_cache_t *cache, const char *uri);
+
+/** @brief Cache the contents of a URI, with the validators of the
+ *         version they are, replacing any older copy.  Call with the
+ *         URI's reader (or writer) lock held.  The cache takes ownership
+ *         of data, which must come from malloc.
+ *
+ *  @return the new object, which the caller must release, or NULL (and
+ *          data is freed) if there is no memory for it.
+ */
+object_t *object_cache_put(object_cache_t *cache, const char *uri, char *data, uint64_t size,
+    const validator_t *validator);
+
+/** @brief Get an object's contents gzip-compressed, compressing them the
+ *         first time they are asked for.  While the object is cached, the
+ *         compressed copy counts against the budget too.
+ *
+ *  @return the compressed contents, with their length in *size, or NULL
+ *          if there is no memory to compress them.
+ */
+const char *object_gzip(object_cache_t *cache, object_t *obj, uint64_t *size);
+
+/** @brief Drop a URI's cached contents.  Call with the URI's writer
+ *         lock held.
+ */
+void object_cache_invalidate(object_cache_t *cache, const char *uri);
+
+/** @brief Release an object obtained from object_cache_get or
+ *         object_cache_put.
+ */
+void object_cache_release(object_cache_t *cache, object_t *obj);
+
+/** @brief Get an object's contents.
+ */
+const char *object_data(object_t *obj);
+
+/** @brief Get an object's size in bytes.
+ */
+uint64_t object_size(object_t *obj);
+
+/** @brief Get the validators of the version an object holds.
+ */
+const validator_t *object_validator(object_t *obj);
+
+/** @brief Take a snapshot of the cache's counters.
+ */
+void object_cache_stats(object_cache_t *cache, object_cache_stats_t *stats);
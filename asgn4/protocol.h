@@ -14,3 +14,10 @@
 #define HEADER_FIELD_REGEX KEY_REGEX ": " VALUE_REGEX EMPTY_LINE_REGEX
 
 #define MAX_HEADER_LENGTH 2048
+
+// The same limits for http_parser.c, which must accept exactly what the regexes match
+#define MAX_METHOD_LENGTH 8
+#define MAX_URI_LENGTH    63
+#define MAX_KEY_LENGTH    128
+#define MAX_VALUE_LENGTH  128
+#define VERSION_LENGTH    8
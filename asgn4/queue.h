@@ -3,6 +3,9 @@
  *
  * The header file that you need to implement for assignment 3.
  *
+ * The queue is a bounded lock-free MPMC ring; threads only sleep when it
+ * is empty (poppers) or full (pushers).
+ *
  * @author Andrew Quinn
  */
 
@@ -22,7 +25,8 @@ typedef struct queue queue_t;
 /** @brief Dynamically allocates and initializes a new queue with a
  *         maximum size, size
  *
- *  @param size the maximum size of the queue
+ *  @param size the maximum size of the queue (rounded up to a power of
+ *  two, and to at least two)
  *
  *  @return a pointer to a new queue_t
  */
@@ -58,3 +62,54 @@ bool queue_push(queue_t *q, void *elem);
  *          should succeed unless the q parameter is NULL.
  */
 bool queue_pop(queue_t *q, void **elem);
+
+/** @brief push an element onto a queue if there is room, without
+ *         blocking.
+ *
+ *  @return true if the element was pushed, false if the queue was full
+ *          (or q is NULL).
+ */
+bool queue_try_push(queue_t *q, void *elem);
+
+/** @brief pop an element from a queue if there is one, without
+ *         blocking.
+ *
+ *  @return true if an element was popped, false if the queue was empty
+ *          (or q is NULL).
+ */
+bool queue_try_pop(queue_t *q, void **elem);
+
+/** @brief push an element onto a queue, waiting at most timeout_ms
+ *         milliseconds for room.
+ *
+ *  @return true if the element was pushed, false on timeout.
+ */
+bool queue_push_timed(queue_t *q, void *elem, int timeout_ms);
+
+/** @brief pop an element from a queue, waiting at most timeout_ms
+ *         milliseconds for one.
+ *
+ *  @return true if an element was popped, false on timeout.
+ */
+bool queue_pop_timed(queue_t *q, void **elem, int timeout_ms);
+
+/** @brief push n elements onto a queue, blocking until all of them are
+ *         in.  Elements that fit are pushed together, so a batch costs
+ *         about as much as a single push.
+ *
+ *  @return n, or -1 if q is NULL.
+ */
+int queue_push_n(queue_t *q, void **elems, int n);
+
+/** @brief pop up to max elements from a queue, blocking until there is
+ *         at least one.
+ *
+ *  @return the number of elements popped, or -1 if q is NULL.
+ */
+int queue_pop_n(queue_t *q, void **elems, int max);
+
+/** @brief Get the number of elements in a queue.  Other threads may
+ *         change it at any moment, so this is only a snapshot, e.g. for
+ *         monitoring.
+ */
+int queue_size(queue_t *q);
@@ -0,0 +1,86 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "range.h"
+
+// Function to read a decimal number at *s, saturating instead of overflowing
+static bool parse_number(const char **s, uint64_t *value) {
+    const char *p = *s;
+    uint64_t v = 0;
+    while (*p >= '0' && *p <= '9') {
+        uint64_t digit = (uint64_t) (*p - '0');
+        v = v > (UINT64_MAX - digit) / 10 ? UINT64_MAX : v * 10 + digit;
+        p++;
+    }
+    if (p == *s) {
+        return false;
+    }
+    *s = p;
+    *value = v;
+    return true;
+}
+
+static const char *skip_spaces(const char *s) {
+    while (*s == ' ' || *s == '\t') {
+        s++;
+    }
+    return s;
+}
+
+int range_parse(const char *value, uint64_t size, byte_range_t *ranges) {
+    if (strncmp(value, "bytes=", 6) != 0) {
+        return -1;
+    }
+    const char *s = value + 6;
+    int specs = 0, n = 0;
+    for (;;) {
+        s = skip_spaces(s);
+        if (*s == ',') {
+            s++;
+            continue;
+        }
+        if (*s == '\0') {
+            break;
+        }
+        if (++specs > RANGE_MAX) {
+            return -1;
+        }
+
+        uint64_t first, last = UINT64_MAX;
+        if (*s == '-') {
+            // "-n" is the last n bytes
+            s++;
+            uint64_t suffix;
+            if (!parse_number(&s, &suffix)) {
+                return -1;
+            }
+            if (suffix == 0 || size == 0) {
+                first = UINT64_MAX;
+            } else {
+                first = suffix < size ? size - suffix : 0;
+            }
+        } else {
+            // "a-b", or "a-" for everything from a on
+            if (!parse_number(&s, &first) || *s++ != '-') {
+                return -1;
+            }
+            if (*s >= '0' && *s <= '9') {
+                parse_number(&s, &last);
+                if (last < first) {
+                    return -1;
+                }
+            }
+        }
+        if (first < size) {
+            ranges[n].first = first;
+            ranges[n].last = last < size ? last : size - 1;
+            n++;
+        }
+
+        s = skip_spaces(s);
+        if (*s != ',' && *s != '\0') {
+            return -1;
+        }
+    }
+    return specs == 0 ? -1 : n;
+}
@@ -0,0 +1,31 @@
+/**
+ * @File range.h
+ *
+ * Byte ranges, as a client asks for them in a "Range: bytes=..." header
+ * (RFC 9110, section 14), resolved against the size of the object.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define RANGE_MAX 16 // a header asking for more ranges than this is ignored
+
+/** @brief An inclusive range of byte offsets, first <= last.
+ */
+typedef struct byte_range {
+    uint64_t first;
+    uint64_t last;
+} byte_range_t;
+
+/** @brief Parse a Range header value for an object of size bytes.
+ *         Ranges that start past the end are dropped, and ranges that run
+ *         past it are cut short, so every range returned lies within the
+ *         object.  They are returned in the order asked for.
+ *
+ *  @return how many ranges were stored in ranges (at most RANGE_MAX), 0
+ *          if none of them is satisfiable (416), or -1 if the header
+ *          should be ignored and the whole object sent: it isn't in bytes,
+ *          is malformed, or asks for more than RANGE_MAX ranges.
+ */
+int range_parse(const char *value, uint64_t size, byte_range_t *ranges);
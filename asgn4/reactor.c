@@ -0,0 +1,411 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "metrics.h"
+#include "reactor.h"
+
+#define MAX_EVENTS 256
+#define TICK_MS    500
+#define SWEEP_MS   100 // how often to look for requests stuck in the queues
+#define RECYCLED   MAX_EVENTS // spare pending_ts kept for reactor_resume
+
+// A connection whose request is still being read, on the idle list in activity order
+typedef struct pending {
+    conn_t *conn;
+    int fd;
+    uint64_t last_active;
+    struct pending *prev;
+    struct pending *next;
+} pending_t;
+
+struct reactor {
+    int epfd;
+    Listener_Socket *sock;
+    worker_pool_t *pool;
+    admission_t *admission;
+    int idle_ms;
+    int wait_ms; // for room in the workers' queues, before shedding; -1 never sheds
+    uint64_t last_sweep; // ms
+    pending_t *oldest;
+    pending_t *newest;
+    int wakefd; // eventfd that workers poke after adding to resumed
+    pthread_mutex_t mutex;
+    pending_t *resumed;
+    pending_t *recycled; // spares for reactor_resume, under mutex
+    int nrecycled;
+    pending_t *spare; // spares for the reactor thread; refills recycled
+    conn_t *ready[MAX_EVENTS]; // parsed requests, handed to the workers once per epoll_wait
+    int nready;
+    _Atomic uint64_t accepted;
+    _Atomic uint64_t shed;
+};
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+static void set_nonblocking(int fd, int on) {
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, on ? flags | O_NONBLOCK : flags & ~O_NONBLOCK);
+}
+
+static void idle_unlink(reactor_t *r, pending_t *p) {
+    if (p->prev) {
+        p->prev->next = p->next;
+    } else {
+        r->oldest = p->next;
+    }
+    if (p->next) {
+        p->next->prev = p->prev;
+    } else {
+        r->newest = p->prev;
+    }
+    p->prev = p->next = NULL;
+}
+
+static void idle_append(reactor_t *r, pending_t *p) {
+    p->last_active = now_ms();
+    p->prev = r->newest;
+    p->next = NULL;
+    if (r->newest) {
+        r->newest->next = p;
+    } else {
+        r->oldest = p;
+    }
+    r->newest = p;
+}
+
+// Function to get a pending_t on the reactor thread.  A connection needs one each time it goes
+// back to waiting for a request, so they are recycled rather than allocated per request.
+static pending_t *pending_get(reactor_t *r) {
+    pending_t *p = r->spare;
+    if (p == NULL) {
+        return malloc(sizeof(pending_t));
+    }
+    r->spare = p->next;
+    return p;
+}
+
+// Function to keep a pending_t the reactor thread is done with for the next pending_get
+static void pending_put(reactor_t *r, pending_t *p) {
+    p->next = r->spare;
+    r->spare = p;
+}
+
+// Function to free a list of pending_ts linked through next
+static void pending_free(pending_t *p) {
+    while (p != NULL) {
+        pending_t *next = p->next;
+        free(p);
+        p = next;
+    }
+}
+
+// Function to drop a connection the reactor still owns
+static void close_pending(reactor_t *r, pending_t *p) {
+    idle_unlink(r, p);
+    close(p->fd);
+    metrics_count_connections(-1);
+    conn_delete(&p->conn);
+    pending_put(r, p);
+}
+
+// Function to start watching a connection for its next bytes
+static void watch(reactor_t *r, pending_t *p) {
+    set_nonblocking(p->fd, 1);
+    idle_append(r, p);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = p };
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, p->fd, &ev) < 0) {
+        close_pending(r, p);
+    }
+}
+
+// Function to accept every connection the listener has queued
+static void accept_all(reactor_t *r) {
+    for (;;) {
+        int fd = listener_accept(r->sock);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                debug("accept: %d", errno);
+            }
+            return;
+        }
+        pending_t *p = pending_get(r);
+        conn_t *conn = conn_new(fd);
+        if (p == NULL || conn == NULL) {
+            if (p != NULL) {
+                pending_put(r, p);
+            }
+            conn_delete(&conn);
+            close(fd);
+            continue;
+        }
+        // Workers block on the socket once it is theirs, so bound how long a read can stall
+        struct timeval timeout
+            = { .tv_sec = r->idle_ms / 1000, .tv_usec = (r->idle_ms % 1000) * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        // Responses go out as a head write and a body write; on a kept-alive connection
+        // Nagle would hold the body back until the client's delayed ACK
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        metrics_count_connections(1);
+        atomic_store_explicit(&r->accepted,
+            atomic_load_explicit(&r->accepted, memory_order_relaxed) + 1, memory_order_relaxed);
+        p->conn = conn;
+        p->fd = fd;
+        watch(r, p);
+    }
+}
+
+// Function to start watching the connections that workers handed back
+static void take_resumed(reactor_t *r) {
+    uint64_t count;
+    if (read(r->wakefd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        debug("eventfd: %d", errno);
+    }
+    pthread_mutex_lock(&r->mutex);
+    pending_t *p = r->resumed;
+    r->resumed = NULL;
+    while (r->nrecycled < RECYCLED && r->spare != NULL) {
+        pending_t *spare = r->spare;
+        r->spare = spare->next;
+        spare->next = r->recycled;
+        r->recycled = spare;
+        r->nrecycled++;
+    }
+    pthread_mutex_unlock(&r->mutex);
+    while (p != NULL) {
+        pending_t *next = p->next;
+        watch(r, p);
+        p = next;
+    }
+}
+
+void reactor_resume(reactor_t *r, conn_t *conn) {
+    pthread_mutex_lock(&r->mutex);
+    pending_t *p = r->recycled;
+    if (p != NULL) {
+        r->recycled = p->next;
+        r->nrecycled--;
+    } else if ((p = malloc(sizeof(pending_t))) == NULL) {
+        pthread_mutex_unlock(&r->mutex);
+        close(conn_get_fd(conn));
+        conn_delete(&conn);
+        metrics_count_connections(-1);
+        return;
+    }
+    p->conn = conn;
+    p->fd = conn_get_fd(conn);
+    p->prev = NULL;
+    p->next = r->resumed;
+    r->resumed = p;
+    pthread_mutex_unlock(&r->mutex);
+    uint64_t one = 1;
+    if (write(r->wakefd, &one, sizeof(one)) < 0) {
+        debug("eventfd: %d", errno);
+    }
+}
+
+// Function to read from a connection and hand it off once its request is parsed
+static void on_readable(reactor_t *r, pending_t *p) {
+    switch (conn_fill(p->conn)) {
+    case CONN_PENDING:
+        idle_unlink(r, p);
+        idle_append(r, p);
+        break;
+    case CONN_READY:
+        epoll_ctl(r->epfd, EPOLL_CTL_DEL, p->fd, NULL);
+        idle_unlink(r, p);
+        set_nonblocking(p->fd, 0);
+        r->ready[r->nready++] = p->conn;
+        pending_put(r, p);
+        break;
+    case CONN_CLOSED: close_pending(r, p); break;
+    }
+}
+
+reactor_t *reactor_new(Listener_Socket *sock, worker_pool_t *pool, admission_t *admission,
+    int idle_ms, int wait_ms) {
+    reactor_t *r = malloc(sizeof(reactor_t));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    r->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    r->sock = sock;
+    r->pool = pool;
+    r->admission = admission;
+    r->idle_ms = idle_ms;
+    r->wait_ms = wait_ms;
+    r->last_sweep = 0;
+    r->oldest = NULL;
+    r->newest = NULL;
+    r->resumed = NULL;
+    r->recycled = NULL;
+    r->nrecycled = 0;
+    r->spare = NULL;
+    r->nready = 0;
+    atomic_init(&r->accepted, 0);
+    atomic_init(&r->shed, 0);
+    pthread_mutex_init(&r->mutex, NULL);
+
+    // The listener is tagged with NULL and the eventfd with the reactor itself
+    set_nonblocking(sock->fd, 1);
+    struct epoll_event listen_ev = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event wake_ev = { .events = EPOLLIN, .data.ptr = r };
+    if (r->epfd < 0 || r->wakefd < 0
+        || epoll_ctl(r->epfd, EPOLL_CTL_ADD, sock->fd, &listen_ev) < 0
+        || epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wakefd, &wake_ev) < 0) {
+        reactor_delete(&r);
+        return NULL;
+    }
+    return r;
+}
+
+void reactor_delete(reactor_t **r) {
+    if (r == NULL || *r == NULL) {
+        return;
+    }
+    while ((*r)->oldest != NULL) {
+        close_pending(*r, (*r)->oldest);
+    }
+    while ((*r)->resumed != NULL) {
+        pending_t *next = (*r)->resumed->next;
+        close((*r)->resumed->fd);
+        metrics_count_connections(-1);
+        conn_delete(&(*r)->resumed->conn);
+        free((*r)->resumed);
+        (*r)->resumed = next;
+    }
+    pending_free((*r)->recycled);
+    pending_free((*r)->spare);
+    if ((*r)->epfd >= 0) {
+        close((*r)->epfd);
+    }
+    if ((*r)->wakefd >= 0) {
+        close((*r)->wakefd);
+    }
+    pthread_mutex_destroy(&(*r)->mutex);
+    free(*r);
+    *r = NULL;
+}
+
+uint64_t reactor_accepted(reactor_t *r) {
+    return atomic_load_explicit(&r->accepted, memory_order_relaxed);
+}
+
+uint64_t reactor_shed(reactor_t *r) {
+    return atomic_load_explicit(&r->shed, memory_order_relaxed);
+}
+
+// Function to turn away a request with a 503, counting it as one the queues had no room for
+// if full.  The socket is made non-blocking again first, so a client that isn't reading loses
+// its connection rather than holding up the reactor.  Otherwise the connection is kept, as
+// after any other response; closing it would only make the client reconnect.
+static void shed(reactor_t *r, conn_t *conn, bool full) {
+    int fd = conn_get_fd(conn);
+    set_nonblocking(fd, 1);
+    bool sent = conn_send_response(conn, &RESPONSE_SERVICE_UNAVAILABLE) == NULL;
+    metrics_count_request(conn_get_method(conn), 503);
+    if (full) {
+        atomic_store_explicit(&r->shed, atomic_load_explicit(&r->shed, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+    }
+
+    // A pipelined request behind this one would need handing out too; it is rare enough to
+    // just drop the connection
+    pending_t *p = NULL;
+    if (sent && conn_keep_alive(conn) && conn_next(conn) == CONN_PENDING) {
+        p = pending_get(r);
+    }
+    if (p == NULL) {
+        close(fd);
+        conn_delete(&conn);
+        metrics_count_connections(-1);
+        return;
+    }
+    p->conn = conn;
+    p->fd = fd;
+    watch(r, p);
+}
+
+// Function to take back the requests still queued for the workers, turn away the ones that
+// have waited too long, and queue the rest again
+static void sweep(reactor_t *r) {
+    conn_t *queued[MAX_EVENTS];
+    int n = worker_pool_reclaim(r->pool, (void **) queued, MAX_EVENTS);
+    uint64_t now = metrics_now();
+    int kept = 0;
+    for (int i = 0; i < n; i++) {
+        if (admission_expired(r->admission, now - conn_get_queued_at(queued[i]))) {
+            shed(r, queued[i], false);
+        } else {
+            queued[kept++] = queued[i];
+        }
+    }
+    int taken = worker_pool_submit_n(r->pool, (void **) queued, kept, 0);
+    for (int i = taken; i < kept; i++) {
+        shed(r, queued[i], true);
+    }
+    r->last_sweep = now_ms();
+}
+
+void reactor_run(reactor_t *r) {
+    struct epoll_event events[MAX_EVENTS];
+    for (;;) {
+        int n = epoll_wait(r->epfd, events, MAX_EVENTS, r->wait_ms < 0 ? TICK_MS : SWEEP_MS);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                accept_all(r);
+            } else if (events[i].data.ptr == r) {
+                take_resumed(r);
+            } else {
+                on_readable(r, events[i].data.ptr);
+            }
+        }
+        if (r->nready > 0) {
+            uint64_t now = metrics_now();
+            for (int i = 0; i < r->nready; i++) {
+                conn_set_queued_at(r->ready[i], now);
+            }
+            int taken = worker_pool_submit_n(r->pool, (void **) r->ready, r->nready, r->wait_ms);
+            if (taken < r->nready) {
+                // The queues stayed full all along; make room by turning away what waited in
+                // them too long, and only then what still doesn't fit
+                sweep(r);
+                taken += worker_pool_submit_n(
+                    r->pool, (void **) r->ready + taken, r->nready - taken, 0);
+            }
+            for (int i = taken; i < r->nready; i++) {
+                shed(r, r->ready[i], true);
+            }
+            r->nready = 0;
+        }
+        if (r->wait_ms >= 0 && now_ms() - r->last_sweep >= SWEEP_MS) {
+            sweep(r);
+        }
+
+        // The idle list is in activity order, so expired connections are at its front
+        uint64_t now = now_ms();
+        while (r->oldest != NULL && now - r->oldest->last_active >= (uint64_t) r->idle_ms) {
+            close_pending(r, r->oldest);
+        }
+    }
+}
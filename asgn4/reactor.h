@@ -0,0 +1,66 @@
+/**
+ * @File reactor.h
+ *
+ * The server's front end: a thread that accepts connections from one
+ * listener and reads their requests with non-blocking I/O and epoll, so
+ * that idle or slow clients cost a few kilobytes of memory rather than a
+ * worker thread.  Only parsed requests are handed to the worker pool, and
+ * workers give kept-alive connections back with reactor_resume.  With
+ * several SO_REUSEPORT listeners, each gets its own reactor.
+ *
+ * If the workers' queues stay full for too long, the reactor stops
+ * waiting for room: it answers the requests that didn't fit with a 503
+ * itself, and goes back to its other connections.  It also looks through
+ * the queues now and then for requests that have waited longer than the
+ * admission control allows; a worker would shed them when it took them,
+ * but if every worker is stuck, none will.
+ */
+
+#pragma once
+
+#include "admission.h"
+#include "asgn2_helper_funcs.h"
+#include "connection.h"
+#include "worker_pool.h"
+
+/** @struct reactor_t
+ *
+ *  @brief The epoll loop and the connections it is still reading from.
+ */
+typedef struct reactor reactor_t;
+
+/** @brief Creates a reactor that accepts from sock and submits ready
+ *         conn_t pointers to pool, whose workers shed with admission.
+ *
+ *  @param idle_ms how long a connection may go without sending anything,
+ *                 whether mid-request or kept alive between requests.
+ *  @param wait_ms how long to wait for room in the queues before shedding
+ *                 requests, or -1 to wait for as long as it takes.
+ *
+ *  @return a pointer to a new reactor_t, or NULL on failure.
+ */
+reactor_t *reactor_new(Listener_Socket *sock, worker_pool_t *pool, admission_t *admission,
+    int idle_ms, int wait_ms);
+
+/** @brief Delete the reactor, closing the connections it still owns.
+ */
+void reactor_delete(reactor_t **r);
+
+/** @brief Hand a kept-alive connection back to the reactor to wait for
+ *         its next request.  Safe to call from any thread.
+ */
+void reactor_resume(reactor_t *r, conn_t *conn);
+
+/** @brief Get how many connections the reactor has accepted.  Safe to
+ *         call from any thread.
+ */
+uint64_t reactor_accepted(reactor_t *r);
+
+/** @brief Get how many requests the reactor answered with a 503 because
+ *         the queues were full.  Safe to call from any thread.
+ */
+uint64_t reactor_shed(reactor_t *r);
+
+/** @brief Run the event loop on the calling thread.  Does not return.
+ */
+void reactor_run(reactor_t *r);
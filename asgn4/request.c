@@ -0,0 +1,12 @@
+#include "request.h"
+
+const Request_t REQUEST_GET = { "GET" };
+const Request_t REQUEST_PUT = { "PUT" };
+const Request_t REQUEST_HEAD = { "HEAD" };
+const Request_t REQUEST_UNSUPPORTED = { "UNSUPPORTED" };
+const Request_t *requests[NUM_REQUESTS]
+    = { &REQUEST_GET, &REQUEST_PUT, &REQUEST_HEAD, &REQUEST_UNSUPPORTED };
+
+const char *request_get_str(const Request_t *request) {
+    return request->name;
+}
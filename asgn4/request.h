@@ -0,0 +1,27 @@
+/**
+ * @File request.h
+ *
+ * The HTTP methods that the server recognizes.
+ */
+
+#pragma once
+
+/** @struct Request_t
+ *
+ *  @brief A recognized request method.  Compare requests by address
+ *         against the REQUEST_* constants.
+ */
+typedef struct Request {
+    const char *name;
+} Request_t;
+
+#define NUM_REQUESTS 4
+extern const Request_t REQUEST_GET;
+extern const Request_t REQUEST_PUT;
+extern const Request_t REQUEST_HEAD;
+extern const Request_t REQUEST_UNSUPPORTED;
+extern const Request_t *requests[NUM_REQUESTS];
+
+/** @brief Get the method name of a request, e.g., "GET".
+ */
+const char *request_get_str(const Request_t *request);
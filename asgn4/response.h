@@ -0,0 +1,40 @@
+/**
+ * @File response.h
+ *
+ * The HTTP status codes that the server can respond with.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @struct Response_t
+ *
+ *  @brief A status code and its reason phrase.  Compare responses by
+ *         address against the RESPONSE_* constants.
+ */
+typedef struct Response {
+    uint16_t code;
+    const char *message;
+} Response_t;
+
+extern const Response_t RESPONSE_OK;
+extern const Response_t RESPONSE_CREATED;
+extern const Response_t RESPONSE_PARTIAL_CONTENT;
+extern const Response_t RESPONSE_NOT_MODIFIED;
+extern const Response_t RESPONSE_BAD_REQUEST;
+extern const Response_t RESPONSE_FORBIDDEN;
+extern const Response_t RESPONSE_NOT_FOUND;
+extern const Response_t RESPONSE_RANGE_NOT_SATISFIABLE;
+extern const Response_t RESPONSE_INTERNAL_SERVER_ERROR;
+extern const Response_t RESPONSE_NOT_IMPLEMENTED;
+extern const Response_t RESPONSE_SERVICE_UNAVAILABLE;
+extern const Response_t RESPONSE_VERSION_NOT_SUPPORTED;
+
+/** @brief Get the numeric status code of a response, e.g., 200.
+ */
+uint16_t response_get_code(const Response_t *response);
+
+/** @brief Get the reason phrase of a response, e.g., "OK".
+ */
+const char *response_get_message(const Response_t *response);
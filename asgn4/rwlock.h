@@ -18,7 +18,19 @@
  */
 typedef struct rwlock rwlock_t;
 
-typedef enum { READERS, WRITERS, N_WAY } PRIORITY;
+/** @brief Who goes first when both readers and writers are waiting.
+ *
+ *  READERS: waiting readers always go before waiting writers.
+ *  WRITERS: waiting writers always go before waiting readers.
+ *  N_WAY:   after a writer releases the lock, at most n readers go
+ *           ahead of a waiting writer, so neither side starves.
+ *  READERS_BIASED: for read-mostly locks.  While no writer has come by
+ *           lately, readers only write a slot of a global table that
+ *           other threads' slots don't share, never the lock itself.  A
+ *           writer revokes the bias and waits for those readers, which
+ *           makes writes slower; otherwise the rules are N_WAY's.
+ */
+typedef enum { READERS, WRITERS, N_WAY, READERS_BIASED } PRIORITY;
 
 /** @brief Dynamically allocates and initializes a new rwlock with
  *         priority p, and, if using N_WAY priority, n.
@@ -0,0 +1,705 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "store.h"
+
+#define SEGMENT_SIZE    (16 << 20) // a segment is sealed once the next record would not fit
+#define RECORD_MAGIC    0x31434f4cu
+#define RECORD_ALIGN    8
+#define INITIAL_BUCKETS 1024
+#define COMPACT_LIVE    50 // compact sealed segments with less than this percentage still live
+#define COMPACT_MS      1000 // how often the compactor looks for such segments
+
+// What precedes a record's URI and data in a segment.  Records start at multiples of
+// RECORD_ALIGN, so that after a torn or unfinished write the next one can be found again.
+typedef struct record {
+    uint32_t magic;
+    uint32_t crc; // of the URI and the data
+    uint64_t version;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint16_t uri_len;
+    uint16_t reserved[3];
+} record_t;
+
+struct segment {
+    uint32_t id;
+    int fd;
+    uint64_t end; // bytes taken by records, including appends still being written
+    uint64_t live; // bytes of the records the index points to
+    int refs; // store_refs into the segment, appends being written, and the compactor
+    int writers; // appends being written
+    bool sealed; // nothing more will be appended
+    bool dead; // compacted and deleted; freed once refs drops to 0
+    int64_t retry_ns; // when compacting it may be tried again, after it failed (monotonic)
+    segment_t *next; // in id order, oldest first
+};
+
+// The index: where each URI's current record is
+typedef struct entry {
+    struct entry *next;
+    uint64_t hash;
+    segment_t *segment;
+    uint64_t offset; // of the record
+    uint64_t length; // of the whole record
+    uint64_t size;
+    uint64_t version;
+    int64_t mtime_ns;
+    char uri[];
+} entry_t;
+
+struct store {
+    pthread_mutex_t mutex;
+    pthread_cond_t wake; // signalled when a segment is sealed, and to stop the compactor
+    int dirfd;
+    uint64_t max_object;
+    segment_t *oldest;
+    segment_t *active; // the newest segment, which appends go to
+    uint32_t next_id;
+    entry_t **buckets;
+    size_t nbuckets;
+    uint64_t next_version;
+    int64_t last_stamp_ns; // the latest modification time handed out, by store_stamp or a PUT
+    bool stop;
+    pthread_t compactor;
+    store_stats_t stats;
+};
+
+// Function to hash a URI (64-bit FNV-1a)
+static uint64_t hash_uri(const char *uri) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *) uri; *p != '\0'; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Function to get the length of a record, padding included
+static uint64_t record_length(size_t uri_len, uint64_t size) {
+    uint64_t length = sizeof(record_t) + uri_len + size;
+    return (length + RECORD_ALIGN - 1) & ~(uint64_t) (RECORD_ALIGN - 1);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function to get a modification time later than every one handed out before, even if the
+// clock has since been set back; call with the mutex held
+static int64_t next_stamp(store_t *s) {
+    int64_t now = now_ns();
+    s->last_stamp_ns = now > s->last_stamp_ns ? now : s->last_stamp_ns + 1;
+    return s->last_stamp_ns;
+}
+
+static bool pread_all(int fd, char *buf, uint64_t count, uint64_t offset) {
+    uint64_t done = 0;
+    while (done < count) {
+        ssize_t n = pread(fd, buf + done, count - done, (off_t) (offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (uint64_t) n;
+    }
+    return true;
+}
+
+static bool pwrite_all(int fd, const char *buf, uint64_t count, uint64_t offset) {
+    uint64_t done = 0;
+    while (done < count) {
+        ssize_t n = pwrite(fd, buf + done, count - done, (off_t) (offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += (uint64_t) n;
+    }
+    return true;
+}
+
+// Function to check the record at offset of a segment's first len bytes; whether it is whole
+// and intact
+static bool record_valid(const char *buf, uint64_t len, uint64_t offset, record_t *rec) {
+    if (len - offset < sizeof(record_t)) {
+        return false;
+    }
+    memcpy(rec, buf + offset, sizeof(record_t));
+    if (rec->magic != RECORD_MAGIC || rec->size > len
+        || record_length(rec->uri_len, rec->size) > len - offset) {
+        return false;
+    }
+    const Bytef *body = (const Bytef *) buf + offset + sizeof(record_t);
+    return crc32(0, body, (uInt) (rec->uri_len + rec->size)) == rec->crc;
+}
+
+// Function to find a URI's entry; call with the mutex held
+static entry_t **find(store_t *s, const char *uri, uint64_t hash) {
+    entry_t **link = &s->buckets[hash & (s->nbuckets - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->uri, uri) != 0)) {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// Function to double the index's bucket array once its load factor reaches 1
+static void grow(store_t *s) {
+    size_t nbuckets = s->nbuckets * 2;
+    entry_t **buckets = calloc(nbuckets, sizeof(entry_t *));
+    if (buckets == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < s->nbuckets; i++) {
+        entry_t *e = s->buckets[i];
+        while (e != NULL) {
+            entry_t *next = e->next;
+            size_t b = e->hash & (nbuckets - 1);
+            e->next = buckets[b];
+            buckets[b] = e;
+            e = next;
+        }
+    }
+    free(s->buckets);
+    s->buckets = buckets;
+    s->nbuckets = nbuckets;
+}
+
+// Function to point a URI at a record, which is live from now on; call with the mutex held
+static bool index_set(store_t *s, const char *uri, const record_t *rec, segment_t *segment,
+    uint64_t offset) {
+    uint64_t hash = hash_uri(uri);
+    entry_t **link = find(s, uri, hash);
+    entry_t *e = *link;
+    if (e == NULL) {
+        size_t len = strlen(uri);
+        e = malloc(sizeof(entry_t) + len + 1);
+        if (e == NULL) {
+            return false;
+        }
+        memcpy(e->uri, uri, len + 1);
+        e->hash = hash;
+        e->next = NULL;
+        *link = e;
+        s->stats.objects++;
+        if (s->stats.objects > s->nbuckets) {
+            grow(s);
+        }
+    } else {
+        e->segment->live -= e->length;
+        s->stats.live_bytes -= e->length;
+    }
+    e->segment = segment;
+    e->offset = offset;
+    e->length = record_length(rec->uri_len, rec->size);
+    e->size = rec->size;
+    e->version = rec->version;
+    e->mtime_ns = rec->mtime_ns;
+    segment->live += e->length;
+    s->stats.live_bytes += e->length;
+    return true;
+}
+
+// Function to drop an entry from the index; call with the mutex held
+static void index_remove(store_t *s, entry_t **link) {
+    entry_t *e = *link;
+    *link = e->next;
+    e->segment->live -= e->length;
+    s->stats.live_bytes -= e->length;
+    s->stats.objects--;
+    free(e);
+}
+
+// Function to drop a reference to a segment, freeing it if it was the last to a dead one; call
+// with the mutex held
+static void segment_put(segment_t *segment) {
+    if (--segment->refs == 0 && segment->dead) {
+        close(segment->fd);
+        free(segment);
+    }
+}
+
+// Function to add a segment to the end of the list, opened from fd
+static segment_t *segment_add(store_t *s, uint32_t id, int fd, uint64_t end) {
+    segment_t *segment = calloc(1, sizeof(segment_t));
+    if (segment == NULL) {
+        return NULL;
+    }
+    segment->id = id;
+    segment->fd = fd;
+    segment->end = end;
+    segment->refs = 1; // the store's own, until the segment is deleted
+    if (s->active == NULL) {
+        s->oldest = segment;
+    } else {
+        s->active->next = segment;
+    }
+    s->active = segment;
+    s->stats.segments++;
+    s->stats.bytes += end;
+    if (id >= s->next_id) {
+        s->next_id = id + 1;
+    }
+    return segment;
+}
+
+// Function to seal the active segment and start a new one; call with the mutex held
+static segment_t *segment_new(store_t *s) {
+    char name[32];
+    snprintf(name, sizeof(name), "%08x.seg", s->next_id);
+    int fd = openat(s->dirfd, name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    segment_t *sealed = s->active;
+    segment_t *segment = segment_add(s, s->next_id, fd, 0);
+    if (segment == NULL) {
+        close(fd);
+        unlinkat(s->dirfd, name, 0);
+        return NULL;
+    }
+    if (sealed != NULL) {
+        sealed->sealed = true;
+        pthread_cond_signal(&s->wake);
+    }
+    return segment;
+}
+
+// Function to take room for a record of length bytes at the end of the log, at *offset of the
+// returned segment, which the caller writes and then hands to append_done; call with the mutex
+// held
+static segment_t *append_begin(store_t *s, uint64_t length, uint64_t *offset) {
+    segment_t *segment = s->active;
+    if (segment == NULL || (segment->end > 0 && segment->end + length > SEGMENT_SIZE)) {
+        segment = segment_new(s);
+        if (segment == NULL) {
+            return NULL;
+        }
+    }
+    *offset = segment->end;
+    segment->end += length;
+    segment->writers++;
+    segment->refs++;
+    s->stats.bytes += length;
+    return segment;
+}
+
+// Function to finish an append of length bytes at offset started with append_begin.  If it
+// failed, its room is given back, unless something was appended after it, in which case it is
+// left as dead bytes.  Call with the mutex held.
+static void append_done(
+    store_t *s, segment_t *segment, uint64_t offset, uint64_t length, bool written) {
+    if (!written && segment->end == offset + length) {
+        segment->end = offset;
+        s->stats.bytes -= length;
+    }
+    segment->writers--;
+    segment_put(segment);
+}
+
+bool store_admits(store_t *s, uint64_t size) {
+    return size <= s->max_object;
+}
+
+int store_put(store_t *s, const char *uri, int fd, uint64_t size) {
+    size_t uri_len = strlen(uri);
+    uint64_t length = record_length(uri_len, size);
+    char *buf = calloc(1, length);
+    if (buf == NULL) {
+        return -1;
+    }
+    record_t rec = { .magic = RECORD_MAGIC, .size = size, .uri_len = (uint16_t) uri_len };
+    memcpy(buf + sizeof(record_t), uri, uri_len);
+    if (!pread_all(fd, buf + sizeof(record_t) + uri_len, size, 0)) {
+        free(buf);
+        return -1;
+    }
+    rec.crc = crc32(0, (const Bytef *) buf + sizeof(record_t), (uInt) (uri_len + size));
+
+    // Appends only hold the mutex to take their room and to publish, not while they write
+    uint64_t offset;
+    pthread_mutex_lock(&s->mutex);
+    rec.version = s->next_version++;
+    rec.mtime_ns = next_stamp(s);
+    segment_t *segment = append_begin(s, length, &offset);
+    pthread_mutex_unlock(&s->mutex);
+    if (segment == NULL) {
+        free(buf);
+        return -1;
+    }
+    memcpy(buf, &rec, sizeof(record_t));
+    bool written = pwrite_all(segment->fd, buf, length, offset);
+    free(buf);
+
+    pthread_mutex_lock(&s->mutex);
+    bool ok = written && index_set(s, uri, &rec, segment, offset);
+    append_done(s, segment, offset, length, written);
+    pthread_mutex_unlock(&s->mutex);
+    return ok ? 0 : -1;
+}
+
+void store_drop(store_t *s, const char *uri) {
+    uint64_t hash = hash_uri(uri);
+    pthread_mutex_lock(&s->mutex);
+    entry_t **link = find(s, uri, hash);
+    if (*link != NULL) {
+        index_remove(s, link);
+    }
+    pthread_mutex_unlock(&s->mutex);
+}
+
+bool store_get(store_t *s, const char *uri, store_ref_t *ref) {
+    uint64_t hash = hash_uri(uri);
+    pthread_mutex_lock(&s->mutex);
+    entry_t *e = *find(s, uri, hash);
+    if (e != NULL) {
+        ref->segment = e->segment;
+        ref->offset = e->offset + sizeof(record_t) + strlen(e->uri);
+        ref->size = e->size;
+        ref->version = e->version;
+        ref->mtime_ns = e->mtime_ns;
+        e->segment->refs++;
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return e != NULL;
+}
+
+int64_t store_stamp(store_t *s) {
+    pthread_mutex_lock(&s->mutex);
+    int64_t stamp = next_stamp(s);
+    pthread_mutex_unlock(&s->mutex);
+    return stamp;
+}
+
+bool store_has(store_t *s, const char *uri) {
+    uint64_t hash = hash_uri(uri);
+    pthread_mutex_lock(&s->mutex);
+    bool found = *find(s, uri, hash) != NULL;
+    pthread_mutex_unlock(&s->mutex);
+    return found;
+}
+
+int store_read(store_t *s, const store_ref_t *ref, char *buf) {
+    (void) s;
+    return pread_all(ref->segment->fd, buf, ref->size, ref->offset) ? 0 : -1;
+}
+
+void store_release(store_t *s, store_ref_t *ref) {
+    pthread_mutex_lock(&s->mutex);
+    segment_put(ref->segment);
+    pthread_mutex_unlock(&s->mutex);
+    ref->segment = NULL;
+}
+
+void store_stats(store_t *s, store_stats_t *stats) {
+    pthread_mutex_lock(&s->mutex);
+    *stats = s->stats;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+// Function to move the live records of a sealed segment to the end of the log, and delete the
+// segment once none are left in it.  A record is only repointed if the index still points at
+// it once it has been copied; otherwise a PUT replaced it meanwhile, and the copy is dead.
+// Returns whether the segment was deleted; if not (out of memory or disk space), it is left as
+// it was, apart from the records already moved.
+static bool compact(store_t *s, segment_t *segment) {
+    uint64_t len = segment->end;
+    char *buf = malloc(len > 0 ? len : 1);
+    if (buf == NULL || !pread_all(segment->fd, buf, len, 0)) {
+        free(buf);
+        return false;
+    }
+    record_t rec;
+    bool failed = false;
+    for (uint64_t offset = 0; offset < len && !failed;) {
+        if (!record_valid(buf, len, offset, &rec)) {
+            offset += RECORD_ALIGN;
+            continue;
+        }
+        uint64_t length = record_length(rec.uri_len, rec.size);
+        char uri[UINT16_MAX + 1];
+        memcpy(uri, buf + offset + sizeof(record_t), rec.uri_len);
+        uri[rec.uri_len] = '\0';
+        uint64_t hash = hash_uri(uri);
+
+        pthread_mutex_lock(&s->mutex);
+        entry_t *e = *find(s, uri, hash);
+        segment_t *to = NULL;
+        uint64_t to_offset = 0;
+        if (e != NULL && e->segment == segment && e->offset == offset) {
+            to = append_begin(s, length, &to_offset);
+            failed = to == NULL;
+        }
+        pthread_mutex_unlock(&s->mutex);
+        if (to != NULL) {
+            bool written = pwrite_all(to->fd, buf + offset, length, to_offset);
+            pthread_mutex_lock(&s->mutex);
+            e = *find(s, uri, hash);
+            if (written && e != NULL && e->segment == segment && e->offset == offset) {
+                index_set(s, uri, &rec, to, to_offset);
+            }
+            append_done(s, to, to_offset, length, written);
+            pthread_mutex_unlock(&s->mutex);
+            failed = !written;
+        }
+        offset += length;
+    }
+    free(buf);
+
+    pthread_mutex_lock(&s->mutex);
+    bool deleted = segment->live == 0;
+    if (deleted) {
+        char name[32];
+        snprintf(name, sizeof(name), "%08x.seg", segment->id);
+        unlinkat(s->dirfd, name, 0);
+        segment_t **link = &s->oldest;
+        while (*link != segment) {
+            link = &(*link)->next;
+        }
+        *link = segment->next;
+        segment->dead = true;
+        s->stats.segments--;
+        s->stats.bytes -= segment->end;
+        s->stats.compactions++;
+        segment_put(segment);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return deleted;
+}
+
+// Function to pick a sealed segment that is mostly dead, has no appends in flight, and isn't
+// waiting out a failed compaction; call with the mutex held
+static segment_t *pick_victim(store_t *s) {
+    int64_t now = monotonic_ns();
+    for (segment_t *segment = s->oldest; segment != NULL; segment = segment->next) {
+        if (segment->sealed && segment->writers == 0 && segment->retry_ns <= now
+            && segment->live * 100 < segment->end * COMPACT_LIVE) {
+            return segment;
+        }
+    }
+    return NULL;
+}
+
+// Thread that compacts segments whenever some are mostly dead
+static void *compactor(void *arg) {
+    store_t *s = arg;
+    pthread_mutex_lock(&s->mutex);
+    while (!s->stop) {
+        segment_t *victim = pick_victim(s);
+        if (victim == NULL) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_sec += COMPACT_MS / 1000;
+            pthread_cond_timedwait(&s->wake, &s->mutex, &until);
+            continue;
+        }
+        // A segment that couldn't be compacted is left alone for a round, rather than read
+        // again and again while, say, the disk stays full
+        victim->refs++;
+        pthread_mutex_unlock(&s->mutex);
+        bool deleted = compact(s, victim);
+        pthread_mutex_lock(&s->mutex);
+        if (!deleted) {
+            victim->retry_ns = monotonic_ns() + (int64_t) COMPACT_MS * 1000000;
+        }
+        segment_put(victim);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return NULL;
+}
+
+// Function to read a segment back into the index: every intact record whose version is newer
+// than the URI's record so far.  Records that don't check out are skipped.
+static bool recover_segment(store_t *s, segment_t *segment) {
+    uint64_t len = segment->end;
+    char *buf = malloc(len > 0 ? len : 1);
+    if (buf == NULL || !pread_all(segment->fd, buf, len, 0)) {
+        free(buf);
+        return false;
+    }
+    record_t rec;
+    for (uint64_t offset = 0; offset < len;) {
+        if (!record_valid(buf, len, offset, &rec)) {
+            offset += RECORD_ALIGN;
+            continue;
+        }
+        char uri[UINT16_MAX + 1];
+        memcpy(uri, buf + offset + sizeof(record_t), rec.uri_len);
+        uri[rec.uri_len] = '\0';
+        entry_t *e = *find(s, uri, hash_uri(uri));
+        if ((e == NULL || e->version < rec.version) && !index_set(s, uri, &rec, segment, offset)) {
+            free(buf);
+            return false;
+        }
+        if (rec.version >= s->next_version) {
+            s->next_version = rec.version + 1;
+        }
+        if (rec.mtime_ns > s->last_stamp_ns) {
+            s->last_stamp_ns = rec.mtime_ns;
+        }
+        offset += record_length(rec.uri_len, rec.size);
+    }
+    free(buf);
+    return true;
+}
+
+// Function to compare segment ids, for qsort
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Function to read back every segment in dir, oldest first, and then drop the URIs whose own
+// files were written after their last record
+static bool recover(store_t *s) {
+    DIR *dir = fdopendir(dup(s->dirfd));
+    if (dir == NULL) {
+        return false;
+    }
+    uint32_t *ids = NULL;
+    size_t nids = 0;
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL) {
+        unsigned id;
+        char rest;
+        if (sscanf(d->d_name, "%8x.se%c", &id, &rest) == 2 && rest == 'g') {
+            uint32_t *more = realloc(ids, (nids + 1) * sizeof(uint32_t));
+            if (more == NULL) {
+                break;
+            }
+            ids = more;
+            ids[nids++] = id;
+        }
+    }
+    closedir(dir);
+    qsort(ids, nids, sizeof(uint32_t), compare_ids);
+
+    bool ok = true;
+    for (size_t i = 0; i < nids && ok; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%08x.seg", ids[i]);
+        int fd = openat(s->dirfd, name, O_RDWR | O_CLOEXEC);
+        struct stat st;
+        segment_t *segment = NULL;
+        bool stat_ok = fd >= 0 && fstat(fd, &st) == 0;
+        if (stat_ok && st.st_size == 0) {
+            // The active segment of a run that put nothing; as it has no bytes, it would never
+            // count as mostly dead, so compaction would never delete it
+            close(fd);
+            unlinkat(s->dirfd, name, 0);
+            continue;
+        }
+        if (stat_ok) {
+            segment = segment_add(s, ids[i], fd, (uint64_t) st.st_size);
+        }
+        if (segment == NULL) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            ok = false;
+            break;
+        }
+        segment->sealed = true;
+        ok = recover_segment(s, segment);
+    }
+    free(ids);
+
+    for (size_t b = 0; ok && b < s->nbuckets; b++) {
+        entry_t **link = &s->buckets[b];
+        while (*link != NULL) {
+            struct stat st;
+            int64_t mtime_ns = stat((*link)->uri, &st) == 0
+                ? (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec
+                : INT64_MIN;
+            if (mtime_ns > (*link)->mtime_ns) {
+                index_remove(s, link);
+            } else {
+                link = &(*link)->next;
+            }
+        }
+    }
+    return ok;
+}
+
+store_t *store_open(const char *dir, uint64_t max_object) {
+    store_t *s = calloc(1, sizeof(store_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->max_object = max_object < SEGMENT_SIZE / 4 ? max_object : SEGMENT_SIZE / 4;
+    s->next_version = 1;
+    s->dirfd = -1;
+    pthread_mutex_init(&s->mutex, NULL);
+    pthread_cond_init(&s->wake, NULL);
+    s->buckets = calloc(INITIAL_BUCKETS, sizeof(entry_t *));
+    s->nbuckets = INITIAL_BUCKETS;
+    if (s->buckets == NULL || (mkdir(dir, 0755) < 0 && errno != EEXIST)
+        || (s->dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 || !recover(s)
+        || segment_new(s) == NULL) {
+        store_close(&s);
+        return NULL;
+    }
+    if (pthread_create(&s->compactor, NULL, compactor, s) != 0) {
+        s->stop = true;
+        store_close(&s);
+        return NULL;
+    }
+    return s;
+}
+
+void store_close(store_t **s) {
+    if (s == NULL || *s == NULL) {
+        return;
+    }
+    store_t *st = *s;
+    pthread_mutex_lock(&st->mutex);
+    bool running = !st->stop;
+    st->stop = true;
+    pthread_cond_signal(&st->wake);
+    pthread_mutex_unlock(&st->mutex);
+    if (running) {
+        pthread_join(st->compactor, NULL);
+    }
+    for (size_t b = 0; st->buckets != NULL && b < st->nbuckets; b++) {
+        while (st->buckets[b] != NULL) {
+            index_remove(st, &st->buckets[b]);
+        }
+    }
+    while (st->oldest != NULL) {
+        segment_t *next = st->oldest->next;
+        close(st->oldest->fd);
+        free(st->oldest);
+        st->oldest = next;
+    }
+    if (st->dirfd >= 0) {
+        close(st->dirfd);
+    }
+    free(st->buckets);
+    pthread_mutex_destroy(&st->mutex);
+    pthread_cond_destroy(&st->wake);
+    free(st);
+    *s = NULL;
+}
@@ -0,0 +1,123 @@
+/**
+ * @File store.h
+ *
+ * A log-structured store for small objects.  Instead of a file each,
+ * small objects are appended as records to large segment files, and an
+ * in-memory index maps every URI to its latest record.  Segments whose
+ * records have mostly been overwritten are compacted in the background:
+ * the records still in use are copied to the end of the log, and the
+ * segment is deleted.
+ *
+ * An object lives either in the store or in a file of its own named after
+ * its URI, in the working directory.  Every record carries a version, so
+ * on startup the segments are read back and each URI gets the record with
+ * the highest version, unless its file was modified after that record; so
+ * a PUT that moves an object out of the store only has to drop it from the
+ * index, provided it sets the file's modification time to store_stamp()
+ * when it puts the file in place.  Clocks can't be trusted to order the
+ * two (file times come from a coarser clock, and clocks get set back), so
+ * the store hands out the times itself.
+ *
+ * The store knows nothing about the per-URI rwlocks: callers put and drop
+ * a URI's object only while holding its writer lock, and look it up while
+ * holding its reader lock.  Compaction doesn't change what is stored, so
+ * it needs neither.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @struct store_t
+ *
+ *  @brief The segments, the index, and the compaction thread.
+ */
+typedef struct store store_t;
+
+typedef struct segment segment_t;
+
+/** @brief Where an object's current version is, as store_get found it.
+ *         The segment stays readable until the reference is released.
+ */
+typedef struct store_ref {
+    segment_t *segment;
+    uint64_t offset; /**< of the object's data in the segment */
+    uint64_t size;
+    uint64_t version; /**< unique to this version of the object */
+    int64_t mtime_ns; /**< when it was put, in ns since the epoch */
+} store_ref_t;
+
+/** @brief Counters describing the store, for monitoring.
+ */
+typedef struct {
+    uint64_t objects;
+    uint64_t live_bytes; /**< of the records the index points to */
+    uint64_t bytes; /**< of every segment, dead records included */
+    uint64_t segments;
+    uint64_t compactions;
+} store_stats_t;
+
+/** @brief Opens the store in dir (created if need be), reading back the
+ *         segments already there, and starts compacting in the background.
+ *         Objects of up to max_object bytes may be put in the store.
+ *
+ *  @return a pointer to a new store_t, or NULL on failure.
+ */
+store_t *store_open(const char *dir, uint64_t max_object);
+
+/** @brief Stop compacting and free the store; *s is set to NULL.  What was
+ *         put stays in the segments for the next store_open.
+ */
+void store_close(store_t **s);
+
+/** @brief Whether an object of size bytes should go in the store.
+ */
+bool store_admits(store_t *s, uint64_t size);
+
+/** @brief Append size bytes read from fd (at offset 0) as the URI's new
+ *         version.  Call with the URI's writer lock held.
+ *
+ *  @return 0 on success, or -1 (and the old version stays) on failure.
+ */
+int store_put(store_t *s, const char *uri, int fd, uint64_t size);
+
+/** @brief Get a modification time, in ns since the epoch, later than
+ *         that of every record the store has (and every other time it
+ *         handed out), for a file that replaces a stored object.  Call
+ *         with the URI's writer lock held.
+ */
+int64_t store_stamp(store_t *s);
+
+/** @brief Drop the URI from the index, if it is there, because its object
+ *         now lives in a file of its own.  Call with the URI's writer lock
+ *         held, after the file was put in place.
+ */
+void store_drop(store_t *s, const char *uri);
+
+/** @brief Look a URI up.  Call with the URI's reader (or writer) lock held.
+ *
+ *  @return whether the store has it; if so, *ref says where, and must be
+ *          released with store_release.
+ */
+bool store_get(store_t *s, const char *uri, store_ref_t *ref);
+
+/** @brief Whether the store has the URI.  Call with the URI's reader (or
+ *         writer) lock held.
+ */
+bool store_has(store_t *s, const char *uri);
+
+/** @brief Read the object ref refers to into buf, which must have room
+ *         for ref->size bytes.
+ *
+ *  @return 0 on success, or -1 on failure.
+ */
+int store_read(store_t *s, const store_ref_t *ref, char *buf);
+
+/** @brief Release a reference obtained from store_get.
+ */
+void store_release(store_t *s, store_ref_t *ref);
+
+/** @brief Take a snapshot of the store's counters.
+ */
+void store_stats(store_t *s, store_stats_t *stats);
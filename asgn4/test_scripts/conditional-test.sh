@@ -0,0 +1,109 @@
+#!/bin/bash
+
+# Checks conditional GETs and HEADs against a running server: a 304 for a matching ETag (also
+# through "*", lists, and weak tags) or an If-Modified-Since date that isn't older than the
+# object, If-None-Match taking precedence over If-Modified-Since, and an unparseable date being
+# ignored.  Every request, 304s included, must be in the audit log.  Each is tried with the
+# object read from its file, from the object cache, and from the store.
+#
+# usage: test_scripts/conditional-test.sh    (from asgn4, after make)
+
+cd "$(dirname "$0")/.." || exit 1
+
+bin=$(realpath httpserver)
+work=$(mktemp -d)
+server=
+failed=0
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+# Function to start the server on a new port in a new $work/data, logging to $work/audit.log
+start() {
+    rm -rf "$work/data" "$work/audit.log" && mkdir "$work/data"
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data" && exec "$bin" -l "$work/audit.log" "$@" "$port" 2>/dev/null) &
+    server=$!
+    until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+        kill -0 $server 2>/dev/null || { echo "FAILED: The server did not start."; exit 1; }
+        sleep 0.01
+    done
+}
+
+stop() {
+    kill $server
+    wait $server 2>/dev/null
+    server=
+}
+
+# Function to send request $2 (a method) for /obj with Request-Id $1 and the headers that follow,
+# check that the status is $3, and note the audit log line expected for it
+expect() {
+    local id=$1 method=$2 code=$3
+    shift 3
+    local args=(-s -o /dev/null -w "%{http_code}" -H "Request-Id: $id")
+    [ "$method" = HEAD ] && args+=(-I)
+    for h in "$@"; do
+        args+=(-H "$h")
+    done
+    local got
+    got=$(curl "${args[@]}" "http://localhost:$port/obj")
+    if [ "$got" != "$code" ]; then
+        echo "FAILED: $backend: $method with $* returned $got instead of $code."
+        failed=1
+    fi
+    echo "$method,/obj,$code,$id" >> "$work/expected.log"
+}
+
+head -c 1000 /dev/urandom > "$work/object"
+
+for backend in files cache store; do
+    case $backend in
+    files) start -c 0 ;;
+    cache) start ;;
+    store) start -c 0 -s 64 ;;
+    esac
+    : > "$work/expected.log"
+    curl -s -o /dev/null -H "Expect:" -H "Request-Id: 1" -T "$work/object" \
+        "http://localhost:$port/obj"
+    echo "PUT,/obj,201,1" >> "$work/expected.log"
+    curl -s -D "$work/head" -o /dev/null -H "Request-Id: 2" "http://localhost:$port/obj"
+    echo "GET,/obj,200,2" >> "$work/expected.log"
+    etag=$(tr -d '\r' < "$work/head" | sed -n 's/^ETag: //p')
+    modified=$(tr -d '\r' < "$work/head" | sed -n 's/^Last-Modified: //p')
+    if [ -z "$etag" ] || [ -z "$modified" ]; then
+        echo "FAILED: $backend: GET sent no ETag or Last-Modified."
+        failed=1
+    fi
+
+    expect 10 GET 304 "If-None-Match: $etag"
+    expect 11 HEAD 304 "If-None-Match: $etag"
+    expect 12 GET 200 "If-None-Match: \"other\""
+    expect 13 GET 304 "If-None-Match: *"
+    expect 14 GET 304 "If-None-Match: \"a\", \"b\", $etag"
+    expect 15 GET 304 "If-None-Match: \"a\", W/$etag"
+    expect 16 GET 200 "If-None-Match: \"a\", \"b\""
+    expect 17 GET 304 "If-Modified-Since: $modified"
+    expect 18 GET 200 "If-Modified-Since: Sat, 01 Jan 2000 00:00:00 GMT"
+    expect 19 GET 200 "If-Modified-Since: Fri, 31 Dec 9999 23:59:59 GMT"
+    expect 20 GET 200 "If-Modified-Since: yesterday"
+    expect 21 GET 200 "If-None-Match: \"other\"" "If-Modified-Since: $modified"
+    expect 22 GET 304 "If-None-Match: $etag" "If-Modified-Since: Sat, 01 Jan 2000 00:00:00 GMT"
+    expect 23 GET 304 "If-None-Match: $etag" "If-Modified-Since: yesterday"
+    stop
+
+    if ! diff <(sort "$work/expected.log") <(sort "$work/audit.log") > /dev/null; then
+        echo "FAILED: $backend: the audit log does not have every request with its status."
+        diff <(sort "$work/expected.log") <(sort "$work/audit.log")
+        failed=1
+    fi
+done
+
+if [ $failed -eq 0 ]; then
+    echo "SUCCESS: Conditional requests got 304s exactly when they should, all logged."
+    exit 0
+fi
+exit 1
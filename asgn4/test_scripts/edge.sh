@@ -0,0 +1,114 @@
+#!/bin/bash
+
+# Checks how the server answers malformed and unusual requests, sent over raw sockets: an old
+# HTTP version, an unknown method, a bad URI, a PUT without a length, a bad header line, and a
+# request whose head arrives in two pieces a second apart while 200 idle connections are open
+# (which must not keep the one worker from it).  Then a 3 MB object is PUT and read back.  The
+# responses (less their ETag and Last-Modified, which change from run to run) and the audit log
+# must be exactly as below.
+#
+# usage: test_scripts/edge.sh [server flags]    (from asgn4, after make)
+
+cd "$(dirname "$0")/.." || exit 1
+
+bin=$(realpath httpserver)
+work=$(mktemp -d)
+server=
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+mkdir "$work/data"
+port=$((20000 + RANDOM % 20000))
+(cd "$work/data" && exec "$bin" -t 1 -q 0 -l "$work/audit.log" "$@" "$port" 2>/dev/null) &
+server=$!
+until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+    kill -0 $server 2>/dev/null || { echo "FAILED: The server did not start."; exit 1; }
+    sleep 0.01
+done
+
+# Function to send $1 (with escapes such as \r\n) on a new connection, a second's pause where it
+# has |DELAY|, and print what came back before the server closed it
+raw() {
+    python3 - "$port" "$1" <<'PY'
+import re, socket, sys, time
+data = sys.argv[2].encode().decode("unicode_escape").encode("latin1")
+s = socket.create_connection(("localhost", int(sys.argv[1])))
+s.settimeout(6)
+for i, part in enumerate(data.split(b"|DELAY|")):
+    if i > 0:
+        time.sleep(1)
+    s.sendall(part)
+out = b""
+try:
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        out += chunk
+except OSError as e:
+    out += b"<" + str(e).encode() + b">"
+out = re.sub(rb"(ETag|Last-Modified): [^\r]*\r\n", b"", out)
+print(repr(out[:300]))
+PY
+}
+
+{
+    raw 'GET /a HTTP/1.0\r\n\r\n'
+    raw 'GTT /a HTTP/1.1\r\n\r\n'
+    raw 'GET /a@b HTTP/1.1\r\n\r\n'
+    raw 'PUT /a HTTP/1.1\r\n\r\n'
+    raw 'PUT /a HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc'
+    raw 'GET /a HTTP/1.1\r\nbad header\r\n\r\n'
+    raw 'DELETE /a HTTP/1.1\r\n\r\n'
+    raw 'GET /a HTTP/1.1\r\nRequest-Id: 7\r\n\r\n'
+
+    # Idle connections must not keep the single worker from the next request
+    python3 - "$port" <<'PY' &
+import socket, sys, time
+idle = [socket.create_connection(("localhost", int(sys.argv[1]))) for _ in range(200)]
+time.sleep(3)
+PY
+    idle=$!
+    sleep 0.5
+    raw 'GET /a HTTP/1.1\r\n|DELAY|Request-Id: 9\r\n\r\n'
+    wait $idle
+
+    head -c 3000000 /dev/urandom > "$work/big"
+    curl -s -H "Expect:" -o /dev/null -w "%{http_code}\n" -T "$work/big" \
+        "http://localhost:$port/big"
+    curl -s "http://localhost:$port/big" | cmp - "$work/big" && echo big-ok
+    kill $server
+    wait $server 2>/dev/null
+    server=
+    cat "$work/audit.log"
+} > "$work/got"
+
+cat > "$work/expected" <<'EOF'
+b'HTTP/1.1 505 HTTP Version Not Supported\r\nContent-Length: 27\r\nConnection: close\r\n\r\nHTTP Version Not Supported\n'
+b'HTTP/1.1 501 Not Implemented\r\nContent-Length: 16\r\n\r\nNot Implemented\n'
+b'HTTP/1.1 400 Bad Request\r\nContent-Length: 12\r\nConnection: close\r\n\r\nBad Request\n'
+b'HTTP/1.1 400 Bad Request\r\nContent-Length: 12\r\nConnection: close\r\n\r\nBad Request\n'
+b'HTTP/1.1 201 Created\r\nContent-Length: 8\r\n\r\nCreated\n'
+b'HTTP/1.1 400 Bad Request\r\nContent-Length: 12\r\nConnection: close\r\n\r\nBad Request\n'
+b'HTTP/1.1 501 Not Implemented\r\nContent-Length: 16\r\n\r\nNot Implemented\n'
+b'HTTP/1.1 200 OK\r\nContent-Length: 3\r\nAccept-Ranges: bytes\r\nVary: Accept-Encoding\r\n\r\nabc'
+b'HTTP/1.1 200 OK\r\nContent-Length: 3\r\nAccept-Ranges: bytes\r\nVary: Accept-Encoding\r\n\r\nabc'
+201
+big-ok
+PUT,/a,201,0
+GET,/a,200,7
+GET,/a,200,9
+PUT,/big,201,0
+GET,/big,200,0
+EOF
+
+if diff "$work/expected" "$work/got"; then
+    echo "SUCCESS: Every edge case got the expected response, and was logged."
+    exit 0
+fi
+echo "FAILED: The responses or the audit log differ from what was expected (above)."
+exit 1
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+
+# Checks that GETs and PUTs of one URI are linearizable in the order of the audit log: 8 clients
+# send 300 requests each to /obj, 40% of them PUTs of their own Request-Id, and every GET must
+# have returned what the last PUT before it in the log put.  Any server flags are passed on,
+# e.g. test_scripts/lin.py -t 2 -T 8 or -n 3.
+#
+# usage: test_scripts/lin.py [server flags]    (from asgn4, after make)
+
+import os
+import random
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+CLIENTS = 8
+REQUESTS = 300
+PUT_SHARE = 0.4
+
+here = os.path.dirname(os.path.abspath(__file__))
+server_bin = os.path.join(here, "..", "httpserver")
+work = tempfile.mkdtemp()
+log = os.path.join(work, "audit.log")
+port = random.randrange(20000, 40000)
+server = subprocess.Popen([server_bin, "-l", log] + sys.argv[1:] + [str(port)], cwd=work,
+                          stderr=subprocess.DEVNULL)
+
+
+# Function to send one request on its own connection and return the whole response
+def request(data):
+    s = socket.create_connection(("127.0.0.1", port))
+    s.sendall(data)
+    response = b""
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        response += chunk
+    s.close()
+    return response
+
+
+got = {}  # what each GET returned, by Request-Id, or None if not a 200
+
+
+def client(k):
+    for j in range(REQUESTS):
+        rid = f"{k}-{j}".encode()
+        if random.random() < PUT_SHARE:
+            request(b"PUT /obj HTTP/1.1\r\nRequest-Id: %s\r\nContent-Length: %d\r\n"
+                    b"Connection: close\r\n\r\n%s" % (rid, len(rid), rid))
+        else:
+            r = request(b"GET /obj HTTP/1.1\r\nRequest-Id: %s\r\nConnection: close\r\n\r\n" % rid)
+            got[rid.decode()] = r.split(b"\r\n\r\n", 1)[1].decode() if b" 200 " in r else None
+
+
+try:
+    for _ in range(500):
+        try:
+            socket.create_connection(("127.0.0.1", port)).close()
+            break
+        except OSError:
+            time.sleep(0.01)
+    threads = [threading.Thread(target=client, args=(k,)) for k in range(CLIENTS)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+finally:
+    server.terminate()
+    server.wait()
+
+last = None
+lines = violations = 0
+with open(log) as f:
+    for line in f:
+        method, uri, code, rid = line.strip().split(",")
+        if uri != "/obj":
+            continue
+        lines += 1
+        if method == "PUT":
+            last = rid
+        elif got.get(rid) is not None and got[rid] != last:
+            violations += 1
+shutil.rmtree(work)
+
+print("lines", lines, "violations", violations)
+if lines != CLIENTS * REQUESTS or violations > 0:
+    print("FAILED: The audit log is missing requests, or GETs saw PUTs out of its order.")
+    sys.exit(1)
+print("SUCCESS: Every GET returned the last PUT before it in the audit log.")
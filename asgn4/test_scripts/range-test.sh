@@ -0,0 +1,129 @@
+#!/bin/bash
+
+# Checks the bodies of range requests byte for byte: a single range, a multipart/byteranges
+# body with its part heads and closing delimiter, a range of an empty object (416), and an
+# unsatisfiable range.  Each is tried with the object sent from its file and from the store.
+#
+# usage: test_scripts/range-test.sh    (from asgn4, after make)
+
+cd "$(dirname "$0")/.." || exit 1
+
+bin=$(realpath httpserver)
+work=$(mktemp -d)
+server=
+failed=0
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+# Function to start the server on a new port in a new $work/data, and wait until it answers
+start() {
+    rm -rf "$work/data" && mkdir "$work/data"
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data" && exec "$bin" "$@" "$port" 2>/dev/null) &
+    server=$!
+    until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+        kill -0 $server 2>/dev/null || { echo "FAILED: The server did not start."; exit 1; }
+        sleep 0.01
+    done
+}
+
+stop() {
+    kill $server
+    wait $server 2>/dev/null
+    server=
+}
+
+# Function to GET /$1 with Range: $2, leaving the head in $work/head and the body in $work/body
+get_range() {
+    curl -s -D "$work/head" -o "$work/body" -H "Range: $2" "http://localhost:$port/$1"
+    tr -d '\r' < "$work/head" > "$work/head.txt"
+}
+
+# Function to get the value of header $1 from the last response
+header() {
+    awk -v name="$1:" 'tolower($1) == tolower(name) { sub(/^[^:]*: /, ""); print }' \
+        "$work/head.txt"
+}
+
+fail() {
+    echo "FAILED: $backend: $1"
+    failed=1
+}
+
+head -c 1000 /dev/urandom > "$work/object"
+: > "$work/empty"
+
+for backend in files store; do
+    case $backend in
+    files) start ;;
+    store) start -s 64 ;;
+    esac
+    curl -s -o /dev/null -H "Expect:" -T "$work/object" "http://localhost:$port/obj"
+    curl -s -o /dev/null -H "Expect:" -T "$work/empty" "http://localhost:$port/empty"
+
+    # A single range is the bytes alone
+    get_range obj "bytes=100-199"
+    if ! head -n 1 "$work/head.txt" | grep -q "^HTTP/1.1 206 " \
+        || [ "$(header Content-Range)" != "bytes 100-199/1000" ] \
+        || ! tail -c +101 "$work/object" | head -c 100 | cmp -s - "$work/body"; then
+        fail "single range"
+    fi
+
+    # A suffix range is the last bytes
+    get_range obj "bytes=-10"
+    if [ "$(header Content-Range)" != "bytes 990-999/1000" ] \
+        || ! tail -c 10 "$work/object" | cmp -s - "$work/body"; then
+        fail "suffix range"
+    fi
+
+    # Several ranges are parts of a multipart/byteranges body, in the order asked for, each
+    # after a delimiter and its own Content-Range
+    get_range obj "bytes=0-9,500-,-1"
+    boundary=$(header Content-Type | sed -n 's/^multipart\/byteranges; boundary=//p')
+    {
+        printf '\r\n--%s\r\nContent-Range: bytes 0-9/1000\r\n\r\n' "$boundary"
+        head -c 10 "$work/object"
+        printf '\r\n--%s\r\nContent-Range: bytes 500-999/1000\r\n\r\n' "$boundary"
+        tail -c +501 "$work/object"
+        printf '\r\n--%s\r\nContent-Range: bytes 999-999/1000\r\n\r\n' "$boundary"
+        tail -c 1 "$work/object"
+        printf '\r\n--%s--\r\n' "$boundary"
+    } > "$work/expected"
+    if ! head -n 1 "$work/head.txt" | grep -q "^HTTP/1.1 206 " || [ -z "$boundary" ] \
+        || ! cmp -s "$work/expected" "$work/body" \
+        || [ "$(header Content-Length)" != "$(stat -c %s "$work/expected")" ]; then
+        fail "multipart/byteranges body"
+    fi
+
+    # No byte of an empty object can be sent
+    get_range empty "bytes=0-"
+    if ! head -n 1 "$work/head.txt" | grep -q "^HTTP/1.1 416 " \
+        || [ "$(header Content-Range)" != "bytes */0" ]; then
+        fail "range of an empty object"
+    fi
+
+    # Nor a byte past the end of any object
+    get_range obj "bytes=1000-"
+    if ! head -n 1 "$work/head.txt" | grep -q "^HTTP/1.1 416 " \
+        || [ "$(header Content-Range)" != "bytes */1000" ]; then
+        fail "unsatisfiable range"
+    fi
+
+    # A malformed Range is ignored, and the whole object sent
+    get_range obj "bytes=9-5"
+    if ! head -n 1 "$work/head.txt" | grep -q "^HTTP/1.1 200 " \
+        || ! cmp -s "$work/object" "$work/body"; then
+        fail "malformed range"
+    fi
+    stop
+done
+
+if [ $failed -eq 0 ]; then
+    echo "SUCCESS: Range requests returned exactly the bytes asked for."
+    exit 0
+fi
+exit 1
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# Quick functional check of the server: a PUT that creates an object and one that replaces it,
+# a GET of it and of a missing one, then 20 concurrent PUTs and 20 concurrent GETs of other
+# objects.  Every request must get the right status and body, and be in the audit log, so load
+# shedding is off (-q 0) unless asked for.  Any server flags are passed on, e.g.
+# test_scripts/smoke.sh -n 3.
+#
+# usage: test_scripts/smoke.sh [server flags]    (from asgn4, after make)
+
+cd "$(dirname "$0")/.." || exit 1
+
+bin=$(realpath httpserver)
+work=$(mktemp -d)
+server=
+failed=0
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+mkdir "$work/data"
+port=$((20000 + RANDOM % 20000))
+(cd "$work/data" && exec "$bin" -t 4 -q 0 -l "$work/audit.log" "$@" "$port" 2>/dev/null) &
+server=$!
+until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+    kill -0 $server 2>/dev/null || { echo "FAILED: The server did not start."; exit 1; }
+    sleep 0.01
+done
+
+# Function to check that $1 (what a request got) is $2
+expect() {
+    if [ "$1" != "$2" ]; then
+        echo "FAILED: $3 got \"$1\" instead of \"$2\"."
+        failed=1
+    fi
+}
+
+printf 'hello world\n' > "$work/body"
+put() {
+    curl -s -H "Expect:" -o /dev/null -w "%{http_code}" -T "$work/body" "http://localhost:$port/$1"
+}
+expect "$(put foo.txt)" 201 "PUT of a new object"
+expect "$(put foo.txt)" 200 "PUT over an object"
+expect "$(curl -s "http://localhost:$port/foo.txt")" "hello world" "GET"
+expect "$(curl -s -o /dev/null -w "%{http_code}" "http://localhost:$port/missing")" 404 \
+    "GET of a missing object"
+
+# Function to wait for the clients started in the background, but not the server
+wait_clients() {
+    wait "${clients[@]}"
+    clients=()
+}
+
+clients=()
+for i in $(seq 20); do
+    put "f$i" > "$work/put$i" &
+    clients+=($!)
+done
+wait_clients
+for i in $(seq 20); do
+    curl -s "http://localhost:$port/f$i" > "$work/get$i" &
+    clients+=($!)
+done
+wait_clients
+for i in $(seq 20); do
+    expect "$(cat "$work/put$i")" 201 "concurrent PUT of /f$i"
+    expect "$(cat "$work/get$i")" "hello world" "concurrent GET of /f$i"
+done
+
+kill $server
+wait $server 2>/dev/null
+server=
+expect "$(wc -l < "$work/audit.log")" 44 "the audit log's line count"
+
+if [ $failed -eq 0 ]; then
+    echo "SUCCESS: Every request got the right status and body, and was logged."
+    exit 0
+fi
+exit 1
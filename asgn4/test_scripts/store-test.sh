@@ -0,0 +1,133 @@
+#!/bin/bash
+
+# Checks the log-structured store (-s): small objects read back from their records, an object
+# that grows past the limit or shrinks under it leaves no stale file or record behind, the
+# records are found again after a restart, a mostly dead segment is compacted away without
+# losing the live data, and a torn record at the end of a segment is skipped on startup.
+#
+# usage: test_scripts/store-test.sh    (from asgn4, after make)
+
+cd "$(dirname "$0")/.." || exit 1
+
+bin=$(realpath httpserver)
+work=$(mktemp -d)
+server=
+failed=0
+
+cleanup() {
+    [ -n "$server" ] && kill "$server" 2>/dev/null
+    rm -rf "$work"
+}
+trap cleanup EXIT
+
+# Function to start the server on a new port in $work/data, and wait until it answers
+start() {
+    port=$((20000 + RANDOM % 20000))
+    (cd "$work/data" && exec "$bin" -s 64 "$port" 2>/dev/null) &
+    server=$!
+    until curl -s -o /dev/null "http://localhost:$port/metrics"; do
+        kill -0 $server 2>/dev/null || { echo "FAILED: The server did not start."; exit 1; }
+        sleep 0.01
+    done
+}
+
+stop() {
+    kill $server
+    wait $server 2>/dev/null
+    server=
+}
+
+put() {
+    curl -s -o /dev/null -H "Expect:" -T "$2" "http://localhost:$port/$1"
+}
+
+# Function to check that GET /$1 returns exactly the bytes in file $2
+check_get() {
+    if ! curl -s "http://localhost:$port/$1" | cmp -s - "$2"; then
+        echo "FAILED: $3: GET /$1 did not return what was PUT."
+        failed=1
+    fi
+}
+
+metric() {
+    curl -s "http://localhost:$port/metrics" | awk -v name="$1" '$1 == name { print $2 }'
+}
+
+mkdir "$work/data"
+head -c 1000 /dev/urandom > "$work/small"
+head -c 2000 /dev/urandom > "$work/small2"
+head -c 200000 /dev/urandom > "$work/large"
+
+start
+
+# A small PUT goes to a record rather than a file
+put a "$work/small"
+check_get a "$work/small" "small PUT"
+if [ -e "$work/data/a" ] || [ "$(metric httpserver_store_objects)" != 1 ]; then
+    echo "FAILED: small PUT: /a was not kept in the store."
+    failed=1
+fi
+
+# Growing past the limit replaces the record with a file, and shrinking back removes the file
+put b "$work/small"
+put b "$work/large"
+check_get b "$work/large" "small to large"
+if [ ! -f "$work/data/b" ] || [ "$(metric httpserver_store_objects)" != 1 ]; then
+    echo "FAILED: small to large: the record of /b was not replaced by a file."
+    failed=1
+fi
+put b "$work/small2"
+check_get b "$work/small2" "large to small"
+if [ -e "$work/data/b" ] || [ "$(metric httpserver_store_objects)" != 2 ]; then
+    echo "FAILED: large to small: the file of /b was not removed."
+    failed=1
+fi
+
+# The records are found again after a restart
+stop
+start
+check_get a "$work/small" "restart"
+check_get b "$work/small2" "restart"
+
+# Overwriting one URI until the segment after the restart is sealed leaves it mostly dead, so the
+# compactor copies what is still live elsewhere and deletes it
+head -c 60000 /dev/urandom > "$work/chunk"
+for i in $(seq 300); do
+    put c "$work/chunk"
+done
+for i in $(seq 50); do
+    [ "$(metric httpserver_store_compactions_total)" -gt 0 ] && break
+    sleep 0.1
+done
+if [ "$(metric httpserver_store_compactions_total)" -eq 0 ] \
+    || [ -e "$work/data/_store/00000001.seg" ]; then
+    echo "FAILED: compaction: the mostly dead segment was not compacted."
+    failed=1
+fi
+check_get a "$work/small" "compaction"
+check_get b "$work/small2" "compaction"
+check_get c "$work/chunk" "compaction"
+
+# A newer record of /a cut short at the end of the last segment is skipped on startup, leaving
+# the older one
+put a "$work/small2"
+stop
+last=$(ls "$work/data/_store"/*.seg | tail -n 1)
+truncate -s -100 "$last"
+start
+check_get a "$work/small" "torn record"
+check_get b "$work/small2" "torn record"
+check_get c "$work/chunk" "torn record"
+
+# And the segment can still be appended to afterwards
+put d "$work/small"
+stop
+start
+check_get d "$work/small" "append after torn record"
+stop
+
+if [ $failed -eq 0 ]; then
+    echo "SUCCESS: The store kept every object through overwrites, restarts and compaction."
+    exit 0
+fi
+exit 1
@@ -0,0 +1,215 @@
+/**
+ * @File chunked_test.c
+ *
+ * Checks chunked_decode against valid and malformed chunked bodies.  Each
+ * body is fed to the decoder whole, a byte at a time, and split in two at
+ * every offset, so every state of the framing sees its input end midway;
+ * each way must decode the same data, stop at the same byte, and agree on
+ * whether the body is malformed.
+ *
+ * usage: ./tests/chunked_test
+ *
+ * Prints the cases that fail, and exits non-zero if any do.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunked.h"
+
+#define MAX_BODY 8192
+
+typedef struct {
+    const char *name;
+    const char *body;
+    chunked_status_t status; // once all of body has been offered
+    const char *data; // the data decoded, if the body is valid
+    size_t end; // bytes consumed, if less than all of body (what follows is the next request)
+} case_t;
+
+static const case_t cases[] = {
+    { "empty body", "0\r\n\r\n", CHUNKED_DONE, "", 0 },
+    { "one chunk", "4\r\nWiki\r\n0\r\n\r\n", CHUNKED_DONE, "Wiki", 0 },
+    { "several chunks", "4\r\nWiki\r\n5\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\n\r\n",
+        CHUNKED_DONE, "Wikipedia in\r\n\r\nchunks.", 0 },
+    { "hex sizes", "a\r\n0123456789\r\nB\r\n0123456789A\r\n0\r\n\r\n", CHUNKED_DONE,
+        "01234567890123456789A", 0 },
+    { "extensions", "4;name=value\r\nWiki\r\n5 ; a=\"b;c\"\r\npedia\r\n0;last\r\n\r\n",
+        CHUNKED_DONE, "Wikipedia", 0 },
+    { "trailers", "4\r\nWiki\r\n0\r\nExpires: never\r\nX-Sum: 1\r\n\r\n", CHUNKED_DONE, "Wiki",
+        0 },
+    { "15 hex digits", "000000000000004\r\nWiki\r\n0\r\n\r\n", CHUNKED_DONE, "Wiki", 0 },
+    { "pipelined request", "4\r\nWiki\r\n0\r\n\r\nGET /a HTTP/1.1\r\n\r\n", CHUNKED_DONE, "Wiki",
+        14 },
+    { "pipelined after trailers", "0\r\nX: 1\r\n\r\nPUT /b HTTP/1.1\r\n\r\n", CHUNKED_DONE, "",
+        11 },
+    { "unfinished size line", "4\r", CHUNKED_MORE, NULL, 0 },
+    { "unfinished data", "4\r\nWi", CHUNKED_MORE, NULL, 0 },
+    { "unfinished trailers", "4\r\nWiki\r\n0\r\nX: 1\r\n", CHUNKED_MORE, NULL, 0 },
+    { "16 hex digits", "0000000000000004\r\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "size over 2^60", "1000000000000000\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "no size", "\r\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "extension without size", ";x\r\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bad size", "4x\r\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF after size", "4\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF in extension", "4;a\nWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "CR without LF after size", "4\rWiki\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF after data", "4\r\nWiki\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare CR after data", "4\r\nWiki\r0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "data too long", "4\r\nWikipedia\r\n0\r\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF in trailer", "0\r\nX: 1\n\r\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF ending body", "0\r\n\n", CHUNKED_ERROR, NULL, 0 },
+    { "bare LF ending trailers", "0\r\nX: 1\r\n\n", CHUNKED_ERROR, NULL, 0 },
+};
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+typedef struct {
+    chunked_status_t status;
+    char data[MAX_BODY];
+    size_t data_len;
+    size_t consumed;
+} result_t;
+
+// Function to feed body to a new decoder in pieces of at most piece bytes, except that the first
+// piece is first bytes long, the way a connection would: offering what it has not consumed yet
+// again along with what arrives next
+static void decode(const char *body, size_t len, size_t first, size_t piece, result_t *r) {
+    chunked_decoder_t d;
+    chunked_init(&d);
+    r->data_len = 0;
+    r->consumed = 0;
+    size_t avail = first < len ? first : len;
+    while (chunked_status(&d) == CHUNKED_MORE) {
+        const char *data;
+        size_t data_len;
+        size_t n = chunked_decode(&d, body + r->consumed, avail - r->consumed, &data, &data_len);
+        memcpy(r->data + r->data_len, data, data_len);
+        r->data_len += data_len;
+        r->consumed += n;
+        if (r->consumed == avail) {
+            if (avail == len) {
+                break;
+            }
+            avail = len - avail < piece ? len : avail + piece;
+        }
+    }
+    r->status = chunked_status(&d);
+}
+
+// Function to check one way of feeding a case, printing what went wrong if anything did
+static bool check(const case_t *c, const char *how, const result_t *r) {
+    size_t len = strlen(c->body);
+    size_t end = c->end > 0 ? c->end : len;
+    const char *wrong = NULL;
+    if (r->status != c->status) {
+        wrong = "status";
+    } else if (c->status == CHUNKED_ERROR) {
+        return true;
+    } else if (r->consumed != end) {
+        wrong = "bytes consumed";
+    } else if (c->data != NULL
+               && (r->data_len != strlen(c->data) || memcmp(r->data, c->data, r->data_len) != 0)) {
+        wrong = "data";
+    }
+    if (wrong != NULL) {
+        fprintf(stderr, "%s (%s): wrong %s (status %d, consumed %zu, data \"%.*s\")\n", c->name,
+            how, wrong, (int) r->status, r->consumed, (int) r->data_len, r->data);
+        return false;
+    }
+    return true;
+}
+
+// Function to run a case whole, a byte at a time, and split in two at every offset
+static bool run_case(const case_t *c) {
+    size_t len = strlen(c->body);
+    result_t r;
+    bool ok = true;
+    decode(c->body, len, len, len, &r);
+    ok = check(c, "whole", &r) && ok;
+    decode(c->body, len, 1, 1, &r);
+    ok = check(c, "bytewise", &r) && ok;
+    for (size_t split = 1; split < len && ok; split++) {
+        char how[32];
+        snprintf(how, sizeof(how), "split at %zu", split);
+        decode(c->body, len, split, len, &r);
+        ok = check(c, how, &r);
+    }
+    return ok;
+}
+
+// Function to check the bound on a run of framing: a size line of exactly CHUNKED_MAX_FRAMING
+// bytes is accepted, and one a byte longer is not
+static bool run_framing_limit(void) {
+    static char body[MAX_BODY];
+    bool ok = true;
+    for (size_t line = CHUNKED_MAX_FRAMING; line <= CHUNKED_MAX_FRAMING + 1; line++) {
+        // "1;" + extension + "\r\n" is line bytes long
+        memset(body, 'x', line);
+        memcpy(body, "1;", 2);
+        memcpy(body + line - 2, "\r\nW\r\n0\r\n\r\n", 11);
+        case_t c = { "", body, CHUNKED_DONE, "W", 0 };
+        char name[48];
+        snprintf(name, sizeof(name), "size line of %zu bytes", line);
+        c.name = name;
+        if (line > CHUNKED_MAX_FRAMING) {
+            c.status = CHUNKED_ERROR;
+        }
+        ok = run_case(&c) && ok;
+    }
+
+    // Trailers count towards the same limit, as they follow the last data
+    size_t n = 0;
+    n += (size_t) sprintf(body, "1\r\nW\r\n0\r\n");
+    while (n < CHUNKED_MAX_FRAMING) {
+        n += (size_t) sprintf(body + n, "X: 1\r\n");
+    }
+    strcpy(body + n, "\r\n");
+    case_t c = { "trailers over the limit", body, CHUNKED_ERROR, NULL, 0 };
+    return run_case(&c) && ok;
+}
+
+// Function to check that data moved with chunked_data_left and chunked_skip_data, as the
+// zero-copy path does, is accounted for like decoded data
+static bool run_skip(void) {
+    const char *body = "4\r\nWiki\r\n5\r\npedia\r\n0\r\n\r\n";
+    size_t len = strlen(body), i = 0;
+    chunked_decoder_t d;
+    chunked_init(&d);
+    while (chunked_status(&d) == CHUNKED_MORE && i < len) {
+        const char *data;
+        size_t data_len;
+        uint64_t left = chunked_data_left(&d);
+        if (left > 0) {
+            chunked_skip_data(&d, left);
+            i += left;
+            continue;
+        }
+        i += chunked_decode(&d, body + i, 1, &data, &data_len);
+        if (data_len > 0) {
+            fprintf(stderr, "skipped data: decoded data that chunked_data_left did not report\n");
+            return false;
+        }
+    }
+    if (chunked_status(&d) != CHUNKED_DONE || i != len || d.total != 9) {
+        fprintf(stderr, "skipped data: status %d, consumed %zu, total %lu\n",
+            (int) chunked_status(&d), i, (unsigned long) d.total);
+        return false;
+    }
+    return true;
+}
+
+int main(void) {
+    bool ok = true;
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        ok = run_case(&cases[i]) && ok;
+    }
+    ok = run_framing_limit() && ok;
+    ok = run_skip() && ok;
+    if (!ok) {
+        return EXIT_FAILURE;
+    }
+    printf("chunked_test: all %zu cases passed\n", NUM_CASES + 4);
+    return EXIT_SUCCESS;
+}
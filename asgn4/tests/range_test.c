@@ -0,0 +1,128 @@
+/**
+ * @File range_test.c
+ *
+ * Checks range_parse against Range header values: single ranges, suffix
+ * ("-n") and open-ended ("n-") ones, several at once, ones that can't be
+ * satisfied (416), malformed ones (ignored), and ranges of an empty
+ * object.
+ *
+ * usage: ./tests/range_test
+ *
+ * Prints the cases that fail, and exits non-zero if any do.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "range.h"
+
+#define MAX_EXPECTED 3
+
+typedef struct {
+    const char *value;
+    uint64_t size;
+    int n; // range_parse's result
+    byte_range_t ranges[MAX_EXPECTED];
+} case_t;
+
+static const case_t cases[] = {
+    // Satisfiable
+    { "bytes=0-9", 100, 1, { { 0, 9 } } },
+    { "bytes=0-0", 100, 1, { { 0, 0 } } },
+    { "bytes=99-99", 100, 1, { { 99, 99 } } },
+    { "bytes=10-", 100, 1, { { 10, 99 } } },
+    { "bytes=0-", 100, 1, { { 0, 99 } } },
+    { "bytes=-10", 100, 1, { { 90, 99 } } },
+    { "bytes=-100", 100, 1, { { 0, 99 } } },
+    { "bytes=-200", 100, 1, { { 0, 99 } } },
+    { "bytes=90-200", 100, 1, { { 90, 99 } } },
+    { "bytes=0-18446744073709551616", 100, 1, { { 0, 99 } } },
+    { "bytes=0-0,-1", 100, 2, { { 0, 0 }, { 99, 99 } } },
+    { "bytes=50-59,0-9,90-", 100, 3, { { 50, 59 }, { 0, 9 }, { 90, 99 } } },
+    { "bytes=0-9,5-14", 100, 2, { { 0, 9 }, { 5, 14 } } },
+    { "bytes= 1-2 ,\t3-4 ", 100, 2, { { 1, 2 }, { 3, 4 } } },
+    { "bytes=0-9,,20-29,", 100, 2, { { 0, 9 }, { 20, 29 } } },
+    { "bytes=100-,0-9", 100, 1, { { 0, 9 } } },
+    { "bytes=0-", 1, 1, { { 0, 0 } } },
+    { "bytes=-1", 1, 1, { { 0, 0 } } },
+
+    // Unsatisfiable: 416
+    { "bytes=100-", 100, 0, { { 0, 0 } } },
+    { "bytes=100-199", 100, 0, { { 0, 0 } } },
+    { "bytes=-0", 100, 0, { { 0, 0 } } },
+    { "bytes=100-,200-300,-0", 100, 0, { { 0, 0 } } },
+    { "bytes=18446744073709551616-", 100, 0, { { 0, 0 } } },
+
+    // An empty object has no bytes to send
+    { "bytes=0-", 0, 0, { { 0, 0 } } },
+    { "bytes=0-0", 0, 0, { { 0, 0 } } },
+    { "bytes=-5", 0, 0, { { 0, 0 } } },
+    { "bytes=0-9,-1", 0, 0, { { 0, 0 } } },
+    { "bytes=x", 0, -1, { { 0, 0 } } },
+
+    // Malformed: the header is ignored
+    { "items=0-9", 100, -1, { { 0, 0 } } },
+    { "bytes 0-9", 100, -1, { { 0, 0 } } },
+    { "bytes=", 100, -1, { { 0, 0 } } },
+    { "bytes=,", 100, -1, { { 0, 0 } } },
+    { "bytes= ", 100, -1, { { 0, 0 } } },
+    { "bytes=0", 100, -1, { { 0, 0 } } },
+    { "bytes=-", 100, -1, { { 0, 0 } } },
+    { "bytes=--5", 100, -1, { { 0, 0 } } },
+    { "bytes=9-5", 100, -1, { { 0, 0 } } },
+    { "bytes=a-b", 100, -1, { { 0, 0 } } },
+    { "bytes=0-9x", 100, -1, { { 0, 0 } } },
+    { "bytes=0-9;20-29", 100, -1, { { 0, 0 } } },
+    { "bytes=0-9 20-29", 100, -1, { { 0, 0 } } },
+    { "bytes=0-9,9-5", 100, -1, { { 0, 0 } } },
+    { "bytes=+1-2", 100, -1, { { 0, 0 } } },
+};
+#define NUM_CASES (sizeof(cases) / sizeof(cases[0]))
+
+// Function to check range_parse's result on value against the n ranges expected
+static bool check(const char *value, uint64_t size, int n, const byte_range_t *expected) {
+    byte_range_t ranges[RANGE_MAX];
+    int got = range_parse(value, size, ranges);
+    bool ok = got == n;
+    for (int i = 0; ok && i < n; i++) {
+        ok = ranges[i].first == expected[i].first && ranges[i].last == expected[i].last;
+    }
+    if (!ok) {
+        fprintf(stderr, "\"%s\" of %lu bytes: got %d", value, (unsigned long) size, got);
+        for (int i = 0; i < got; i++) {
+            fprintf(stderr, " %lu-%lu", (unsigned long) ranges[i].first,
+                (unsigned long) ranges[i].last);
+        }
+        fprintf(stderr, ", expected %d\n", n);
+    }
+    return ok;
+}
+
+// Function to check that RANGE_MAX ranges are returned, and that one more has the header ignored,
+// even if the extra one is unsatisfiable
+static bool check_range_max(void) {
+    char value[RANGE_MAX * 16 + 32] = "bytes=";
+    byte_range_t expected[RANGE_MAX];
+    for (int i = 0; i < RANGE_MAX; i++) {
+        sprintf(value + strlen(value), "%s%d-%d", i > 0 ? "," : "", i * 2, i * 2);
+        expected[i].first = expected[i].last = (uint64_t) i * 2;
+    }
+    bool ok = check(value, 100, RANGE_MAX, expected);
+    strcat(value, ",1000-");
+    return check(value, 100, -1, expected) && ok;
+}
+
+int main(void) {
+    bool ok = true;
+    for (size_t i = 0; i < NUM_CASES; i++) {
+        ok = check(cases[i].value, cases[i].size, cases[i].n, cases[i].ranges) && ok;
+    }
+    ok = check_range_max() && ok;
+    if (!ok) {
+        return EXIT_FAILURE;
+    }
+    printf("range_test: all %zu cases passed\n", NUM_CASES + 2);
+    return EXIT_SUCCESS;
+}
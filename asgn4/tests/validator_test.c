@@ -0,0 +1,117 @@
+/**
+ * @File validator_test.c
+ *
+ * Checks validator_not_modified against conditional request headers:
+ * If-None-Match with a tag, "*", lists, and weak tags, If-Modified-Since
+ * with past, future, and unparseable dates, and If-None-Match taking
+ * precedence when a request has both.
+ *
+ * usage: ./tests/validator_test
+ *
+ * Prints the cases that fail, and exits non-zero if any do.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "validator.h"
+
+#define MTIME    1000000000 // Sun, 09 Sep 2001 01:46:40 GMT
+#define BEFORE   "Sun, 09 Sep 2001 01:46:39 GMT"
+#define AT       "Sun, 09 Sep 2001 01:46:40 GMT"
+#define AFTER    "Mon, 10 Sep 2001 00:00:00 GMT"
+#define FUTURE   "Fri, 31 Dec 9999 23:59:59 GMT"
+#define MAX_TAGS 160
+
+static int failures = 0;
+
+// Function to check one pair of headers; NULL means the request doesn't have that header
+static void check(const validator_t *v, const char *inm, const char *ims, bool expected) {
+    if (validator_not_modified(v, inm, ims) != expected) {
+        fprintf(stderr, "ETag %s, If-None-Match: %s, If-Modified-Since: %s: expected %s\n",
+            v->etag, inm != NULL ? inm : "(none)", ims != NULL ? ims : "(none)",
+            expected ? "304" : "the object");
+        failures++;
+    }
+}
+
+int main(void) {
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_ino = 42;
+    st.st_size = 10;
+    st.st_mtim.tv_sec = MTIME;
+    st.st_mtim.tv_nsec = 5;
+    validator_t v;
+    validator_from_stat(&v, &st);
+    if (strcmp(v.last_modified, AT) != 0) {
+        fprintf(stderr, "Last-Modified: %s, expected %s\n", v.last_modified, AT);
+        failures++;
+    }
+    char tag[MAX_TAGS];
+
+    // Neither header: send the object
+    check(&v, NULL, NULL, false);
+
+    // If-None-Match
+    check(&v, v.etag, NULL, true);
+    check(&v, "\"2a-0-a\"", NULL, false);
+    check(&v, "*", NULL, true);
+    check(&v, " *", NULL, true);
+    snprintf(tag, sizeof(tag), "W/%s", v.etag);
+    check(&v, tag, NULL, true);
+    snprintf(tag, sizeof(tag), "\"a\", \"b\",%s", v.etag);
+    check(&v, tag, NULL, true);
+    snprintf(tag, sizeof(tag), "\"a\",\tW/%s , \"b\"", v.etag);
+    check(&v, tag, NULL, true);
+    check(&v, "\"a\", \"b\"", NULL, false);
+    check(&v, "", NULL, false);
+    check(&v, "\"a", NULL, false);
+    snprintf(tag, sizeof(tag), "%.*s", (int) strlen(v.etag) - 1, v.etag);
+    check(&v, tag, NULL, false);
+    snprintf(tag, sizeof(tag), "%.*sx\"", (int) strlen(v.etag) - 1, v.etag);
+    check(&v, tag, NULL, false);
+    snprintf(tag, sizeof(tag), "%s", v.etag + 1);
+    check(&v, tag, NULL, false);
+
+    // If-Modified-Since
+    check(&v, NULL, AT, true);
+    check(&v, NULL, AFTER, true);
+    check(&v, NULL, BEFORE, false);
+    check(&v, NULL, FUTURE, false);
+    check(&v, NULL, "yesterday", false);
+    check(&v, NULL, "", false);
+    check(&v, NULL, AT " ", false);
+    check(&v, NULL, "Sunday, 09-Sep-01 01:46:40 GMT", false);
+    check(&v, NULL, "Sun Sep  9 01:46:40 2001", false);
+    check(&v, NULL, "Sun, 09 Sep 2001 25:46:40 GMT", false);
+
+    // If-None-Match takes precedence, whatever If-Modified-Since says
+    check(&v, "\"a\"", AT, false);
+    check(&v, "\"a\"", AFTER, false);
+    check(&v, v.etag, BEFORE, true);
+    check(&v, "*", "yesterday", true);
+    check(&v, "", AT, false);
+
+    // The gzip form has a tag of its own, which the plain one doesn't match, nor the other way
+    validator_t gz = v;
+    validator_gzip(&gz);
+    check(&gz, gz.etag, NULL, true);
+    check(&gz, v.etag, NULL, false);
+    check(&v, gz.etag, NULL, false);
+
+    // A record's tag can't match a file's with the same numbers
+    validator_t rec;
+    validator_from_record(&rec, 42, (int64_t) MTIME * 1000000000 + 5, 10);
+    check(&rec, rec.etag, NULL, true);
+    check(&rec, v.etag, NULL, false);
+    check(&rec, NULL, AT, true);
+
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    printf("validator_test: all cases passed\n");
+    return EXIT_SUCCESS;
+}
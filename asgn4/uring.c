@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.h"
+
+#define RING_ENTRIES 8
+#define SLOT         0 // the fixed-file slot objects are opened into
+
+// Build with IO_URING=0 to always use open and read, for comparison
+#ifndef IO_URING
+#define IO_URING 1
+#endif
+
+typedef struct uring {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map; // the same mapping as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    size_t sqes_size;
+    unsigned tail; // our copy of the SQ tail, published on submit
+    unsigned queued; // SQEs written since the last submit
+    char *buffer;
+    bool registered; // buffer is registered, so reads into it can be READ_FIXED
+} uring_t;
+
+static bool supported = false;
+static _Thread_local uring_t *ring = NULL;
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned submit, unsigned wait) {
+    return (int) syscall(__NR_io_uring_enter, fd, submit, wait, IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned n) {
+    return (int) syscall(__NR_io_uring_register, fd, op, arg, n);
+}
+
+static void ring_delete(uring_t *r) {
+    if (r->sqes != NULL && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_map != NULL && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_size);
+    }
+    if (r->sq_map != NULL && r->sq_map != MAP_FAILED) {
+        munmap(r->sq_map, r->sq_map_size);
+    }
+
+    // Closing the ring closes whatever is in its file table
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(r->buffer);
+    free(r);
+}
+
+static uring_t *ring_new(void) {
+    uring_t *r = calloc(1, sizeof(uring_t));
+    if (r == NULL) {
+        return NULL;
+    }
+    r->fd = -1;
+
+    // The ring is only ever used by the thread that made it, and only while it waits on it
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    r->fd = sys_setup(RING_ENTRIES, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        r->fd = sys_setup(RING_ENTRIES, &p);
+    }
+    if (r->fd < 0) {
+        ring_delete(r);
+        return NULL;
+    }
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_size > r->sq_map_size) {
+            r->sq_map_size = r->cq_map_size;
+        }
+        r->cq_map_size = r->sq_map_size;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = p.features & IORING_FEAT_SINGLE_MMAP
+                    ? r->sq_map
+                    : mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+        IORING_OFF_SQES);
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        ring_delete(r);
+        return NULL;
+    }
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    r->tail = *r->sq_tail;
+
+    // One (initially empty) fixed-file slot, so objects never take up a descriptor
+    int files[1] = { -1 };
+    r->buffer = aligned_alloc(4096, URING_BUFFER_SIZE);
+    if (r->buffer == NULL || sys_register(r->fd, IORING_REGISTER_FILES, files, 1) < 0) {
+        ring_delete(r);
+        return NULL;
+    }
+
+    // Registering the buffer counts against RLIMIT_MEMLOCK; without it, reads still work
+    struct iovec iov = { r->buffer, URING_BUFFER_SIZE };
+    r->registered = sys_register(r->fd, IORING_REGISTER_BUFFERS, &iov, 1) == 0;
+    return r;
+}
+
+// Function to get the calling thread's ring, setting it up on first use
+static uring_t *ring_get(void) {
+    if (ring == NULL && supported) {
+        ring = ring_new();
+    }
+    return ring;
+}
+
+// Function to claim the next SQE; the caller fills it in
+static struct io_uring_sqe *sqe_next(uring_t *r, uint8_t opcode, uint64_t user_data) {
+    unsigned index = r->tail++ & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    r->sq_array[index] = index;
+    r->queued++;
+    return sqe;
+}
+
+// Function to publish the queued SQEs to the kernel; the next sys_enter submits them
+static unsigned publish(uring_t *r) {
+    __atomic_store_n(r->sq_tail, r->tail, __ATOMIC_RELEASE);
+    unsigned n = r->queued;
+    r->queued = 0;
+    return n;
+}
+
+// Function to submit the queued SQEs and wait for all of them to complete; res[i] gets the
+// result of the SQE whose user_data is i.  Returns -1 if the ring itself failed.
+static int ring_run(uring_t *r, int *res) {
+    unsigned unsubmitted = publish(r);
+    unsigned outstanding = unsubmitted;
+    while (outstanding > 0) {
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, outstanding--) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            res[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        if (outstanding == 0) {
+            break;
+        }
+        int n = sys_enter(r->fd, unsubmitted, outstanding);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        unsubmitted -= n > 0 ? (unsigned) n : 0;
+    }
+    return 0;
+}
+
+// Function to queue opening path into the slot; returns the SQE, for the caller to link
+static struct io_uring_sqe *queue_open(uring_t *r, const char *path, uint64_t user_data) {
+    struct io_uring_sqe *sqe = sqe_next(r, IORING_OP_OPENAT, user_data);
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t) (uintptr_t) path;
+    sqe->open_flags = O_RDONLY; // a fixed file has no descriptor for O_CLOEXEC to apply to
+    sqe->file_index = SLOT + 1;
+    return sqe;
+}
+
+bool uring_init(void) {
+    if (!IO_URING) {
+        return false;
+    }
+    uring_t *r = ring_new();
+    if (r == NULL) {
+        return false;
+    }
+
+    // Probing (5.6) tells whether the operations exist at all
+    size_t size
+        = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe != NULL && sys_register(r->fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        uint8_t needed[]
+            = { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_READ_FIXED, IORING_OP_CLOSE };
+        supported = true;
+        for (size_t i = 0; i < sizeof(needed); i++) {
+            uint8_t op = needed[i];
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                supported = false;
+            }
+        }
+    }
+    free(probe);
+
+    // but not whether OPENAT can open into a fixed-file slot (5.15).  A kernel that can returns
+    // 0; one that can't ignores file_index and returns a descriptor.
+    int res[1] = { -1 };
+    if (supported) {
+        queue_open(r, "/", 0);
+        supported = ring_run(r, res) == 0 && res[0] == 0;
+        if (res[0] > 0) {
+            close(res[0]);
+        }
+    }
+    ring_delete(r);
+    return supported;
+}
+
+int uring_read(const char *path, uint64_t size, const char **data) {
+    uring_t *r = size <= URING_BUFFER_SIZE ? ring_get() : NULL;
+    if (r == NULL) {
+        return ENOSYS;
+    }
+
+    // The read only runs if the open succeeded, and the close whether or not the read did.  For
+    // an object in the page cache, all three complete inline, without handing off to a kernel
+    // worker thread.
+    struct io_uring_sqe *sqe = queue_open(r, path, 0);
+    sqe->flags = IOSQE_IO_LINK;
+
+    sqe = sqe_next(r, r->registered ? IORING_OP_READ_FIXED : IORING_OP_READ, 1);
+    sqe->fd = SLOT;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+    sqe->addr = (uint64_t) (uintptr_t) r->buffer;
+    sqe->len = (uint32_t) size;
+    sqe->off = 0;
+    sqe->buf_index = 0;
+
+    sqe = sqe_next(r, IORING_OP_CLOSE, 2);
+    sqe->file_index = SLOT + 1;
+
+    int res[3];
+    if (ring_run(r, res) < 0) {
+        // Whatever state the ring is in, it is of no more use
+        uring_detach();
+        return ENOSYS;
+    }
+    if (res[0] < 0 || res[1] < 0) {
+        return res[0] < 0 ? -res[0] : -res[1];
+    }
+    if ((uint64_t) res[1] != size) {
+        return EIO;
+    }
+    *data = r->buffer;
+    return 0;
+}
+
+void uring_detach(void) {
+    if (ring != NULL) {
+        ring_delete(ring);
+        ring = NULL;
+    }
+}
@@ -0,0 +1,44 @@
+/**
+ * @File uring.h
+ *
+ * An io_uring backend for reading small objects, driven through the raw
+ * system calls.  Each worker thread gets its own ring the first time it
+ * calls uring_read, with one fixed-file slot and one registered buffer of
+ * URING_BUFFER_SIZE bytes.  A single submission then opens an object into
+ * the slot, reads it into the buffer and closes it again, where open,
+ * read and close would each have been a system call.
+ *
+ * Build with IO_URING=0, or run on a kernel without io_uring (or one that
+ * forbids it), and uring_read always fails with ENOSYS; callers then fall
+ * back to open and read.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define URING_BUFFER_SIZE (64 * 1024) // the largest object uring_read reads
+
+/** @brief Check that io_uring can be used, and that it supports the
+ *         operations we need.  Call once, before any uring_read.
+ *
+ *  @return whether uring_read will be used.
+ */
+bool uring_init(void);
+
+/** @brief Read all size bytes (at most URING_BUFFER_SIZE) of the regular
+ *         file at path into the calling thread's buffer, in one
+ *         submission on its ring.  *data stays valid until the thread's
+ *         next uring_read.
+ *
+ *  @return 0, the errno the open or read failed with (EIO if the file
+ *          was shorter than size), or ENOSYS if the backend is not in use
+ *          or the thread's ring could not be set up.
+ */
+int uring_read(const char *path, uint64_t size, const char **data);
+
+/** @brief Tear down the calling thread's ring, if it has one; for a
+ *         worker that is about to exit.
+ */
+void uring_detach(void);
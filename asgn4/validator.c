@@ -0,0 +1,91 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "validator.h"
+
+#define HTTP_DATE "%a, %d %b %Y %H:%M:%S GMT" // IMF-fixdate
+
+void validator_from_stat(validator_t *v, const struct stat *st) {
+    uint64_t mtime_ns
+        = (uint64_t) st->st_mtim.tv_sec * 1000000000 + (uint64_t) st->st_mtim.tv_nsec;
+    snprintf(v->etag, sizeof(v->etag), "\"%lx-%lx-%lx\"", (uint64_t) st->st_ino, mtime_ns,
+        (uint64_t) st->st_size);
+
+    struct tm tm;
+    time_t mtime = st->st_mtim.tv_sec;
+    gmtime_r(&mtime, &tm);
+    strftime(v->last_modified, sizeof(v->last_modified), HTTP_DATE, &tm);
+    v->mtime = (int64_t) mtime;
+}
+
+void validator_from_record(validator_t *v, uint64_t version, int64_t mtime_ns, uint64_t size) {
+    snprintf(v->etag, sizeof(v->etag), "\"s%lx-%lx-%lx\"", version, (uint64_t) mtime_ns, size);
+
+    struct tm tm;
+    time_t mtime = (time_t) (mtime_ns / 1000000000);
+    gmtime_r(&mtime, &tm);
+    strftime(v->last_modified, sizeof(v->last_modified), HTTP_DATE, &tm);
+    v->mtime = (int64_t) mtime;
+}
+
+void validator_gzip(validator_t *v) {
+    size_t len = strlen(v->etag);
+    if (len >= 2 && len + 3 < sizeof(v->etag)) {
+        memcpy(v->etag + len - 1, "-gz\"", 5);
+    }
+}
+
+// Function to check an If-None-Match list for the ETag.  GETs compare weakly, so a "W/" in front
+// of a tag doesn't matter.
+static bool etag_listed(const char *etag, const char *list) {
+    size_t len = strlen(etag);
+    const char *p = list;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        if (strncmp(p, "W/", 2) == 0) {
+            p += 2;
+        }
+        if (*p != '"') {
+            return false; // malformed; not a match
+        }
+        const char *end = strchr(p + 1, '"');
+        if (end == NULL) {
+            return false;
+        }
+        if ((size_t) (end + 1 - p) == len && strncmp(p, etag, len) == 0) {
+            return true;
+        }
+        p = end + 1;
+    }
+    return false;
+}
+
+bool validator_not_modified(
+    const validator_t *v, const char *if_none_match, const char *if_modified_since) {
+    if (if_none_match != NULL) {
+        return etag_listed(v->etag, if_none_match);
+    }
+    if (if_modified_since == NULL) {
+        return false;
+    }
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(if_modified_since, HTTP_DATE, &tm);
+    if (end == NULL || *end != '\0') {
+        return false;
+    }
+    time_t since = timegm(&tm);
+    if (since == (time_t) -1 || since > time(NULL)) {
+        return false;
+    }
+    return v->mtime <= (int64_t) since;
+}
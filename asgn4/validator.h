@@ -0,0 +1,54 @@
+/**
+ * @File validator.h
+ *
+ * The validators of an object's current version, the strong ETag and
+ * Last-Modified date sent with it, and the conditional request headers
+ * (If-None-Match and If-Modified-Since, RFC 9110, section 13) that are
+ * checked against them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+/** @struct validator_t
+ *
+ *  @brief An object's ETag (quotes included) and Last-Modified date, as
+ *         they are sent, and its modification time in seconds.
+ */
+typedef struct validator {
+    char etag[64];
+    char last_modified[32];
+    int64_t mtime;
+} validator_t;
+
+/** @brief Derive the validators of a regular file from its stat.  PUTs
+ *         rename a new file over the object, so every version has its own
+ *         inode; the ETag is made from the inode, the modification time
+ *         (in nanoseconds) and the size.
+ */
+void validator_from_stat(validator_t *v, const struct stat *st);
+
+/** @brief Derive the validators of an object kept in the store from its
+ *         record: the ETag is made from the record's version (unique to
+ *         it), modification time (in nanoseconds) and size, with an "s" in
+ *         front so that it can't match a file's.
+ */
+void validator_from_record(validator_t *v, uint64_t version, int64_t mtime_ns, uint64_t size);
+
+/** @brief Turn an object's validators into those of its gzip-compressed
+ *         form.  That has different bytes, so it needs an ETag of its own
+ *         (the object's, with "-gz" added).
+ */
+void validator_gzip(validator_t *v);
+
+/** @brief Whether a GET or HEAD with the given If-None-Match and
+ *         If-Modified-Since headers (either may be NULL) should be
+ *         answered with a 304.  If-None-Match takes precedence, and an
+ *         If-Modified-Since date that is malformed or in the future is
+ *         ignored.
+ */
+bool validator_not_modified(
+    const validator_t *v, const char *if_none_match, const char *if_modified_since);
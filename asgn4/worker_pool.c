@@ -0,0 +1,412 @@
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "worker_pool.h"
+
+// Build with WORK_STEALING=0 for one queue shared by all workers, for comparison
+#ifndef WORK_STEALING
+#define WORK_STEALING 1
+#endif
+
+#define QUEUE_PER_WORKER 8 // a worker's backlog; stealing evens out the rest
+#define CACHE_LINE_SIZE  64
+#define TICK_MS          10 // how often the supervisor looks at the pool
+#define GROW_WAIT_NS     1000000 // a queue wait this long means the workers are behind
+#define RETIRE_IDLE_MS   2000 // a worker idle this long exits, if there are more than min
+
+typedef struct worker_queue {
+    _Alignas(CACHE_LINE_SIZE) queue_t *queue;
+    _Atomic uint64_t steals; // items this worker took from others
+} worker_queue_t;
+
+struct worker_pool {
+    int min;
+    int max;
+    int cpus;
+    int nqueues;
+    worker_queue_t *queues;
+    worker_pool_ops_t ops;
+    pthread_t supervisor;
+    _Atomic uint64_t grown;
+    _Atomic uint64_t shrunk;
+    _Atomic uint32_t cursor; // next queue to submit to
+    _Atomic int workers; // workers 0 to workers - 1 are running
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint32_t epoch; // futex word bumped to wake idle workers
+    _Atomic uint32_t idle; // workers parked (or about to park) on epoch
+    _Alignas(CACHE_LINE_SIZE) _Atomic int blocked; // workers inside block_begin/end
+    _Atomic uint64_t wait_max; // longest queue wait since the supervisor last looked
+};
+
+typedef struct worker_arg {
+    worker_pool_t *pool;
+    int id;
+} worker_arg_t;
+
+static void futex_wait(_Atomic uint32_t *word, uint32_t val, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (long) (timeout_ms % 1000) * 1000000L };
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t *word, int count) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+}
+
+worker_pool_t *worker_pool_new(int min, int max) {
+    if (min < 1 || max < min) {
+        return NULL;
+    }
+    worker_pool_t *pool = aligned_alloc(CACHE_LINE_SIZE, sizeof(worker_pool_t));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->min = min;
+    pool->max = max;
+    pool->cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (pool->cpus < 1) {
+        pool->cpus = 1;
+    }
+
+    // A queue for every worker there may ever be, so that growing never moves one
+    pool->nqueues = WORK_STEALING ? max : 1;
+    pool->queues = aligned_alloc(CACHE_LINE_SIZE, pool->nqueues * sizeof(worker_queue_t));
+    if (pool->queues == NULL) {
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < pool->nqueues; i++) {
+        pool->queues[i].queue = queue_new(WORK_STEALING ? QUEUE_PER_WORKER : max);
+        atomic_init(&pool->queues[i].steals, 0);
+        if (pool->queues[i].queue == NULL) {
+            pool->nqueues = i;
+            worker_pool_delete(&pool);
+            return NULL;
+        }
+    }
+    atomic_init(&pool->grown, 0);
+    atomic_init(&pool->shrunk, 0);
+    atomic_init(&pool->cursor, 0);
+    atomic_init(&pool->workers, 0);
+    atomic_init(&pool->epoch, 0);
+    atomic_init(&pool->idle, 0);
+    atomic_init(&pool->blocked, 0);
+    atomic_init(&pool->wait_max, 0);
+    return pool;
+}
+
+void worker_pool_delete(worker_pool_t **pool) {
+    if (pool == NULL || *pool == NULL) {
+        return;
+    }
+    for (int i = 0; i < (*pool)->nqueues; i++) {
+        queue_delete(&(*pool)->queues[i].queue);
+    }
+    free((*pool)->queues);
+    free(*pool);
+    *pool = NULL;
+}
+
+// Function to wake up to n parked workers, but only pay for the syscall if one is parked.
+// As in queue.c, reading idle with an RMW orders it against a parking worker's increment:
+// either we see the worker, or it sees the new items when it looks again.
+static void wake_idle(worker_pool_t *pool, int n) {
+    uint32_t idle = atomic_fetch_add(&pool->idle, 0);
+    if (idle > 0) {
+        atomic_fetch_add(&pool->epoch, 1);
+        futex_wake(&pool->epoch, n < (int) idle ? n : (int) idle);
+    }
+}
+
+// Function to get what is left of a wait of wait_ms that began at start (ms); negative waits
+// never run out
+static int wait_left(int wait_ms, uint64_t start) {
+    if (wait_ms < 0) {
+        return -1;
+    }
+    uint64_t spent = now_ms() - start;
+    return spent >= (uint64_t) wait_ms ? 0 : wait_ms - (int) spent;
+}
+
+// Function to push an item onto a full queue, waiting at most left ms (forever if negative)
+static bool push_wait(queue_t *queue, void *item, int left) {
+    if (left < 0) {
+        return queue_push(queue, item);
+    }
+    return left > 0 ? queue_push_timed(queue, item, left) : queue_try_push(queue, item);
+}
+
+int worker_pool_submit_n(worker_pool_t *pool, void **items, int n, int wait_ms) {
+    uint64_t start = wait_ms > 0 ? now_ms() : 0;
+    if (pool->nqueues == 1) {
+        if (wait_ms < 0) {
+            queue_push_n(pool->queues[0].queue, items, n);
+            return n;
+        }
+        for (int i = 0; i < n; i++) {
+            if (!push_wait(pool->queues[0].queue, items[i], wait_left(wait_ms, start))) {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    // Only running workers' queues get new items.  One that just exited may still be handed
+    // one by a submitter that read workers before it dropped, but every worker steals from
+    // every queue, so the item is still served.
+    int workers = atomic_load_explicit(&pool->workers, memory_order_relaxed);
+    if (workers < 1) {
+        workers = 1;
+    }
+    int pushed = 0;
+    for (int i = 0; i < n; i++) {
+        // Skip full queues; if they are all full, wait for the one whose turn it is, after
+        // making sure its worker is awake to empty it
+        uint32_t first = atomic_fetch_add_explicit(&pool->cursor, 1, memory_order_relaxed);
+        int q = (int) (first % (uint32_t) workers);
+        int k = 0;
+        while (k < workers && !queue_try_push(pool->queues[(q + k) % workers].queue, items[i])) {
+            k++;
+        }
+        if (k == workers) {
+            wake_idle(pool, pool->nqueues);
+            pushed = 0;
+            if (!push_wait(pool->queues[q].queue, items[i], wait_left(wait_ms, start))) {
+                return i;
+            }
+        }
+        pushed++;
+    }
+    wake_idle(pool, pushed);
+    return n;
+}
+
+// Function to take an item from worker's own queue, or else from the next non-empty one
+static void *try_take(worker_pool_t *pool, int worker) {
+    void *item = NULL;
+    if (queue_try_pop(pool->queues[worker].queue, &item)) {
+        return item;
+    }
+    for (int k = 1; k < pool->nqueues; k++) {
+        if (queue_try_pop(pool->queues[(worker + k) % pool->nqueues].queue, &item)) {
+            atomic_fetch_add_explicit(&pool->queues[worker].steals, 1, memory_order_relaxed);
+            return item;
+        }
+    }
+    return NULL;
+}
+
+// Function to let worker exit, if it is the highest-numbered one and there are more than min
+static bool try_retire(worker_pool_t *pool, int worker) {
+    int expected = worker + 1;
+    if (expected <= pool->min
+        || !atomic_compare_exchange_strong(&pool->workers, &expected, worker)) {
+        return false;
+    }
+    atomic_fetch_add_explicit(&pool->shrunk, 1, memory_order_relaxed);
+
+    // The next worker down may have been idle just as long; let it look now, not at its
+    // next timeout
+    wake_idle(pool, pool->nqueues);
+    return true;
+}
+
+// Function to get worker its next item, or NULL once it has been idle long enough to exit
+static void *take(worker_pool_t *pool, int worker) {
+    void *item = NULL;
+    if (pool->nqueues == 1) {
+        for (;;) {
+            atomic_fetch_add(&pool->idle, 1);
+            bool got = queue_pop_timed(pool->queues[0].queue, &item, RETIRE_IDLE_MS);
+            atomic_fetch_sub(&pool->idle, 1);
+            if (got) {
+                return item;
+            }
+            if (try_retire(pool, worker)) {
+                return NULL;
+            }
+        }
+    }
+
+    uint64_t idle_since = 0;
+    for (;;) {
+        if ((item = try_take(pool, worker)) != NULL) {
+            return item;
+        }
+        uint64_t now = now_ms();
+        if (idle_since == 0) {
+            idle_since = now;
+        } else if (now - idle_since >= RETIRE_IDLE_MS && try_retire(pool, worker)) {
+            return NULL;
+        }
+
+        // Announce that we are about to sleep, then look once more before sleeping
+        uint32_t seen = atomic_load(&pool->epoch);
+        atomic_fetch_add(&pool->idle, 1);
+        item = try_take(pool, worker);
+        if (item == NULL) {
+            futex_wait(&pool->epoch, seen, RETIRE_IDLE_MS);
+        }
+        atomic_fetch_sub(&pool->idle, 1);
+        if (item != NULL) {
+            return item;
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_arg_t *wa = arg;
+    worker_pool_t *pool = wa->pool;
+    int id = wa->id;
+    free(wa);
+
+    const worker_pool_ops_t *ops = &pool->ops;
+    if (ops->start != NULL) {
+        ops->start(ops->ctx, id);
+    }
+    void *item;
+    while ((item = take(pool, id)) != NULL) {
+        ops->serve(ops->ctx, id, item);
+    }
+
+    // No new items come to our queue now; serve what is already there
+    if (pool->nqueues > 1) {
+        while (queue_try_pop(pool->queues[id].queue, &item)) {
+            ops->serve(ops->ctx, id, item);
+        }
+    }
+    if (ops->stop != NULL) {
+        ops->stop(ops->ctx, id);
+    }
+    return NULL;
+}
+
+// Function to start worker id; the caller has already counted it in pool->workers
+static bool spawn(worker_pool_t *pool, int id) {
+    worker_arg_t *wa = malloc(sizeof(worker_arg_t));
+    if (wa == NULL) {
+        return false;
+    }
+    wa->pool = pool;
+    wa->id = id;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    int rc = pthread_create(&thread, &attr, worker_main, wa);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        free(wa);
+        return false;
+    }
+    return true;
+}
+
+// Function to add a worker when the running ones are falling behind: nobody is idle, and
+// either requests have been waiting in the queues while there are CPUs no worker is using, or
+// half the workers are stuck (e.g. behind a writer) with requests queued up behind them.  Long
+// waits with every CPU busy only mean the machine is saturated; more threads would not help.
+static void *supervisor_main(void *arg) {
+    worker_pool_t *pool = arg;
+    struct timespec tick = { 0, TICK_MS * 1000000L };
+    for (;;) {
+        nanosleep(&tick, NULL);
+        uint64_t wait = atomic_exchange_explicit(&pool->wait_max, 0, memory_order_relaxed);
+        int workers = atomic_load(&pool->workers);
+        if (workers >= pool->max || atomic_load(&pool->idle) > 0) {
+            continue;
+        }
+        int blocked = atomic_load_explicit(&pool->blocked, memory_order_relaxed);
+        bool behind = wait >= GROW_WAIT_NS && workers - blocked < pool->cpus;
+        if (!behind && blocked * 2 >= workers) {
+            for (int i = 0; i < pool->nqueues && !behind; i++) {
+                behind = queue_size(pool->queues[i].queue) > 0;
+            }
+        }
+        if (!behind) {
+            continue;
+        }
+
+        // Only the top worker ever leaves, and it can't be workers, so this can't race
+        if (atomic_compare_exchange_strong(&pool->workers, &workers, workers + 1)) {
+            if (spawn(pool, workers)) {
+                atomic_fetch_add_explicit(&pool->grown, 1, memory_order_relaxed);
+            } else {
+                atomic_fetch_sub(&pool->workers, 1);
+            }
+        }
+    }
+    return NULL;
+}
+
+int worker_pool_start(worker_pool_t *pool, const worker_pool_ops_t *ops) {
+    pool->ops = *ops;
+    for (int i = 0; i < pool->min; i++) {
+        atomic_fetch_add(&pool->workers, 1);
+        if (!spawn(pool, i)) {
+            atomic_fetch_sub(&pool->workers, 1);
+            break;
+        }
+    }
+    if (atomic_load(&pool->workers) == 0) {
+        return -1;
+    }
+
+    // A pool that can't grow needs no supervisor
+    if (pool->max > pool->min) {
+        pthread_create(&pool->supervisor, NULL, supervisor_main, pool);
+        pthread_detach(pool->supervisor);
+    }
+    return 0;
+}
+
+int worker_pool_reclaim(worker_pool_t *pool, void **items, int max) {
+    int n = 0;
+    for (int i = 0; i < pool->nqueues && n < max; i++) {
+        while (n < max && queue_try_pop(pool->queues[i].queue, &items[n])) {
+            n++;
+        }
+    }
+    return n;
+}
+
+void worker_pool_note_wait(worker_pool_t *pool, uint64_t ns) {
+    if (ns > atomic_load_explicit(&pool->wait_max, memory_order_relaxed)) {
+        atomic_store_explicit(&pool->wait_max, ns, memory_order_relaxed);
+    }
+}
+
+void worker_pool_block_begin(worker_pool_t *pool) {
+    atomic_fetch_add_explicit(&pool->blocked, 1, memory_order_relaxed);
+}
+
+void worker_pool_block_end(worker_pool_t *pool) {
+    atomic_fetch_sub_explicit(&pool->blocked, 1, memory_order_relaxed);
+}
+
+void worker_pool_stats(worker_pool_t *pool, worker_pool_stats_t *stats) {
+    stats->workers = atomic_load(&pool->workers);
+    stats->min = pool->min;
+    stats->max = pool->max;
+    stats->idle = (int) atomic_load(&pool->idle);
+    stats->blocked = atomic_load(&pool->blocked);
+    stats->queued = 0;
+    stats->steals = 0;
+    for (int i = 0; i < pool->nqueues; i++) {
+        stats->queued += queue_size(pool->queues[i].queue);
+        stats->steals += atomic_load_explicit(&pool->queues[i].steals, memory_order_relaxed);
+    }
+    stats->grown = atomic_load(&pool->grown);
+    stats->shrunk = atomic_load(&pool->shrunk);
+}
@@ -0,0 +1,102 @@
+/**
+ * @File worker_pool.h
+ *
+ * The worker threads and how parsed requests get to them.  Each worker
+ * has its own queue_t; the reactor deals requests out round-robin, a
+ * worker serves its own queue first, and a worker whose queue is empty
+ * steals from the others before it sleeps.  Sleeping workers park on one
+ * pool-wide futex, so a request pushed onto any queue can wake them.
+ *
+ * The pool is elastic.  A supervisor thread adds workers (up to max)
+ * while requests wait too long in the queues or too many workers are
+ * blocked, e.g. behind a writer, and a worker that has been idle for a
+ * while exits (down to min).  Only the highest-numbered worker exits, so
+ * the workers are always 0 to workers - 1.
+ *
+ * Built with WORK_STEALING=0, the workers share one queue instead.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** @struct worker_pool_t
+ *
+ *  @brief The workers' queues, the futex idle workers sleep on, and the
+ *         supervisor.
+ */
+typedef struct worker_pool worker_pool_t;
+
+/** @brief What the workers run.  start and stop may be NULL.
+ */
+typedef struct worker_pool_ops {
+    void (*start)(void *ctx, int worker); /**< on a new worker, before its first item */
+    void (*serve)(void *ctx, int worker, void *item); /**< for every item */
+    void (*stop)(void *ctx, int worker); /**< on a worker that is about to exit */
+    void *ctx;
+} worker_pool_ops_t;
+
+/** @brief A snapshot of the pool, for monitoring.
+ */
+typedef struct worker_pool_stats {
+    int workers; /**< running now */
+    int min;
+    int max;
+    int idle; /**< waiting for an item */
+    int blocked; /**< inside worker_pool_block_begin/end */
+    int queued; /**< items waiting in the queues */
+    uint64_t steals; /**< items a worker took from another worker's queue */
+    uint64_t grown; /**< workers the supervisor added */
+    uint64_t shrunk; /**< workers that exited after idling */
+} worker_pool_stats_t;
+
+/** @brief Creates the queues for a pool of min to max workers.  No
+ *         worker runs until worker_pool_start.
+ *
+ *  @return a pointer to a new worker_pool_t, or NULL on failure.
+ */
+worker_pool_t *worker_pool_new(int min, int max);
+
+/** @brief Delete a pool that was never started, and its queues; *pool is
+ *         set to NULL.  Items still queued are not freed.
+ */
+void worker_pool_delete(worker_pool_t **pool);
+
+/** @brief Start min workers running ops, and the supervisor.
+ *
+ *  @return 0, or -1 if no thread could be started.
+ */
+int worker_pool_start(worker_pool_t *pool, const worker_pool_ops_t *ops);
+
+/** @brief Hand n items to the workers, spreading them round-robin over
+ *         their queues.  If every queue is full, waits at most wait_ms in
+ *         all for room (for as long as it takes if wait_ms is negative).
+ *         Safe to call from any thread.
+ *
+ *  @return how many items were handed over: n, or the first that many if
+ *          the wait ran out.  The caller still owns the rest.
+ */
+int worker_pool_submit_n(worker_pool_t *pool, void **items, int n, int wait_ms);
+
+/** @brief Take back up to max items that are still waiting in the queues,
+ *         e.g. to answer them some cheaper way while every worker is stuck.
+ *         Safe to call from any thread.
+ *
+ *  @return how many items were stored in items; the caller owns them.
+ */
+int worker_pool_reclaim(worker_pool_t *pool, void **items, int max);
+
+/** @brief Report how long an item waited in the queue before a worker
+ *         took it.  Long waits make the supervisor add workers.
+ */
+void worker_pool_note_wait(worker_pool_t *pool, uint64_t ns);
+
+/** @brief Bracket a wait that may be long, e.g. for a lock.  While half
+ *         the workers are blocked, the supervisor adds workers.
+ */
+void worker_pool_block_begin(worker_pool_t *pool);
+void worker_pool_block_end(worker_pool_t *pool);
+
+/** @brief Fill *stats with a snapshot of the pool.
+ */
+void worker_pool_stats(worker_pool_t *pool, worker_pool_stats_t *stats);